@@ -1,18 +1,562 @@
 #include <virtmem-continued.h>
 #include <alloc/stdio_alloc.h>
+#include <alloc/static_alloc.h>
 
 #include <chrono>
+#include <cstdlib>
 #include <iostream>
 
+#include <thread>
+#include <vector>
+
 using namespace virtmem;
 
 enum
 {
     STDIO_POOLSIZE = 1024 * 128 + 128,
     STDIO_BUFSIZE = 1024 * 128,
-    STDIO_REPEATS = 50
+    STDIO_REPEATS = 50,
+
+    // sequential reading with read-ahead
+    READAHEAD_POOLSIZE = 1024 * 1024 + 128,
+    READAHEAD_BUFSIZE = 1024 * 1024,
+    READAHEAD_REPEATS = 10,
+
+    // chunks processed by a computation, optionally loading the next chunk in the background
+    PREFETCH_CHUNKSIZE = 1024 * 16,
+    PREFETCH_WORK = 64,
+
+    // repeated writes to resident pages, optionally with locked data elsewhere
+    RESIDENT_POOLSIZE = 1024 * 48 + 128,
+    RESIDENT_BUFSIZE = 1024 * 32,
+    RESIDENT_REPEATS = 200,
+    RESIDENT_LOCKSIZE = 16,
+
+    // mixed workload: random accesses to a hot set, regularly interrupted by a sequential scan
+    POLICY_POOLSIZE = 1024 * 96 + 128,
+    POLICY_HOTSIZE = 1024 * 4,
+    POLICY_SCANSIZE = 1024 * 64,
+    POLICY_HOTACCESSES = 2000,
+    POLICY_REPEATS = 50,
+
+    // random accesses to a compressible working set that is larger than the big pages
+    VICTIM_POOLSIZE = 1024 * 32 + 128,
+    VICTIM_BUFSIZE = 1024 * 32,
+    VICTIM_ACCESSES = 200000,
+
+    // random allocation and release of small blocks
+    CHURN_POOLSIZE = 1024 * 256,
+    CHURN_LIVEBLOCKS = 256,
+    CHURN_MAXSIZE = 128,
+    CHURN_OPERATIONS = 100000,
+
+    // repeatedly growing buffers that can't be resized in place
+    GROW_POOLSIZE = 1024 * 1024,
+    GROW_STARTSIZE = 1024,
+    GROW_MAXSIZE = 1024 * 128,
+    GROW_REPEATS = 200,
+
+    // random accesses by multiple threads to their own part of a shared buffer
+    THREAD_POOLSIZE = 1024 * 64 + 128,
+    THREAD_BUFSIZE = 1024 * 64,
+    THREAD_OPERATIONS = 200000,
+    THREAD_LOCKSIZE = 16,
+    THREAD_MAXTHREADS = 32,
+
+    // records that are each on their own page, processed by coroutines (whose misses are loaded together)
+    // or by blocking accesses
+    TASK_POOLSIZE = 1024 * 1024 + 128,
+    TASK_RECORDSIZE = 1024,
+    TASK_RECORDS = 1024,
+    TASK_COUNT = 16,
+    TASK_REPEATS = 20
+};
+
+struct ReadAheadProperties
+{
+    static const uint8_t smallPageCount = 4, smallPageSize = 32;
+    static const uint8_t mediumPageCount = 4, mediumPageSize = 128;
+    static const uint8_t bigPageCount = 16;
+    static const uint16_t bigPageSize = 1024 * 4;
+    static const bool bigPageGrid = true;
+};
+
+#ifdef VIRTMEM_READ_AHEAD
+void benchReadAhead(uint8_t depth)
+{
+    StdioVAllocP<ReadAheadProperties> vAlloc(READAHEAD_POOLSIZE);
+
+    vAlloc.start();
+    vAlloc.setReadAheadDepth(depth);
+
+    StdioVAllocP<ReadAheadProperties>::TVPtr<char>::type buf = vAlloc.alloc<char>(READAHEAD_BUFSIZE);
+    vAlloc.clearPages();
+#ifdef VIRTMEM_TRACE_STATS
+    vAlloc.resetStats();
+#endif
+
+    char sum = 0;
+    const auto time = std::chrono::high_resolution_clock::now();
+    for (int i=0; i<READAHEAD_REPEATS; ++i)
+    {
+        for (int j=0; j<READAHEAD_BUFSIZE; ++j)
+            sum += buf[j];
+    }
+
+    const unsigned difftime =
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - time).count();
+
+    std::cout << "Read-ahead depth " << (int)depth << ": " << READAHEAD_REPEATS * READAHEAD_BUFSIZE / difftime * 1000 / 1024 << " kB/s";
+#ifdef VIRTMEM_TRACE_STATS
+    std::cout << ", page reads: " << vAlloc.getBigPageReads() << ", read ahead: " << vAlloc.getBigPagePrefetches()
+              << " (useful: " << vAlloc.getUsefulPrefetches() << ", wasted: " << vAlloc.getWastedPrefetches() << ")";
+#endif
+    std::cout << " (" << (int)sum << ")\n";
+
+    vAlloc.stop();
+}
+#endif
+
+void benchPrefetch(bool prefetch)
+{
+    typedef StdioVAllocP<ReadAheadProperties> Alloc;
+    Alloc vAlloc(READAHEAD_POOLSIZE);
+
+    vAlloc.start();
+#ifdef VIRTMEM_READ_AHEAD
+    vAlloc.setReadAhead(false);
+#endif
+
+    Alloc::TVPtr<char>::type buf = vAlloc.alloc<char>(READAHEAD_BUFSIZE);
+    vAlloc.clearPages();
+#ifdef VIRTMEM_TRACE_STATS
+    vAlloc.resetStats();
+#endif
+
+    unsigned sum = 0;
+    const auto time = std::chrono::high_resolution_clock::now();
+    for (int i=0; i<READAHEAD_REPEATS; ++i)
+    {
+        for (int c=0; c<READAHEAD_BUFSIZE; c+=PREFETCH_CHUNKSIZE)
+        {
+            if (prefetch && (c + PREFETCH_CHUNKSIZE) < READAHEAD_BUFSIZE)
+                (buf + c + PREFETCH_CHUNKSIZE).prefetch(PREFETCH_CHUNKSIZE);
+            for (int j=c; j<(c + PREFETCH_CHUNKSIZE); ++j)
+            {
+                const char v = buf[j];
+                for (int k=0; k<PREFETCH_WORK; ++k)
+                    sum = sum * 31 + v + k;
+            }
+        }
+    }
+
+    const unsigned difftime =
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - time).count();
+
+    std::cout << "Chunk processing (" << ((prefetch) ? "prefetch" : "no prefetch") << "): " << difftime << " ms";
+#ifdef VIRTMEM_TRACE_STATS
+    std::cout << ", page reads: " << vAlloc.getBigPageReads() << ", prefetched: " << vAlloc.getBigPagePrefetches();
+#endif
+    std::cout << " (" << sum << ")\n";
+
+    vAlloc.stop();
+}
+
+void benchResidentAccess(uint8_t locks)
+{
+    StdioVAllocP<ReadAheadProperties> vAlloc(RESIDENT_POOLSIZE);
+
+    vAlloc.start();
+
+    StdioVAllocP<ReadAheadProperties>::TVPtr<char>::type buf = vAlloc.alloc<char>(RESIDENT_BUFSIZE);
+    StdioVAllocP<ReadAheadProperties>::TVPtr<char>::type lockbuf = vAlloc.alloc<char>(RESIDENT_LOCKSIZE * 4);
+    for (uint8_t i=0; i<locks; ++i)
+        vAlloc.makeDataLock(lockbuf.getRawNum() + i * RESIDENT_LOCKSIZE, RESIDENT_LOCKSIZE);
+
+    const auto time = std::chrono::high_resolution_clock::now();
+    for (int i=0; i<RESIDENT_REPEATS; ++i)
+    {
+        for (int j=0; j<RESIDENT_BUFSIZE; ++j)
+            buf[j] = (char)j;
+    }
+
+    const unsigned difftime =
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - time).count();
+
+    std::cout << "Resident page writes (" << (int)locks << " locks): " << RESIDENT_REPEATS * RESIDENT_BUFSIZE / difftime * 1000 / 1024 << " kB/s\n";
+
+    for (uint8_t i=0; i<locks; ++i)
+        vAlloc.releaseLock(lockbuf.getRawNum() + i * RESIDENT_LOCKSIZE);
+    vAlloc.stop();
+}
+
+#ifdef VIRTMEM_TRACE_STATS
+template <uint8_t policy> struct PolicyProperties
+{
+    static const uint8_t smallPageCount = 4, smallPageSize = 32;
+    static const uint8_t mediumPageCount = 4, mediumPageSize = 128;
+    static const uint8_t bigPageCount = 16;
+    static const uint16_t bigPageSize = 512;
+    static const uint8_t bigPagePolicy = policy;
+};
+
+// replacement policy of the benchmarks of other features
+#ifdef VIRTMEM_PAGE_POLICIES
+enum { BENCH_PAGE_POLICY = PAGE_POLICY_LRU };
+#else
+enum { BENCH_PAGE_POLICY = PAGE_POLICY_FIFO };
+#endif
+
+template <uint8_t policy> void benchPolicy(const char *name)
+{
+    StdioVAllocP<PolicyProperties<policy> > vAlloc(POLICY_POOLSIZE);
+
+    vAlloc.start();
+
+    typename StdioVAllocP<PolicyProperties<policy> >::template TVPtr<char>::type hot = vAlloc.template alloc<char>(POLICY_HOTSIZE);
+    typename StdioVAllocP<PolicyProperties<policy> >::template TVPtr<char>::type scan = vAlloc.template alloc<char>(POLICY_SCANSIZE);
+
+    vAlloc.resetStats();
+    srand(1);
+    char sum = 0;
+    for (int i=0; i<POLICY_REPEATS; ++i)
+    {
+        for (int j=0; j<POLICY_HOTACCESSES; ++j)
+            sum += hot[rand() % POLICY_HOTSIZE];
+        for (int j=0; j<POLICY_SCANSIZE; j+=64)
+            sum += scan[j];
+    }
+
+    const uint32_t accesses = vAlloc.getBigPageHits() + vAlloc.getBigPageReads();
+    std::cout << name << ": " << vAlloc.getBigPageReads() << " page reads, hit ratio: "
+              << (100.0 * vAlloc.getBigPageHits() / accesses) << "% (" << (int)sum << ")\n";
+
+    vAlloc.stop();
+}
+
+#ifdef VIRTMEM_VICTIM_CACHE
+template <uint16_t cacheSize> struct VictimCacheProperties : public PolicyProperties<BENCH_PAGE_POLICY>
+{
+    static const bool bigPageGrid = true;
+    static const uint16_t victimCacheSize = cacheSize;
+};
+
+template <uint16_t cacheSize> void benchVictimCache(void)
+{
+    StdioVAllocP<VictimCacheProperties<cacheSize> > vAlloc(VICTIM_POOLSIZE);
+
+    vAlloc.start();
+
+    typename StdioVAllocP<VictimCacheProperties<cacheSize> >::template TVPtr<int>::type buf =
+            vAlloc.template alloc<int>(VICTIM_BUFSIZE / sizeof(int));
+    for (int i=0; i<(int)(VICTIM_BUFSIZE / sizeof(int)); ++i)
+        buf[i] = (i / 64) * 0x01010101; // compressible
+
+    vAlloc.resetStats();
+    srand(1);
+    int sum = 0;
+    const auto time = std::chrono::high_resolution_clock::now();
+    for (int i=0; i<VICTIM_ACCESSES; ++i)
+    {
+        const int j = rand() % (VICTIM_BUFSIZE / sizeof(int));
+        if (i & 1)
+            buf[j] = (j / 64) * 0x01010101;
+        else
+            sum += buf[j];
+    }
+    vAlloc.flush();
+
+    const unsigned difftime =
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - time).count();
+
+    const uint32_t lookups = vAlloc.getVictimCacheHits() + vAlloc.getVictimCacheMisses();
+    std::cout << "Victim cache " << cacheSize << " bytes: " << difftime << " ms, page reads: " << vAlloc.getBigPageReads()
+              << ", page writes: " << vAlloc.getBigPageWrites() << ", hit ratio: "
+              << ((lookups) ? (100.0 * vAlloc.getVictimCacheHits() / lookups) : 0.0) << "%, compression ratio: "
+              << ((vAlloc.getVictimCacheRawBytes()) ? (100.0 * vAlloc.getVictimCacheStoredBytes() / vAlloc.getVictimCacheRawBytes()) : 100.0)
+              << "% (" << sum << ")\n";
+
+    vAlloc.stop();
+}
+#endif
+
+template <uint8_t classes, uint8_t engine> struct ChurnProperties : public PolicyProperties<BENCH_PAGE_POLICY>
+{
+    static const bool bigPageGrid = true;
+    static const uint8_t sizeClassCount = classes;
+    static const uint8_t allocEngine = engine;
+    static const uint32_t buddyMinSize = 16, buddyBlockCount = CHURN_POOLSIZE / 16;
 };
 
+template <uint8_t classes, uint8_t engine=ALLOC_ENGINE_FREELIST> void benchAllocChurn(void)
+{
+    StdioVAllocP<ChurnProperties<classes, engine> > vAlloc(CHURN_POOLSIZE);
+
+    vAlloc.start();
+
+    VPtrNum blocks[CHURN_LIVEBLOCKS];
+    srand(1);
+    for (int i=0; i<CHURN_LIVEBLOCKS; ++i)
+        blocks[i] = vAlloc.allocRaw(1 + rand() % CHURN_MAXSIZE);
+
+    vAlloc.resetStats();
+    const auto time = std::chrono::high_resolution_clock::now();
+    for (int i=0; i<CHURN_OPERATIONS; ++i)
+    {
+        const int j = rand() % CHURN_LIVEBLOCKS;
+        vAlloc.freeRaw(blocks[j]);
+        blocks[j] = vAlloc.allocRaw(1 + rand() % CHURN_MAXSIZE);
+    }
+
+    const unsigned difftime =
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - time).count();
+
+    if (engine == ALLOC_ENGINE_BUDDY)
+        std::cout << "Alloc churn (buddy): ";
+    else
+        std::cout << "Alloc churn (" << (int)classes << " size classes): ";
+    std::cout << difftime << " ms, page reads: " << vAlloc.getBigPageReads() << ", page hits: " << vAlloc.getBigPageHits();
+#ifdef VIRTMEM_SIZE_CLASSES
+    std::cout << ", size class hits: " << vAlloc.getSizeClassHits();
+#endif
+    std::cout << "\n";
+
+    vAlloc.stop();
+}
+#endif
+
+struct GrowProperties : public DefaultAllocProperties { };
+
+void benchGrowBuffer(bool userealloc)
+{
+    typedef StdioVAllocP<GrowProperties> Alloc;
+    Alloc vAlloc(GROW_POOLSIZE);
+
+    vAlloc.start();
+
+    const auto time = std::chrono::high_resolution_clock::now();
+    for (int i=0; i<GROW_REPEATS; ++i)
+    {
+        Alloc::TVPtr<char>::type buf = vAlloc.alloc<char>(GROW_STARTSIZE);
+        virtmem::memset(buf, i, GROW_STARTSIZE);
+        for (VPtrSize size=GROW_STARTSIZE; size<GROW_MAXSIZE; size*=2)
+        {
+            // block following the buffer prevents growing in place
+            Alloc::TVPtr<char>::type blocker = vAlloc.alloc<char>(16);
+
+            if (userealloc)
+                buf = vAlloc.realloc(buf, size * 2);
+            else
+            {
+                Alloc::TVPtr<char>::type newbuf = vAlloc.alloc<char>(size * 2);
+                virtmem::memcpy(newbuf, buf, size);
+                vAlloc.free(buf);
+                buf = newbuf;
+            }
+            vAlloc.free(blocker);
+        }
+        vAlloc.free(buf);
+    }
+
+    const unsigned difftime =
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - time).count();
+
+    std::cout << "Grow buffer (" << ((userealloc) ? "realloc" : "alloc+memcpy") << "): " << difftime << " ms\n";
+
+    vAlloc.stop();
+}
+
+// every thread uses its own allocator instance, with a part of the memory pool and its own page cache
+struct ShardProperties : public DefaultAllocProperties
+{
+    static const uint8_t bigPageCount = THREAD_BUFSIZE / (1024 * 4); // slices stay cached
+    static const uint16_t bigPageSize = 1024 * 4;
+    static const bool bigPageGrid = true;
+    static const bool multiInstance = true;
+};
+
+void benchShards(void)
+{
+    typedef StdioVAllocP<ShardProperties> Alloc;
+
+    for (int threadcount=1; threadcount<=THREAD_MAXTHREADS; threadcount*=2)
+    {
+        const int operations = THREAD_OPERATIONS / threadcount, slicesize = THREAD_BUFSIZE / threadcount;
+        const auto time = std::chrono::high_resolution_clock::now();
+
+        std::vector<std::thread> threads;
+        for (int t=0; t<threadcount; ++t)
+        {
+            threads.push_back(std::thread([operations, slicesize, t]()
+            {
+                Alloc vAlloc(slicesize + 128);
+                vAlloc.start();
+
+                Alloc::TVPtr<char>::type slice = vAlloc.alloc<char>(slicesize);
+                virtmem::memset(slice, 0, slicesize);
+                uint32_t seed = t + 1;
+                for (int i=0; i<operations; ++i)
+                {
+                    seed = seed * 1103515245 + 12345;
+                    const int j = (seed >> 8) % slicesize;
+                    if (i & 1)
+                        slice[j] = (char)i;
+                    else
+                        seed += slice[j];
+                }
+
+                vAlloc.free(slice);
+                vAlloc.stop();
+            }));
+        }
+        for (size_t t=0; t<threads.size(); ++t)
+            threads[t].join();
+
+        const unsigned difftime =
+                std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - time).count();
+
+        std::cout << "Shards (" << threadcount << " threads): " << difftime << " ms, "
+                  << THREAD_OPERATIONS / ((difftime) ? difftime : 1) << " ops/ms\n";
+    }
+}
+
+#ifdef VIRTMEM_THREAD_SAFE
+// every thread may hold a lock, which may also lock a big page if the data is cached there
+struct ThreadProperties : public DefaultAllocProperties
+{
+    static const uint8_t smallPageCount = THREAD_MAXTHREADS, smallPageSize = 64;
+    static const uint8_t bigPageCount = THREAD_MAXTHREADS + 16;
+    static const bool bigPageGrid = true;
+    static const uint8_t cacheShards = 8;
+};
+
+template <typename Alloc> void benchThreads(Alloc &vAlloc, const char *name, bool readonly)
+{
+    vAlloc.start();
+
+    typedef typename Alloc::template TVPtr<char>::type CharPtr;
+    CharPtr buf = vAlloc.template alloc<char>(THREAD_BUFSIZE);
+    virtmem::memset(buf, 0, THREAD_BUFSIZE);
+    vAlloc.flush(); // clean pages can be read without locking
+
+    for (int threadcount=1; threadcount<=THREAD_MAXTHREADS; threadcount*=2)
+    {
+        // the total amount of operations is divided over the threads
+        const int operations = THREAD_OPERATIONS / threadcount, slicesize = THREAD_BUFSIZE / threadcount;
+        const auto time = std::chrono::high_resolution_clock::now();
+
+        std::vector<std::thread> threads;
+        for (int t=0; t<threadcount; ++t)
+        {
+            threads.push_back(std::thread([&buf, operations, slicesize, readonly, t]()
+            {
+                CharPtr slice = buf + (t * slicesize);
+                uint32_t seed = t + 1;
+                for (int i=0; i<operations; ++i)
+                {
+                    seed = seed * 1103515245 + 12345;
+                    const int j = (seed >> 8) % (slicesize - THREAD_LOCKSIZE);
+                    if (readonly)
+                        seed += slice[j];
+                    else if ((i % 64) == 0)
+                    {
+                        VPtrLock<CharPtr> lock = makeVirtPtrLock(slice + j, THREAD_LOCKSIZE);
+                        for (int k=0; k<(int)lock.getLockSize(); ++k)
+                            ++(*lock)[k];
+                    }
+                    else if (i & 1)
+                        slice[j] = (char)i;
+                    else
+                        seed += slice[j];
+                }
+            }));
+        }
+        for (size_t t=0; t<threads.size(); ++t)
+            threads[t].join();
+
+        const unsigned difftime =
+                std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - time).count();
+
+        std::cout << "Threads (" << name << ((readonly) ? ", reads" : "") << ", " << threadcount << " threads): " << difftime << " ms, "
+                  << THREAD_OPERATIONS / ((difftime) ? difftime : 1) << " ops/ms\n";
+    }
+
+    vAlloc.free(buf);
+    vAlloc.stop();
+}
+#endif
+
+#ifdef VIRTMEM_COROUTINES
+struct TaskProperties
+{
+    static const uint8_t smallPageCount = 4, smallPageSize = 32;
+    static const uint8_t mediumPageCount = 4, mediumPageSize = 128;
+    static const uint8_t bigPageCount = 64;
+    static const uint16_t bigPageSize = 1024;
+    static const bool bigPageGrid = true;
+};
+
+typedef StdioVAllocP<TaskProperties> TaskAlloc;
+
+VTask recordTask(TaskAlloc &vAlloc, TaskAlloc::TVPtr<int>::type buf, int first, unsigned *sum)
+{
+    // every task handles every TASK_COUNT'th record, so that the records of suspended tasks are adjacent
+    for (int i=first; i<TASK_RECORDS; i+=TASK_COUNT)
+        *sum += *co_await vAlloc.readAsync(buf + i * (TASK_RECORDSIZE / sizeof(int)));
+}
+
+void benchTasks(bool coroutines)
+{
+    TaskAlloc vAlloc(TASK_POOLSIZE);
+
+    vAlloc.start();
+#ifdef VIRTMEM_READ_AHEAD
+    vAlloc.setReadAhead(false);
+#endif
+
+    TaskAlloc::TVPtr<int>::type buf = vAlloc.alloc<int>(TASK_RECORDSIZE * TASK_RECORDS);
+    for (int i=0; i<TASK_RECORDS; ++i)
+        buf[i * (TASK_RECORDSIZE / sizeof(int))] = i;
+    vAlloc.clearPages();
+#ifdef VIRTMEM_TRACE_STATS
+    vAlloc.resetStats();
+#endif
+
+    unsigned sum = 0;
+    uint32_t requests = 0;
+    const auto time = std::chrono::high_resolution_clock::now();
+    for (int r=0; r<TASK_REPEATS; ++r)
+    {
+        if (coroutines)
+        {
+            VTaskScheduler scheduler;
+            for (int t=0; t<TASK_COUNT; ++t)
+                scheduler.spawn(recordTask(vAlloc, buf, t, &sum));
+            scheduler.run();
+            requests += scheduler.getRequestCount();
+        }
+        else
+        {
+            for (int i=0; i<TASK_RECORDS; ++i)
+                sum += buf[i * (TASK_RECORDSIZE / sizeof(int))];
+        }
+    }
+
+    const unsigned difftime =
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - time).count();
+
+    std::cout << "Record processing (" << ((coroutines) ? "coroutines" : "blocking") << "): " << difftime << " ms";
+    if (coroutines)
+        std::cout << ", load requests: " << requests;
+#ifdef VIRTMEM_TRACE_STATS
+    std::cout << ", page reads: " << vAlloc.getBigPageReads() << ", prefetched: " << vAlloc.getBigPagePrefetches();
+#endif
+    std::cout << " (" << sum << ")\n";
+
+    vAlloc.stop();
+}
+#endif
+
 int main()
 {
     StdioVAlloc vAlloc(STDIO_POOLSIZE);
@@ -34,6 +578,62 @@ int main()
     std::cout << "Finished in " << difftime << " ms\n";
     std::cout << "Speed: " << STDIO_REPEATS * STDIO_BUFSIZE / difftime * 1000 / 1024 << " kB/s\n";
 
+    vAlloc.stop();
+
+#ifdef VIRTMEM_READ_AHEAD
+    benchReadAhead(0);
+    benchReadAhead(2);
+    benchReadAhead(8);
+#endif
+
+    benchPrefetch(false);
+    benchPrefetch(true);
+
+    benchResidentAccess(0);
+    benchResidentAccess(4);
+
+    benchGrowBuffer(false);
+    benchGrowBuffer(true);
+
+#ifdef VIRTMEM_TRACE_STATS
+    benchPolicy<PAGE_POLICY_FIFO>("FIFO");
+#ifdef VIRTMEM_PAGE_POLICIES
+    benchPolicy<PAGE_POLICY_LRU>("LRU");
+    benchPolicy<PAGE_POLICY_CLOCK>("CLOCK");
+    benchPolicy<PAGE_POLICY_2Q>("2Q");
+#endif
+
+#ifdef VIRTMEM_VICTIM_CACHE
+    benchVictimCache<0>();
+    benchVictimCache<1024 * 4>();
+    benchVictimCache<1024 * 8>();
+#endif
+
+    benchAllocChurn<0>();
+#ifdef VIRTMEM_SIZE_CLASSES
+    benchAllocChurn<9>();
+#endif
+#ifdef VIRTMEM_BUDDY_ALLOC
+    benchAllocChurn<0, ALLOC_ENGINE_BUDDY>();
+#endif
+#endif
+
+    benchShards();
+
+#ifdef VIRTMEM_COROUTINES
+    benchTasks(false);
+    benchTasks(true);
+#endif
+
+#ifdef VIRTMEM_THREAD_SAFE
+    StdioVAllocP<ThreadProperties> stdioAlloc(THREAD_POOLSIZE);
+    benchThreads(stdioAlloc, "stdio", false);
+    benchThreads(stdioAlloc, "stdio", true);
+    static StaticVAllocP<THREAD_POOLSIZE, ThreadProperties> staticAlloc;
+    benchThreads(staticAlloc, "static", false);
+    benchThreads(staticAlloc, "static", true);
+#endif
+
     return 0;
 }
 
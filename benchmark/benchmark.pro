@@ -4,7 +4,10 @@ CONFIG -= app_bundle
 CONFIG -= qt
 
 SOURCES += \
-    benchmark.cpp
+    benchmark.cpp \
+    ../src/base_alloc.cpp \
+    ../src/codec.cpp \
+    ../src/utils.cpp
 
 include(deployment.pri)
 qtcAddDeployment()
@@ -12,7 +15,13 @@ qtcAddDeployment()
 INCLUDEPATH += $$PWD/../src .
 DEPENDPATH += $$PWD/../src
 
-LIBS += -L$$PWD/../src/ -lvirtmem
-unix:!macx: PRE_TARGETDEPS += $$PWD/../src/libvirtmem.a
+include($$PWD/../src/features.pri)
+
+# build the library sources directly, so statistics (e.g. page hits) can be enabled
+DEFINES += VIRTMEM_TRACE_STATS
 
 QMAKE_CXXFLAGS +=  -std=gnu++11
+
+# enable to include the multi-threaded benchmark
+# DEFINES += VIRTMEM_THREAD_SAFE
+QMAKE_LFLAGS += -pthread
@@ -0,0 +1,7 @@
+# Same benchmark built as C++20, which includes the coroutine benchmark (VIRTMEM_COROUTINES)
+include(benchmark.pro)
+
+TARGET = benchmark_cpp20
+OBJECTS_DIR = cpp20
+QMAKE_CXXFLAGS -= -std=gnu++11
+QMAKE_CXXFLAGS += -std=gnu++20
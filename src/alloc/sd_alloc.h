@@ -81,9 +81,9 @@ class SDVAllocP : public VAlloc<Properties, SDVAllocP<Properties> >
         if (_sdBegan) {
             _ramFile = _sdClass->open(_ramFilename.c_str(), FILE_WRITE);
 
-            // make file the right size if needed
+            // make file the right size if needed, with lazy zero filling the file grows when written (see doWrite())
             const uint32_t size = _ramFile.size();
-            if (size < this->getPoolSize()) {
+            if (size < this->getPoolSize() && !this->hasLazyZeroFill()) {
                 this->writeZeros(size, this->getPoolSize() - size);
             }
         }
@@ -111,6 +111,16 @@ class SDVAllocP : public VAlloc<Properties, SDVAllocP<Properties> >
     void doWrite(const void *data, VPtrSize offset, VPtrSize size)
     {
 //        const uint32_t t = micros();
+        const uint32_t fsize = _ramFile.size();
+        if (offset > fsize) {
+            // FAT files cannot have holes: fill the gap
+            uint8_t zeros[64];
+            memset(zeros, 0, sizeof(zeros));
+            _ramFile.seek(fsize);
+            for (uint32_t i=fsize; i<offset; i+=sizeof(zeros)) {
+                _ramFile.write(zeros, private_utils::minimal((uint32_t)(offset - i), (uint32_t)sizeof(zeros)));
+            }
+        }
         _ramFile.seek(offset);
         _ramFile.write((const uint8_t *)data, size);
 //        Serial.print("write: "); Serial.print(size); Serial.print("/"); Serial.println(micros() - t);
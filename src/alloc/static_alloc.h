@@ -27,7 +27,7 @@ namespace virtmem {
  * @sa @ref bUsing
  */
 
-template <uint32_t poolSize=VIRTMEM_DEFAULT_POOLSIZE, typename Properties=DefaultAllocProperties>
+template <VPtrSize poolSize=VIRTMEM_DEFAULT_POOLSIZE, typename Properties=DefaultAllocProperties>
 class StaticVAllocP : public VAlloc<Properties, StaticVAllocP<poolSize, Properties> >
 {
     char staticData[poolSize];
@@ -12,6 +12,20 @@
 #include <stdio.h>
 #include <string.h>
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#define VIRTMEM_STDIO_TRUNCATE
+#endif
+
+#ifdef VIRTMEM_CPP11
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#define VIRTMEM_STDIO_ASYNC
+#endif
+
 namespace virtmem {
 
 /**
@@ -19,6 +33,9 @@ namespace virtmem {
  *
  * This class is meant for debugging and can only be used on systems supporting stdio (e.g. PCs).
  *
+ * When compiled as C++11, asynchronous transfers (e.g. started by BaseVAlloc::prefetch()) are performed by
+ * a worker thread, which is started by \ref start() and stopped by \ref stop().
+ *
  * @tparam Properties Allocator properties, see DefaultAllocProperties
  *
  * @sa @ref bUsing
@@ -27,18 +44,97 @@ template <typename Properties = DefaultAllocProperties>
 class StdioVAllocP : public VAlloc<Properties, StdioVAllocP<Properties> >
 {
     FILE *ramFile;
+    const char *ramFileName;
 
-    void doStart(void)
+#ifdef VIRTMEM_STDIO_ASYNC
+    struct AsyncRequest
     {
-        ramFile = tmpfile();
-        if (!ramFile)
-            fprintf(stderr, "Unable to open ram file!");
-        this->writeZeros(0, this->getPoolSize()); // make sure it gets the right size
+        bool write;
+        void *data;
+        VPtrSize offset, size;
+        BaseVAlloc::AsyncCallback callback;
+        void *arg;
+    };
+
+    std::thread ioThread;
+    std::mutex ioMutex;
+    std::condition_variable ioCondition;
+    std::deque<AsyncRequest> pendingIO; // the first request is being transferred
+    std::vector<AsyncRequest> completedIO; // callbacks are called by doWaitAsync()
+    bool ioQuit;
+
+    void ioLoop(void)
+    {
+        std::unique_lock<std::mutex> lock(ioMutex);
+        for (;;)
+        {
+            ioCondition.wait(lock, [this] { return ioQuit || !pendingIO.empty(); });
+            if (pendingIO.empty())
+                return;
+
+            const AsyncRequest req = pendingIO.front();
+            lock.unlock();
+            if (req.write)
+                writeFile(req.data, req.offset, req.size);
+            else
+                readFile(req.data, req.offset, req.size);
+            lock.lock();
+
+            pendingIO.pop_front();
+            completedIO.push_back(req);
+            ioCondition.notify_all();
+        }
     }
 
-    void doSuspend(void) { }
-    void doStop(void) { if (ramFile) { fclose(ramFile); ramFile = 0; } }
-    void doRead(void *data, VPtrSize offset, VPtrSize size)
+    // Waits until the worker thread is idle, so the file may be accessed directly
+    void waitIdle(std::unique_lock<std::mutex> &lock)
+    {
+        ioCondition.wait(lock, [this] { return pendingIO.empty(); });
+    }
+
+    void queueRequest(bool write, void *data, VPtrSize offset, VPtrSize size, BaseVAlloc::AsyncCallback callback, void *arg)
+    {
+        if (!ioThread.joinable())
+        {
+            // not started (or unable to open the file)
+            if (write)
+                doWrite(data, offset, size);
+            else
+                doRead(data, offset, size);
+            callback(this, arg);
+            return;
+        }
+
+        const AsyncRequest req = { write, data, offset, size, callback, arg };
+        std::lock_guard<std::mutex> lock(ioMutex);
+        pendingIO.push_back(req);
+        ioCondition.notify_all();
+    }
+
+    void doReadAsync(void *data, VPtrSize offset, VPtrSize size, BaseVAlloc::AsyncCallback callback, void *arg)
+    {
+        queueRequest(false, data, offset, size, callback, arg);
+    }
+
+    void doWriteAsync(const void *data, VPtrSize offset, VPtrSize size, BaseVAlloc::AsyncCallback callback, void *arg)
+    {
+        queueRequest(true, const_cast<void *>(data), offset, size, callback, arg);
+    }
+
+    void doWaitAsync(void)
+    {
+        std::vector<AsyncRequest> done;
+        {
+            std::unique_lock<std::mutex> lock(ioMutex);
+            waitIdle(lock);
+            done.swap(completedIO);
+        }
+        for (size_t i=0; i<done.size(); ++i)
+            done[i].callback(this, done[i].arg);
+    }
+#endif
+
+    void readFile(void *data, VPtrSize offset, VPtrSize size)
     {
         if (fseek(ramFile, offset, SEEK_SET) != 0)
             fprintf(stderr, "fseek error: %s\n", strerror(errno));
@@ -46,10 +142,9 @@ class StdioVAllocP : public VAlloc<Properties, StdioVAllocP<Properties> >
         fread(data, size, 1, ramFile);
         if (ferror(ramFile))
             fprintf(stderr, "didn't read correctly: %s\n", strerror(errno));
-
     }
 
-    void doWrite(const void *data, VPtrSize offset, VPtrSize size)
+    void writeFile(const void *data, VPtrSize offset, VPtrSize size)
     {
         if (fseek(ramFile, offset, SEEK_SET) != 0)
             fprintf(stderr, "fseek error: %s\n", strerror(errno));
@@ -59,13 +154,91 @@ class StdioVAllocP : public VAlloc<Properties, StdioVAllocP<Properties> >
             fprintf(stderr, "didn't write correctly: %s\n", strerror(errno));
     }
 
+    void doStart(void)
+    {
+        if (ramFileName)
+        {
+            ramFile = fopen(ramFileName, "r+b"); // reuse existing file
+            if (!ramFile)
+                ramFile = fopen(ramFileName, "w+b");
+        }
+        else
+            ramFile = tmpfile();
+
+        if (!ramFile)
+        {
+            fprintf(stderr, "Unable to open ram file!");
+            return;
+        }
+
+        // make sure it gets the right size
+        // NOTE: this is done before the worker thread is started, since the file is accessed directly here
+        fseek(ramFile, 0, SEEK_END);
+        const long size = ftell(ramFile);
+        if (size < 0)
+            fprintf(stderr, "ftell error: %s\n", strerror(errno));
+        else if ((VPtrSize)size < this->getPoolSize())
+        {
+#ifdef VIRTMEM_STDIO_TRUNCATE
+            // resize at once: the new part of the file is sparse and reads as zeros
+            if (ftruncate(fileno(ramFile), this->getPoolSize()) == 0)
+                this->setPoolZeroed(size == 0);
+            else
+#endif
+                this->writeZeros(size, this->getPoolSize() - size);
+        }
+
+#ifdef VIRTMEM_STDIO_ASYNC
+        ioQuit = false;
+        ioThread = std::thread(&StdioVAllocP::ioLoop, this);
+#endif
+    }
+
+    void doSuspend(void) { }
+    void doStop(void)
+    {
+#ifdef VIRTMEM_STDIO_ASYNC
+        if (ioThread.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(ioMutex);
+                ioQuit = true;
+                ioCondition.notify_all();
+            }
+            ioThread.join(); // NOTE: pending transfers are finished first
+        }
+#endif
+        if (ramFile) { fclose(ramFile); ramFile = 0; }
+    }
+
+    void doRead(void *data, VPtrSize offset, VPtrSize size)
+    {
+#ifdef VIRTMEM_STDIO_ASYNC
+        std::unique_lock<std::mutex> lock(ioMutex);
+        waitIdle(lock);
+#endif
+        readFile(data, offset, size);
+    }
+
+    void doWrite(const void *data, VPtrSize offset, VPtrSize size)
+    {
+#ifdef VIRTMEM_STDIO_ASYNC
+        std::unique_lock<std::mutex> lock(ioMutex);
+        waitIdle(lock);
+#endif
+        writeFile(data, offset, size);
+    }
+
 public:
     /**
      * @brief Constructs (but not initializes) the allocator.
      * @param ps Total amount of bytes of the memory pool.
+     * @param file Name of the file used as memory pool, which is reused if it exists
+     * (e.g. for persistent pools, see BaseVAlloc::setPersistent). The string is not copied. If zero,
+     * a temporary file is used.
      * @sa setPoolSize
      */
-    StdioVAllocP(VPtrSize ps=VIRTMEM_DEFAULT_POOLSIZE) : ramFile(0) { this->setPoolSize(ps); }
+    StdioVAllocP(VPtrSize ps=VIRTMEM_DEFAULT_POOLSIZE, const char *file=0) : ramFile(0), ramFileName(file) { this->setPoolSize(ps); }
     ~StdioVAllocP(void) { doStop(); }
 };
 
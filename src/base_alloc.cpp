@@ -9,6 +9,7 @@
  */
 
 #include "internal/base_alloc.h"
+#include "internal/codec.h"
 #include "internal/utils.h"
 
 #include <string.h>
@@ -19,18 +20,35 @@
 #include <stdio.h>
 #endif
 
+// Scoped locks for concurrent mode (see VIRTMEM_THREAD_SAFE), the allocation state is always locked first
+#ifdef VIRTMEM_THREAD_SAFE
+#define VIRTMEM_LOCK_ALLOC() std::lock_guard<std::recursive_mutex> allocGuard(allocMutex)
+#define VIRTMEM_LOCK_CACHE() CacheGuard cacheGuard(this)
+#define VIRTMEM_LOCK_RANGE(p, size) CacheGuard cacheGuard(this, p, size)
+#define VIRTMEM_LOCK_VICTIM() std::lock_guard<std::mutex> victimGuard(victimMutex)
+#define VIRTMEM_LOCK_POOL() std::lock_guard<std::mutex> poolGuard(poolMutex)
+#else
+#define VIRTMEM_LOCK_ALLOC()
+#define VIRTMEM_LOCK_CACHE()
+#define VIRTMEM_LOCK_RANGE(p, size)
+#define VIRTMEM_LOCK_VICTIM()
+#define VIRTMEM_LOCK_POOL()
+#endif
+
 namespace virtmem {
 
 
-void BaseVAlloc::initPages(PageInfo *info, LockPage *pages, uint8_t *pool, uint8_t pcount, VirtPageSize psize)
+void BaseVAlloc::initPages(PageInfo *info, LockPage *pages, uint8_t *pool, VirtPageIndex pcount, VirtPageSize psize)
 {
     info->pages = pages;
     info->count = pcount;
     info->size = psize;
     info->freeIndex = 0;
     info->lockedIndex = -1;
+    info->index = 0;
+    info->indexMask = 0;
 
-    for (uint8_t i=0; i<pcount; ++i)
+    for (VirtPageIndex i=0; i<pcount; ++i)
     {
 #ifndef NVALGRIND
         const int start = i * (psize + valgrindPad * 2);
@@ -42,6 +60,143 @@ void BaseVAlloc::initPages(PageInfo *info, LockPage *pages, uint8_t *pool, uint8
     }
 }
 
+void BaseVAlloc::initBigPageGrid(bool grid)
+{
+    bigPageGrid = grid;
+    bigPageShift = 0;
+    if (grid)
+    {
+        ASSERT((bigPages.size & (bigPages.size - 1)) == 0);
+        while ((1u << bigPageShift) < bigPages.size)
+            ++bigPageShift;
+    }
+}
+
+#ifdef VIRTMEM_THREAD_SAFE
+void BaseVAlloc::initFrameVersions(FrameVersion *versions, VirtPageIndex count)
+{
+    frameVersions = versions;
+    for (VirtPageIndex i=0; i<count; ++i)
+        frameVersions[i].version.store(1, std::memory_order_relaxed); // unpublished
+    for (uint8_t i=0; i<PAGE_TLB_SIZE; ++i)
+        frameHints[i].store(-1, std::memory_order_relaxed);
+}
+#endif
+
+void BaseVAlloc::clearPageIndex(PageInfo *pinfo)
+{
+    for (uint32_t b=0; b<=pinfo->indexMask; ++b)
+        pinfo->index[b] = -1;
+    for (VirtPageIndex i=0; i<pinfo->count; ++i)
+        pinfo->pages[i].indexNext = -1;
+    if (pinfo == &bigPages)
+    {
+        unalignedBigPages = 0;
+        unpublishFrames();
+    }
+}
+
+// Adds an unlocked page in use to the page index. Pages are hashed by their page number, ie start / page size.
+void BaseVAlloc::indexPage(PageInfo *pinfo, VirtPageIndex index)
+{
+    ASSERT(pinfo->pages[index].start != 0);
+    ASSERT(pinfo != &bigPages || getPageShard(pinfo->pages[index].start) == getFrameShard(index));
+    const uint32_t bucket = (pinfo->pages[index].start / pinfo->size) & pinfo->indexMask;
+    pinfo->pages[index].indexNext = pinfo->index[bucket];
+    pinfo->index[bucket] = index;
+    if (pinfo == &bigPages && bigPageGrid && !isOnBigGrid(&pinfo->pages[index]))
+        ++unalignedBigPages;
+}
+
+void BaseVAlloc::unindexPage(PageInfo *pinfo, VirtPageIndex index)
+{
+    if (pinfo == &bigPages)
+        unpublishFrame(&pinfo->pages[index]); // the page will be reused or locked
+    const uint32_t bucket = (pinfo->pages[index].start / pinfo->size) & pinfo->indexMask;
+    if (pinfo->index[bucket] == index)
+        pinfo->index[bucket] = pinfo->pages[index].indexNext;
+    else
+    {
+        VirtPageIndex previ = pinfo->index[bucket];
+        for (; previ != -1 && pinfo->pages[previ].indexNext != index; previ=pinfo->pages[previ].indexNext)
+            ;
+        ASSERT(previ != -1);
+        pinfo->pages[previ].indexNext = pinfo->pages[index].indexNext;
+    }
+    pinfo->pages[index].indexNext = -1;
+    if (pinfo == &bigPages && bigPageGrid && !isOnBigGrid(&pinfo->pages[index]))
+        --unalignedBigPages;
+
+#ifdef VIRTMEM_PAGE_TLB
+    if (pinfo == &bigPages)
+    {
+        // only entries of page numbers within the page can refer to it. NOTE: entries of other cache shards
+        // may be used concurrently
+        const VPtrNum first = pinfo->pages[index].start >> tlbShift;
+        const VPtrNum last = (pinfo->pages[index].start + pinfo->pages[index].size - 1) >> tlbShift;
+        for (VPtrNum n=first; n<=last && (n - first)<PAGE_TLB_SIZE; ++n)
+        {
+            TLBEntry *entry = &pageTLB[n & (PAGE_TLB_SIZE - 1)];
+            if (entry->page == index)
+                entry->generation = 0;
+        }
+    }
+#endif
+
+    // pages are unindexed before they are swapped, invalidated or locked
+    if (pinfo->pages[index].flags & PAGE_PREFETCHED)
+    {
+        pinfo->pages[index].flags &= ~PAGE_PREFETCHED;
+#ifdef VIRTMEM_TRACE_STATS
+        ++wastedPrefetches;
+#endif
+    }
+}
+
+// Returns an indexed page which starts within [start, end), or -1 if there is none
+VirtPageIndex BaseVAlloc::findIndexedPageStart(const PageInfo *pinfo, VPtrNum start, VPtrNum end) const
+{
+    if (start >= end)
+        return -1;
+
+    VPtrNum pagenr = start / pinfo->size;
+    const VPtrNum lastpagenr = (end - 1) / pinfo->size;
+
+    // every bucket is visited at most once
+    if ((lastpagenr - pagenr) > pinfo->indexMask)
+        pagenr = lastpagenr - pinfo->indexMask;
+
+    for (; pagenr<=lastpagenr; ++pagenr)
+    {
+        for (VirtPageIndex i=pinfo->index[pagenr & pinfo->indexMask]; i!=-1; i=pinfo->pages[i].indexNext)
+        {
+            if (pinfo->pages[i].start >= start && pinfo->pages[i].start < end)
+                return i;
+        }
+    }
+
+    return -1;
+}
+
+// Returns an indexed page which fully contains the given range, or -1 if there is none
+VirtPageIndex BaseVAlloc::findIndexedPage(const PageInfo *pinfo, VPtrNum p, VPtrSize size) const
+{
+    // pages are never larger than the page size, so only two page numbers have to be checked. Pages on the
+    // big page grid start at their own page number: the previous bucket may belong to another cache shard.
+    const VPtrNum pagenr = p / pinfo->size;
+    const bool aligned = (pinfo == &bigPages && bigPageGrid && unalignedBigPages == 0);
+    for (VPtrNum n=((pagenr && !aligned) ? (pagenr - 1) : pagenr); n<=pagenr; ++n)
+    {
+        for (VirtPageIndex i=pinfo->index[n & pinfo->indexMask]; i!=-1; i=pinfo->pages[i].indexNext)
+        {
+            if (p >= pinfo->pages[i].start && (p - pinfo->pages[i].start + size) <= pinfo->pages[i].size)
+                return i;
+        }
+    }
+
+    return -1;
+}
+
 VPtrNum BaseVAlloc::getMem(VPtrSize size)
 {
     size = private_utils::maximal(size, (VPtrSize)MIN_ALLOC_SIZE);
@@ -54,12 +209,8 @@ VPtrNum BaseVAlloc::getMem(VPtrSize size)
         UMemHeader h;
         h.s.size = size;
         h.s.next = 0;
-        write(poolFreePos, &h, sizeof(UMemHeader));
-#ifdef VIRTMEM_TRACE_STATS
-        // HACK: increase here to balance the subtraction by free()
-        memUsed += totalsize;
-#endif
-        freeRaw(poolFreePos + sizeof(UMemHeader));
+        // NOTE: added to the free list directly, as freeRaw() may keep it in a size class
+        freeBlock(poolFreePos, &h);
         poolFreePos += totalsize;
     }
     else
@@ -68,6 +219,46 @@ VPtrNum BaseVAlloc::getMem(VPtrSize size)
     return freePointer;
 }
 
+// Returns the dirty big page whose modified data directly follows that of the given page, both in
+// virtual memory and in RAM, so both can be written at once. Returns -1 if there is none.
+VirtPageIndex BaseVAlloc::findFlushNext(VirtPageIndex index) const
+{
+    const LockPage *page = &bigPages.pages[index];
+    if (!page->dirty || getDirtyEnd(page) != page->size)
+        return -1;
+
+    const VirtPageIndex next = findIndexedPageStart(&bigPages, page->start + page->size, page->start + page->size + 1);
+    if (next == -1 || !bigPages.pages[next].dirty || getDirtyStart(&bigPages.pages[next]) != 0 ||
+        bigPages.pages[next].pool != (page->pool + page->size))
+        return -1;
+
+    return next;
+}
+
+// Marks a part of a page as modified. If VIRTMEM_DIRTY_RANGES is defined only the modified range is written when
+// the page is synchronized, otherwise the whole page.
+void BaseVAlloc::markDirty(LockPage *page, VPtrSize offset, VPtrSize size)
+{
+    if (!page->dirty)
+    {
+        unpublishFrame(page); // NOTE: called before the data is modified
+        page->dirty = true;
+#ifdef VIRTMEM_DIRTY_RANGES
+        page->dirtyStart = offset;
+        page->dirtyEnd = offset + size;
+#endif
+    }
+#ifdef VIRTMEM_DIRTY_RANGES
+    else
+    {
+        page->dirtyStart = private_utils::minimal(page->dirtyStart, (VirtPageSize)offset);
+        page->dirtyEnd = private_utils::maximal(page->dirtyEnd, (VirtPageSize)(offset + size));
+    }
+#else
+    (void)offset; (void)size;
+#endif
+}
+
 void BaseVAlloc::syncBigPage(LockPage *page)
 {
     ASSERT(page->start != 0);
@@ -75,8 +266,10 @@ void BaseVAlloc::syncBigPage(LockPage *page)
     if (page->dirty)
     {
 //        std::cout << "dirty page\n";
-        const VirtPageSize wrsize = private_utils::minimal((poolSize - page->start), (VPtrSize)bigPages.size);
-        doWrite(page->pool, page->start, wrsize);
+        const VirtPageSize dstart = getDirtyStart(page);
+        const VPtrNum wrstart = page->start + dstart;
+        const VirtPageSize wrsize = private_utils::minimal((poolSize - wrstart), (VPtrSize)(getDirtyEnd(page) - dstart));
+        writePool(page->pool + dstart, wrstart, wrsize);
         page->dirty = false;
         page->cleanSkips = 0;
 #ifdef VIRTMEM_TRACE_STATS
@@ -92,37 +285,34 @@ void BaseVAlloc::copyRawData(void *dest, VPtrNum p, VPtrSize size)
     // Note that the size of these pages are never smaller than the copy size,
     // so it is impossible that more than two pages overlap
 
-    for (int8_t i=bigPages.freeIndex; i!=-1 && size; i=bigPages.pages[i].next)
+    VirtPageIndex i;
+    while (size && (i = findIndexedPage(&bigPages, p)) != -1) // start address within a page?
     {
-        if (!bigPages.pages[i].start)
-            continue;
-
-        const VPtrNum pageend = bigPages.pages[i].start + bigPages.size;
-        if (p >= bigPages.pages[i].start && p < pageend) // start address within this page?
-        {
-            const VPtrSize offset = p - bigPages.pages[i].start;
-            const VPtrSize copysize = private_utils::minimal(size, bigPages.pages[i].size - offset);
-            memcpy(dest, bigPages.pages[i].pool + offset, copysize);
+        const VPtrSize offset = p - bigPages.pages[i].start;
+        const VPtrSize copysize = private_utils::minimal(size, bigPages.pages[i].size - offset);
+        memcpy(dest, bigPages.pages[i].pool + offset, copysize);
+
+        // move start to end of this page
+        dest = (uint8_t *)dest + copysize;
+        p += copysize;
+        size -= copysize;
+    }
 
-            // move start to end of this page
-            dest = (uint8_t *)dest + copysize;
-            p += copysize;
-            size -= copysize;
-        }
-        // end overlaps?
-        else if (p < bigPages.pages[i].start && (p + size) > bigPages.pages[i].start)
-        {
-            const VPtrSize offset = bigPages.pages[i].start - p;
-            const VPtrSize copysize = private_utils::minimal(size - offset, (VPtrSize)bigPages.pages[i].size);
-            memcpy((uint8_t *)dest + offset, bigPages.pages[i].pool, copysize);
-            size = offset;
-        }
+    // end overlaps?
+    while (size && (i = findIndexedPageStart(&bigPages, p + 1, p + size)) != -1)
+    {
+        const VPtrSize offset = bigPages.pages[i].start - p;
+        const VPtrSize copysize = private_utils::minimal(size - offset, (VPtrSize)bigPages.pages[i].size);
+        memcpy((uint8_t *)dest + offset, bigPages.pages[i].pool, copysize);
+        size = offset;
     }
 
     if (size > 0)
     {
         // read in rest of the data
-        doRead(dest, p, size);
+        if (getVictimCacheSize())
+            syncVictimRange(p, size, false);
+        readPool(dest, p, size);
 #ifdef VIRTMEM_TRACE_STATS
         bytesRead += size;
 #endif
@@ -132,50 +322,48 @@ void BaseVAlloc::copyRawData(void *dest, VPtrNum p, VPtrSize size)
 // This function is the reverse of copyRawData()
 void BaseVAlloc::saveRawData(void *src, VPtrNum p, VPtrSize size)
 {
-    for (int8_t i=bigPages.freeIndex; i!=-1 && size; i=bigPages.pages[i].next)
+    finishAsync(); // data that is not cached is written to the pool
+    VirtPageIndex i;
+    while (size && (i = findIndexedPage(&bigPages, p)) != -1) // start address within a page?
     {
-        if (!bigPages.pages[i].start)
-            continue;
+        const VPtrSize offset = p - bigPages.pages[i].start;
+        const VPtrSize copysize = private_utils::minimal(size, bigPages.pages[i].size - offset);
 
-        const VPtrNum pageend = bigPages.pages[i].start + bigPages.size;
-        if (p >= bigPages.pages[i].start && p < pageend) // start address within this page?
+        // only copy data if it changed
+        if (memcmp(bigPages.pages[i].pool + offset, src, copysize) != 0)
         {
-            const VPtrSize offset = p - bigPages.pages[i].start;
-            const VPtrSize copysize = private_utils::minimal(size, bigPages.pages[i].size - offset);
-
-            // only copy data if regular page is already dirty or data changed
-            if (bigPages.pages[i].dirty || memcmp(bigPages.pages[i].pool + offset, src, copysize) != 0)
-            {
-                memcpy(bigPages.pages[i].pool + offset, src, copysize);
-                bigPages.pages[i].dirty = true;
-            }
-
-            // move start to end of this page
-            src = (uint8_t *)src + copysize;
-            p += copysize;
-            size -= copysize;
+            markDirty(&bigPages.pages[i], offset, copysize);
+            memcpy(bigPages.pages[i].pool + offset, src, copysize);
         }
-        // end overlaps?
-        else if (p < bigPages.pages[i].start && (p + size) > bigPages.pages[i].start)
-        {
-            const VPtrSize offset = bigPages.pages[i].start - p;
-            const VPtrSize copysize = private_utils::minimal(size - offset, (VPtrSize)bigPages.pages[i].size);
 
-            // only copy data if regular page is already dirty or data changed
-            if (bigPages.pages[i].dirty || memcmp(bigPages.pages[i].pool, (uint8_t *)src + offset, copysize) != 0)
-            {
-                memcpy(bigPages.pages[i].pool, (uint8_t *)src + offset, copysize);
-                bigPages.pages[i].dirty = true;
-            }
+        // move start to end of this page
+        src = (uint8_t *)src + copysize;
+        p += copysize;
+        size -= copysize;
+    }
+
+    // end overlaps?
+    while (size && (i = findIndexedPageStart(&bigPages, p + 1, p + size)) != -1)
+    {
+        const VPtrSize offset = bigPages.pages[i].start - p;
+        const VPtrSize copysize = private_utils::minimal(size - offset, (VPtrSize)bigPages.pages[i].size);
 
-            size = offset;
+        // only copy data if it changed
+        if (memcmp(bigPages.pages[i].pool, (uint8_t *)src + offset, copysize) != 0)
+        {
+            markDirty(&bigPages.pages[i], 0, copysize);
+            memcpy(bigPages.pages[i].pool, (uint8_t *)src + offset, copysize);
         }
+
+        size = offset;
     }
 
     if (size > 0)
     {
         // read in rest of the data
-        doWrite(src, p, size);
+        if (getVictimCacheSize())
+            syncVictimRange(p, size, true); // cached data would become outdated
+        writePool(src, p, size);
 #ifdef VIRTMEM_TRACE_STATS
         bytesWritten += size;
 #endif
@@ -193,47 +381,94 @@ void *BaseVAlloc::pullRawData(VPtrNum p, VPtrSize size, bool readonly, bool forc
      * Otherwise if a 'clean' page is found use that but keep searching for the above.
      * Otherwise look for dirty pages in a FIFO way. */
 
-    int8_t pageindex = -1;
+    VirtPageIndex pageindex = -1;
     enum { STATE_GOTFULL, STATE_GOTPARTIAL, STATE_GOTEMPTY, STATE_GOTCLEAN, STATE_GOTDIRTY, STATE_GOTNONE } pagefindstate = STATE_GOTNONE;
 
+    // Grid mode: load pages at their fixed grid position, unless they should start at p or data crosses the grid
+    VPtrNum newstart = p;
+    VirtPageSize newsize = bigPages.size;
+    bool ongrid = false;
+    if (bigPageGrid && !forcestart)
+    {
+        const VPtrNum gridstart = getBigGridStart(p);
+        if ((p - gridstart + size) <= getBigGridSize(gridstart))
+        {
+            newstart = gridstart;
+            newsize = getBigGridSize(gridstart);
+            ongrid = true;
+        }
+    }
+
+    // the page is loaded in a big page of its cache shard
+    const uint8_t shard = getPageShard(newstart);
+    CacheShard *cshard = getShard(shard);
+
     // Start by looking for fitting pages, the ideal situation
-    if ((pageindex = findFreePage(&bigPages, p, size, forcestart)) != -1)
+    for (;;)
+    {
+        if (ongrid && unalignedBigPages == 0)
+            pageindex = findGridPage(newstart);
+        else
+            pageindex = findFreePage(&bigPages, p, size, forcestart);
+
+        if (pageindex != -1 || !asyncReads)
+            break;
+        finishAsync(); // the data may be loading, and pages should not be swapped while others are loaded
+    }
+
+    if (pageindex != -1)
         pagefindstate = STATE_GOTFULL;
     else
     {
-        const VPtrNum newpageend = p + bigPages.size;
-
-        for (int8_t i=bigPages.freeIndex; i!=-1; i=bigPages.pages[i].next)
+        // Invalidate all pages that contain either the start or the end of the new page.
+        // NOTE: pages on the grid never overlap each other
+        const VPtrNum overlapstart = (newstart > bigPages.size) ? (newstart - bigPages.size + 1) : 1;
+        VirtPageIndex i;
+        while ((!ongrid || unalignedBigPages != 0) &&
+               (i = findIndexedPageStart(&bigPages, overlapstart, newstart + newsize + 1)) != -1)
         {
-            if (bigPages.pages[i].start != 0)
-            {
-                const VPtrNum pageend = bigPages.pages[i].start + bigPages.size;
-                if ((p >= bigPages.pages[i].start && p < pageend) ||
-                    (newpageend >= bigPages.pages[i].start && newpageend <= pageend))
-                {
-                    pageindex = i;
-                    syncBigPage(&bigPages.pages[pageindex]);
-                    bigPages.pages[i].start = 0; // invalidate
-                    pagefindstate = STATE_GOTPARTIAL;
-                }
-            }
-            else if (pagefindstate != STATE_GOTPARTIAL)
+            syncBigPage(&bigPages.pages[i]);
+            unindexPage(&bigPages, i);
+            bigPages.pages[i].start = 0; // invalidate
+            if (getFrameShard(i) == shard)
             {
                 pageindex = i;
-                pagefindstate = STATE_GOTEMPTY;
+                pagefindstate = STATE_GOTPARTIAL;
             }
+        }
 
-            if (pagefindstate > STATE_GOTCLEAN)
+        if (pagefindstate != STATE_GOTPARTIAL)
+        {
+#ifdef VIRTMEM_PAGE_POLICIES
+            if (bigPagePolicy != PAGE_POLICY_FIFO)
             {
-                if (!bigPages.pages[i].dirty || (++bigPages.pages[i].cleanSkips) >= PAGE_MAX_CLEAN_SKIPS)
-                {
-                    pageindex = i;
-                    pagefindstate = STATE_GOTCLEAN;
-                }
-                else if (pagefindstate != STATE_GOTDIRTY && i == nextPageToSwap)
+                pageindex = findSwapPage(shard);
+                pagefindstate = (bigPages.pages[pageindex].start == 0) ? STATE_GOTEMPTY : STATE_GOTCLEAN;
+            }
+            else
+#endif
+            {
+                for (i=findShardFrame(bigPages.freeIndex, shard); i!=-1; i=findShardFrame(bigPages.pages[i].next, shard))
                 {
-                    pageindex = i;
-                    pagefindstate = STATE_GOTDIRTY;
+                    if (bigPages.pages[i].start == 0)
+                    {
+                        pageindex = i;
+                        pagefindstate = STATE_GOTEMPTY;
+                    }
+
+                    if (pagefindstate > STATE_GOTCLEAN)
+                    {
+                        if (!bigPages.pages[i].dirty || (++bigPages.pages[i].cleanSkips) >= PAGE_MAX_CLEAN_SKIPS)
+                        {
+                            pageindex = i;
+                            pagefindstate = STATE_GOTCLEAN;
+                        }
+                        else if (pagefindstate != STATE_GOTDIRTY && i == cshard->nextPageToSwap)
+                        {
+                            pageindex = i;
+                            pagefindstate = STATE_GOTDIRTY;
+                        }
+                    }
                 }
             }
         }
@@ -243,47 +478,74 @@ void *BaseVAlloc::pullRawData(VPtrNum p, VPtrSize size, bool readonly, bool forc
     ASSERT(pageindex != -1);
 
     // do we need to swap a page?
-    if (pagefindstate != STATE_GOTFULL)
+    bool firstuse = (pagefindstate != STATE_GOTFULL);
+    if (firstuse)
     {
 //        std::cout << "getPool switches " << (page - memPageList) << " from: " << page->start << " to " << p << std::endl;
 
         if (bigPages.pages[pageindex].start != 0)
-            syncBigPage(&bigPages.pages[pageindex]);
+        {
+            if (!storeVictimPage(&bigPages.pages[pageindex]))
+                syncBigPage(&bigPages.pages[pageindex]);
+            unindexPage(&bigPages, pageindex);
+        }
 
         if (pagefindstate == STATE_GOTDIRTY)
         {
-            nextPageToSwap = bigPages.pages[pageindex].next;
-            if (nextPageToSwap == -1)
-                nextPageToSwap = bigPages.freeIndex;
+            cshard->nextPageToSwap = findShardFrame(bigPages.pages[pageindex].next, shard);
+            if (cshard->nextPageToSwap == -1)
+                cshard->nextPageToSwap = findShardFrame(bigPages.freeIndex, shard);
         }
         else
-            nextPageToSwap = bigPages.freeIndex;
+            cshard->nextPageToSwap = findShardFrame(bigPages.freeIndex, shard);
 
         // Load in page
-        if (/*!forcestart*/false) // check alignment UNDONE
-        {
-            const VPtrNum alignp = p - (p & (sizeof(TAlign) - 1));
-            if ((alignp + bigPages.size) >= (p + size))
-                bigPages.pages[pageindex].start = alignp;
-            else
-                bigPages.pages[pageindex].start = p;
-        }
-        else
-            bigPages.pages[pageindex].start = p;
+        bigPages.pages[pageindex].start = newstart;
+        bigPages.pages[pageindex].size = newsize;
+
+        indexPage(&bigPages, pageindex);
 
 //        std::cout << "start: " << bigPages.pages[pageindex].start <<"/" << p << std::endl;
 
-        const VirtPageSize rdsize = private_utils::minimal((poolSize - bigPages.pages[pageindex].start), (VPtrSize)bigPages.size);
-        doRead(bigPages.pages[pageindex].pool, bigPages.pages[pageindex].start, rdsize);
+        if (!loadVictimPage(&bigPages.pages[pageindex]))
+        {
+            const VirtPageSize rdsize = private_utils::minimal((poolSize - newstart), (VPtrSize)newsize);
+            readPool(bigPages.pages[pageindex].pool, bigPages.pages[pageindex].start, rdsize);
+
+#ifdef VIRTMEM_TRACE_STATS
+            ++bigPageReads;
+            bytesRead += rdsize;
+#endif
+        }
 
+#ifdef VIRTMEM_READ_AHEAD
+        if (readAheadEnabled && readAheadDepth && !forcestart)
+            readAhead(pageindex);
+#endif
+    }
+    else
+    {
 #ifdef VIRTMEM_TRACE_STATS
-        ++bigPageReads;
-        bytesRead += rdsize;
+        ++bigPageHits;
+#endif
+        if (bigPages.pages[pageindex].flags & PAGE_PREFETCHED)
+        {
+            // first access of a page that was read ahead: the stream continues from here
+            bigPages.pages[pageindex].flags &= ~PAGE_PREFETCHED;
+#ifdef VIRTMEM_READ_AHEAD
+            readAheadPage = bigPages.pages[pageindex].start / bigPages.size;
+#endif
+            firstuse = true;
+#ifdef VIRTMEM_TRACE_STATS
+            ++usefulPrefetches;
 #endif
+        }
     }
 
+    updatePageUse(pageindex, firstuse);
+
     if (!readonly)
-        bigPages.pages[pageindex].dirty = true;
+        markDirty(&bigPages.pages[pageindex], p - bigPages.pages[pageindex].start, size);
 
     ASSERT(p >= bigPages.pages[pageindex].start);
 
@@ -308,6 +570,15 @@ const BaseVAlloc::UMemHeader *BaseVAlloc::getHeaderConst(VPtrNum p)
     return reinterpret_cast<UMemHeader *>(read(p, sizeof(UMemHeader)));
 }
 
+// Returns a copy of a block header. The header may be unaligned in the page cache, for instance if a big page was
+// loaded for data at an unaligned address, so it should not be accessed through the pointer of getHeaderConst().
+BaseVAlloc::UMemHeader BaseVAlloc::getHeader(VPtrNum p)
+{
+    UMemHeader ret;
+    memcpy(&ret, getHeaderConst(p), sizeof(UMemHeader));
+    return ret;
+}
+
 void BaseVAlloc::updateHeader(VPtrNum p, UMemHeader *h)
 {
     if (p == BASE_INDEX)
@@ -316,163 +587,1258 @@ void BaseVAlloc::updateHeader(VPtrNum p, UMemHeader *h)
         write(p, h, sizeof(UMemHeader));
 }
 
-int8_t BaseVAlloc::findFreePage(BaseVAlloc::PageInfo *pinfo, VPtrNum p, VPtrSize size, bool atstart)
+VirtPageIndex BaseVAlloc::findFreePage(BaseVAlloc::PageInfo *pinfo, VPtrNum p, VPtrSize size, bool atstart)
 {
-    const VPtrNum pend = p + size;
-    for (int8_t i=pinfo->freeIndex; i!=-1; i=pinfo->pages[i].next)
-    {
-        if (pinfo->pages[i].start != 0 && ((atstart && pinfo->pages[i].start == p) ||
-            (!atstart && p >= pinfo->pages[i].start && pend <= (pinfo->pages[i].start + pinfo->pages[i].size))))
-            return i;
-    }
+    if (atstart)
+        return findIndexedPageStart(pinfo, p, p + 1);
+    return findIndexedPage(pinfo, p, size);
+}
 
-    return -1;
+#ifdef VIRTMEM_PAGE_TLB
+// Returns the big page from the translation cache which contains the given range, or 0 if there is none
+BaseVAlloc::LockPage *BaseVAlloc::findTLBPage(VPtrNum p, VPtrSize size)
+{
+    const TLBEntry *entry = getTLBEntry(p);
+    if (entry->generation != tlbGeneration)
+        return 0;
+
+    LockPage *page = &bigPages.pages[entry->page];
+    if (p < page->start || (p - page->start + size) > page->size)
+        return 0;
+
+    updatePageUse(entry->page, false);
+#ifdef VIRTMEM_TRACE_STATS
+    ++bigPageHits;
+#endif
+    return page;
 }
+#endif
 
-int8_t BaseVAlloc::findUnusedLockedPage(PageInfo *pinfo)
+#if defined(VIRTMEM_PAGE_TLB) || defined(VIRTMEM_THREAD_SAFE)
+// Adds the big page containing the given range to the translation cache, and publishes it for optimistic readers.
+// Pages which overlap with a locked page are skipped, as read() and write() should use the locked data instead.
+void BaseVAlloc::updateTLB(VPtrNum p, VPtrSize size)
 {
-    for (int8_t i=pinfo->lockedIndex; i!=-1; i=pinfo->pages[i].next)
+    const VirtPageIndex index = findIndexedPage(&bigPages, p, size);
+    if (index == -1)
+        return;
+
+    const VPtrNum start = bigPages.pages[index].start, end = start + bigPages.pages[index].size;
+    for (VirtPageIndex l=findLockOverlap(start); l<lockIntervalCount && getLockInterval(l)->start < end; ++l)
     {
-        if (pinfo->pages[i].locks == 0)
-            return i;
+        const LockPage *page = getLockInterval(l);
+        if ((page->start + page->size) > start)
+            return;
     }
 
-    return -1;
+#ifdef VIRTMEM_PAGE_TLB
+    TLBEntry *entry = getTLBEntry(p);
+    entry->page = index;
+    entry->generation = tlbGeneration;
+#endif
+    publishFrame(index, p);
 }
+#endif
 
-void BaseVAlloc::syncLockedPage(BaseVAlloc::LockPage *page)
+// Invalidates all entries of the translation cache, called when locks change
+void BaseVAlloc::invalidateTLB()
 {
-    ASSERT(page->start != 0);
-    if (page->dirty)
+#ifdef VIRTMEM_PAGE_TLB
+    if (++tlbGeneration == 0)
     {
-#if 1
-        saveRawData(page->pool, page->start, page->size);
-#else
-        void *data = pullRawData(page->start, page->size, true, false);
-        const int8_t pageindex = findFreePage(&bigPages, page->start, page->size, false);
-        ASSERT(pageindex != -1);
-
-        // only copy data if regular page is already dirty or data changed
-        if (bigPages.pages[pageindex].dirty || memcmp(data, page->pool, page->size) != 0)
-        {
-            memcpy(data, page->pool, page->size);
-            bigPages.pages[pageindex].dirty = true;
-        }
-
-        // UNDONE: unset dirty?
-#endif
+        // wrapped around: make sure that old entries don't become valid again
+        for (uint8_t i=0; i<PAGE_TLB_SIZE; ++i)
+            pageTLB[i].generation = 0;
+        tlbGeneration = 1;
     }
+#endif
+    unpublishFrames(); // locks changed
 }
 
-int8_t BaseVAlloc::lockPage(PageInfo *pinfo, VPtrNum ptr, VirtPageSize size)
+// Allows optimistic readers to use a clean and unlocked big page (see readOptimistic()). The page should not
+// overlap any locks (see updateTLB()).
+void BaseVAlloc::publishFrame(VirtPageIndex index, VPtrNum p)
 {
-    int8_t index;
+#ifdef VIRTMEM_THREAD_SAFE
+    const LockPage *page = &bigPages.pages[index];
+    if (page->dirty || page->locks)
+        return;
 
-    if (pinfo == &bigPages)
+    FrameVersion *frame = &frameVersions[index];
+    const uint32_t version = frame->version.load(std::memory_order_relaxed);
+    if (version & 1)
     {
-        // read in data and lock the page that was used
-        // NOTE: set readonly here, the eventual ro flag should be set afterwards
-        pullRawData(ptr, size, true, true);
-        index = findFreePage(pinfo, ptr, size, true);
-        if (size < pinfo->size)
-            syncBigPage(&bigPages.pages[index]); // synchronize if there is data outside lock range
+        frame->start.store(page->start, std::memory_order_relaxed);
+        frame->end.store(page->start + page->size, std::memory_order_relaxed);
+        frame->version.store(version + 1, std::memory_order_release);
     }
-    else
-        index = pinfo->freeIndex;
+    frameHints[(p >> tlbShift) & (PAGE_TLB_SIZE - 1)].store(index, std::memory_order_release);
+#else
+    (void)index; (void)p;
+#endif
+}
 
-    if (index == pinfo->freeIndex)
-        pinfo->freeIndex = pinfo->pages[pinfo->freeIndex].next;
-    else
+// Stops optimistic reads of a big page, called before its data or position changes
+void BaseVAlloc::unpublishFrame(const LockPage *page)
+{
+#ifdef VIRTMEM_THREAD_SAFE
+    if (page < bigPages.pages || page >= (bigPages.pages + bigPages.count))
+        return;
+
+    FrameVersion *frame = &frameVersions[page - bigPages.pages];
+    const uint32_t version = frame->version.load(std::memory_order_relaxed);
+    if (!(version & 1))
     {
-        // find previous
-        int8_t previ = pinfo->freeIndex;
-        for (; index!=pinfo->pages[previ].next; previ=pinfo->pages[previ].next)
-            ;
-        pinfo->pages[previ].next = pinfo->pages[index].next;
+        frame->version.store(version + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
     }
-
-    if (pinfo == &bigPages && nextPageToSwap == index)
-        nextPageToSwap = pinfo->freeIndex; // locked page, can't swap it anymore
-
-    pinfo->pages[index].next = pinfo->lockedIndex;
-    pinfo->lockedIndex = index;
-
-    return index;
+#else
+    (void)page;
+#endif
 }
 
-int8_t BaseVAlloc::freeLockedPage(BaseVAlloc::PageInfo *pinfo, int8_t index)
+void BaseVAlloc::unpublishFrames()
 {
-    if (pinfo != &bigPages)
-        syncLockedPage(&pinfo->pages[index]);
-    else if (pinfo->pages[index].size < pinfo->size /*|| (pinfo->pages[index].start & (sizeof(TAlign)-1)) != 0*/)
-    {
-        // only synchronize shrunk big pages as they cannot be used for regular IO or unaligned pages
-        syncLockedPage(&pinfo->pages[index]);
-        // restore as regular unused free page
-        pinfo->pages[index].start = 0;
-        pinfo->pages[index].size = pinfo->size;
-    }
+#ifdef VIRTMEM_THREAD_SAFE
+    for (VirtPageIndex i=0; i<bigPages.count; ++i)
+        unpublishFrame(&bigPages.pages[i]);
+#endif
+}
 
-    const int8_t ret = pinfo->pages[index].next;
+#ifdef VIRTMEM_THREAD_SAFE
+// Copies data of a big page that may be modified concurrently (see readOptimistic()). A plain memcpy() would be
+// a data race, which is undefined behaviour even if the result is discarded afterwards. Instead the data is
+// copied with relaxed atomic loads (word by word where possible), which may not be torn, elided or moved across
+// the fence of readOptimistic() by the compiler.
+static void copyRacyData(void *d, const uint8_t *src, VPtrSize size)
+{
+    typedef uintptr_t __attribute__ ((may_alias)) TWord; // page pools are byte arrays
 
-    if (index == pinfo->lockedIndex)
-        pinfo->lockedIndex = pinfo->pages[index].next;
-    else
+    uint8_t *dst = static_cast<uint8_t *>(d);
+    for (; size && ((uintptr_t)src % sizeof(TWord)) != 0; --size)
+        *dst++ = __atomic_load_n(src++, __ATOMIC_RELAXED);
+    for (; size >= sizeof(TWord); size -= sizeof(TWord), src += sizeof(TWord), dst += sizeof(TWord))
     {
-        int prevind = pinfo->lockedIndex;
-        for (; pinfo->pages[prevind].next != index; prevind=pinfo->pages[prevind].next)
-            ;
-        pinfo->pages[prevind].next = pinfo->pages[index].next;
+        const TWord word = __atomic_load_n(reinterpret_cast<const TWord *>(src), __ATOMIC_RELAXED);
+        memcpy(dst, &word, sizeof(TWord));
     }
-    pinfo->pages[index].next = pinfo->freeIndex;
-    pinfo->freeIndex = index;
-//    printf("freeing page %d - free/used: %d/%d\n", index, pinfo->freeIndex, pinfo->usedIndex);
-
-    if (pinfo == &bigPages && nextPageToSwap == -1)
-        nextPageToSwap = pinfo->freeIndex;
+    for (; size; --size)
+        *dst++ = __atomic_load_n(src++, __ATOMIC_RELAXED);
+}
 
-    pinfo->pages[index].locks = 0;
+// Copies data from a published big page without locking (seqlock read). Returns false if the data is not in
+// a published page or if the page changed while copying, in which case the caller should take the cache lock.
+// NOTE: the memory of big pages is never released, so a page that is reused meanwhile is still safe to read
+bool BaseVAlloc::readOptimistic(VPtrNum p, void *d, VPtrSize size) const
+{
+    const VirtPageIndex index = frameHints[(p >> tlbShift) & (PAGE_TLB_SIZE - 1)].load(std::memory_order_acquire);
+    if (index == -1)
+        return false;
+
+    const FrameVersion *frame = &frameVersions[index];
+    const uint32_t version = frame->version.load(std::memory_order_acquire);
+    if (version & 1)
+        return false;
+
+    const VPtrNum start = frame->start.load(std::memory_order_relaxed);
+    if (p < start || (p + size) > frame->end.load(std::memory_order_relaxed))
+        return false;
+
+    // Fence pairing: before page data is changed, unpublishFrame() stores an odd version (relaxed) followed by a
+    // release fence. The acquire fence below keeps the data loads before the second version load, so if any of
+    // them saw data written after the page was unpublished, the version differs and the copy is discarded.
+    // NOTE: writers (e.g. backend reads, write() and locks) store page data non-atomically, hence formally this is
+    // still a data race. The atomic loads only make sure that a racy copy is not miscompiled, after which the
+    // version check discards it.
+    copyRacyData(d, bigPages.pages[index].pool + (p - start), size);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return frame->version.load(std::memory_order_relaxed) == version;
+}
+#endif
 
-    return ret;
+// Returns the start of the grid aligned big page containing p. The first page starts at START_OFFSET,
+// since zero marks unused pages.
+VPtrNum BaseVAlloc::getBigGridStart(VPtrNum p) const
+{
+    const VPtrNum ret = (p >> bigPageShift) << bigPageShift;
+    return (ret) ? ret : (VPtrNum)START_OFFSET;
 }
 
-int8_t BaseVAlloc::findLockedPage(PageInfo *pinfo, VPtrNum p)
+VirtPageSize BaseVAlloc::getBigGridSize(VPtrNum gridstart) const
 {
-    for (int8_t i=pinfo->lockedIndex; i!=-1; i=pinfo->pages[i].next)
+    return (gridstart == START_OFFSET) ? (bigPages.size - START_OFFSET) : bigPages.size;
+}
+
+bool BaseVAlloc::isOnBigGrid(const LockPage *page) const
+{
+    return page->start == getBigGridStart(page->start) && page->size == getBigGridSize(page->start);
+}
+
+// Finds the indexed big page with the given grid position. Only valid if all indexed pages are on the grid.
+VirtPageIndex BaseVAlloc::findGridPage(VPtrNum gridstart) const
+{
+    for (VirtPageIndex i=bigPages.index[(gridstart >> bigPageShift) & bigPages.indexMask]; i!=-1; i=bigPages.pages[i].indexNext)
+    {
+        if (bigPages.pages[i].start == gridstart)
+            return i;
+    }
+
+    return -1;
+}
+
+#ifdef VIRTMEM_THREAD_SAFE
+// Returns the cache shard of a range within a single grid page, or -1 if the cache is not sharded or if the range
+// crosses the grid
+int BaseVAlloc::getRangeShard(VPtrNum p, VPtrSize size) const
+{
+    if (!shardMask || !size || (p >> bigPageShift) != ((p + size - 1) >> bigPageShift))
+        return -1;
+    return getPageShard(p);
+}
+
+// Returns whether a range of a single shard (see getRangeShard()) can be accessed while only that shard is locked.
+// The data should be in, or be loaded into, a grid page without touching state that is shared by the shards: hence
+// it should not overlap locks, and all indexed pages should be on the grid. Pages that were read ahead, page misses
+// that would read ahead and asynchronous loads require all shards as well.
+bool BaseVAlloc::isShardAccessible(VPtrNum p, VPtrSize size) const
+{
+    if (unalignedBigPages || asyncReads)
+        return false;
+
+    for (VirtPageIndex l=findLockOverlap(p); l<lockIntervalCount && getLockInterval(l)->start < (p + size); ++l)
+    {
+        const LockPage *page = getLockInterval(l);
+        if ((page->start + page->size) > p)
+            return false;
+    }
+
+    const VirtPageIndex index = findGridPage(getBigGridStart(p));
+    if (index == -1)
+#ifdef VIRTMEM_READ_AHEAD
+        return !readAheadEnabled || !readAheadDepth;
+#else
+        return true;
+#endif
+    return !(bigPages.pages[index].flags & PAGE_PREFETCHED);
+}
+
+BaseVAlloc::CacheGuard::CacheGuard(const BaseVAlloc *alloc, VPtrNum p, VPtrSize size)
+{
+    const int shard = alloc->getRangeShard(p, size);
+    if (shard != -1)
+    {
+        first = last = &alloc->cacheShards[shard];
+        first->mutex.lock();
+        if (alloc->isShardAccessible(p, size))
+            return;
+        first->mutex.unlock();
+    }
+
+    first = &alloc->cacheShards[0];
+    last = &alloc->cacheShards[alloc->shardMask];
+    for (CacheShard *s=first; s<=last; ++s)
+        s->mutex.lock();
+}
+#endif
+
+// Returns the first big page of the given cache shard in the free list, starting at the given page (may be -1)
+VirtPageIndex BaseVAlloc::findShardFrame(VirtPageIndex index, uint8_t shard) const
+{
+    for (; index != -1 && getFrameShard(index) != shard; index=bigPages.pages[index].next)
+        ;
+    return index;
+}
+
+// Returns the cache shard of the free frame that is used to lock the given data. Locking the last free frame
+// of a shard would leave no frames for its regular IO, so the shard with the most free frames is used then.
+uint8_t BaseVAlloc::findLockShard(VPtrNum ptr) const
+{
+    uint8_t ret = getPageShard(ptr), retfree = 0;
+    for (uint8_t shard=0; shard<getShardCount(); ++shard)
+    {
+        uint8_t free = 0;
+        for (VirtPageIndex i=findShardFrame(bigPages.freeIndex, shard); i!=-1 && free<2; i=findShardFrame(bigPages.pages[i].next, shard))
+            ++free;
+
+        if (shard == getPageShard(ptr) && free > 1)
+            return shard;
+        if (free > retfree)
+        {
+            ret = shard;
+            retfree = free;
+        }
+    }
+    return ret;
+}
+
+void BaseVAlloc::resetShards()
+{
+    const uint8_t count = getShardCount();
+    for (uint8_t i=0; i<count; ++i)
+    {
+        CacheShard *shard = getShard(i);
+        shard->nextPageToSwap = i; // first page of the shard
+#ifdef VIRTMEM_PAGE_POLICIES
+        shard->clockHand = i;
+        shard->nextPageGhost = 0;
+        shard->pageClock = 0;
+#endif
+    }
+#ifdef VIRTMEM_PAGE_POLICIES
+    for (VirtPageIndex i=0; i<(pageGhostCount * count); ++i)
+        pageGhosts[i] = 0;
+#endif
+}
+
+#ifdef VIRTMEM_PAGE_POLICIES
+
+// Selects a big page of a cache shard to swap for all replacement policies except PAGE_POLICY_FIFO
+VirtPageIndex BaseVAlloc::findSwapPage(uint8_t shard)
+{
+    CacheShard *cshard = getShard(shard);
+
+    // Unused pages don't have to be swapped out, so always take these first
+    for (VirtPageIndex i=findShardFrame(bigPages.freeIndex, shard); i!=-1; i=findShardFrame(bigPages.pages[i].next, shard))
+    {
+        if (bigPages.pages[i].start == 0)
+            return i;
+    }
+
+    // NOTE: every shard has an equal amount of pages (see VAlloc)
+    const VirtPageIndex shardpages = bigPages.count / getShardCount();
+
+    if (bigPagePolicy == PAGE_POLICY_CLOCK)
+    {
+        // Sweep through all pages and give referenced pages a second chance. Since references are cleared
+        // while sweeping, an unlocked page is always found within two rounds.
+        for (uint32_t n=0; n<(shardpages * 2u); ++n)
+        {
+            const VirtPageIndex i = cshard->clockHand;
+            cshard->clockHand = (cshard->clockHand + getShardCount()) % bigPages.count;
+
+            if (bigPages.pages[i].flags & (PAGE_LOCKED | PAGE_LOADING))
+                continue;
+            if (bigPages.pages[i].flags & PAGE_REFERENCED)
+                bigPages.pages[i].flags &= ~PAGE_REFERENCED;
+            else
+                return i;
+        }
+
+        ASSERT(false);
+        return findShardFrame(bigPages.freeIndex, shard);
+    }
+
+    // LRU and 2Q: find the oldest pages. Hot and cold pages are only distinguished by 2Q
+    VirtPageIndex oldesthot = -1, oldestcold = -1;
+    VirtPageIndex coldpages = 0;
+    for (VirtPageIndex i=findShardFrame(bigPages.freeIndex, shard); i!=-1; i=findShardFrame(bigPages.pages[i].next, shard))
+    {
+        if (bigPagePolicy == PAGE_POLICY_2Q && !(bigPages.pages[i].flags & PAGE_HOT))
+        {
+            ++coldpages;
+            // NOTE: signed difference to deal with wrap around of pageClock
+            if (oldestcold == -1 || (int32_t)(bigPages.pages[i].lastUse - bigPages.pages[oldestcold].lastUse) < 0)
+                oldestcold = i;
+        }
+        else if (oldesthot == -1 || (int32_t)(bigPages.pages[i].lastUse - bigPages.pages[oldesthot].lastUse) < 0)
+            oldesthot = i;
+    }
+
+    // 2Q: swap cold pages (in FIFO order) if there are too many or if there are no hot pages
+    if (oldestcold != -1 && (oldesthot == -1 || coldpages > private_utils::maximal(shardpages / 4, 1)))
+    {
+        // remember the page so it becomes hot when it is loaded again soon
+        pageGhosts[shard * pageGhostCount + cshard->nextPageGhost] = bigPages.pages[oldestcold].start / bigPages.size + 1;
+        cshard->nextPageGhost = (cshard->nextPageGhost + 1) % pageGhostCount;
+        return oldestcold;
+    }
+
+    return oldesthot;
+}
+
+// Updates bookkeeping of the replacement policy after a big page was accessed or swapped in
+void BaseVAlloc::updatePageUse(VirtPageIndex index, bool swapped)
+{
+    LockPage *page = &bigPages.pages[index];
+    const uint8_t shard = getFrameShard(index);
+    CacheShard *cshard = getShard(shard);
+
+    switch (bigPagePolicy)
+    {
+    case PAGE_POLICY_LRU:
+        page->lastUse = ++cshard->pageClock;
+        break;
+    case PAGE_POLICY_CLOCK:
+        page->flags |= PAGE_REFERENCED;
+        break;
+    case PAGE_POLICY_2Q:
+        ++cshard->pageClock; // NOTE: counts all accesses, so lastUse of cold pages tells how long ago they were loaded
+        if (swapped)
+        {
+            // new pages start cold, unless they were swapped out recently
+            const VPtrNum ghost = page->start / bigPages.size + 1;
+            VPtrNum *ghosts = &pageGhosts[shard * pageGhostCount];
+            page->flags &= ~PAGE_HOT;
+            for (VirtPageIndex i=0; i<pageGhostCount; ++i)
+            {
+                if (ghosts[i] == ghost)
+                {
+                    ghosts[i] = 0;
+                    page->flags |= PAGE_HOT;
+                    break;
+                }
+            }
+            page->lastUse = cshard->pageClock;
+        }
+        else if (page->flags & PAGE_HOT)
+            page->lastUse = cshard->pageClock;
+        else if ((cshard->pageClock - page->lastUse) > (uint32_t)(bigPages.count / getShardCount()))
+        {
+            // Cold pages that are used again after a while become hot. Accesses shortly after loading
+            // (e.g. a sequential scan) are correlated and don't change their FIFO order.
+            page->flags |= PAGE_HOT;
+            page->lastUse = cshard->pageClock;
+        }
+        break;
+    }
+}
+#endif
+
+// Returns whether any part of the given range is present in an indexed (unlocked) big page
+bool BaseVAlloc::isBigRangeCached(VPtrNum p, VPtrSize size) const
+{
+    // pages are never larger than the page size, so only pages starting within this range can overlap
+    const VPtrNum start = (p > bigPages.size) ? (p - bigPages.size + 1) : 1;
+    return findIndexedPageStart(&bigPages, start, p + size) != -1;
+}
+
+#ifdef VIRTMEM_READ_AHEAD
+// Called after a big page was swapped in: detects streams of page misses with a constant stride,
+// and if found reads the next pages of the stream in unused or clean pages.
+void BaseVAlloc::readAhead(VirtPageIndex index)
+{
+    const LockPage *page = &bigPages.pages[index];
+    const VPtrNum pagenr = page->start / bigPages.size;
+    const int32_t stride = (int32_t)(pagenr - readAheadPage);
+    const bool stream = (stride != 0 && stride == readAheadStride &&
+                         stride <= READ_AHEAD_MAX_STRIDE && stride >= -READ_AHEAD_MAX_STRIDE);
+
+    readAheadPage = pagenr;
+    readAheadStride = stride;
+
+    if (!stream)
+        return;
+
+    // collect start addresses of the next pages in the stream that are not loaded yet
+    VPtrNum targets[READ_AHEAD_MAX_DEPTH];
+    VirtPageSize tsizes[READ_AHEAD_MAX_DEPTH];
+    uint8_t tcount = 0;
+    const VPtrSize step = (VPtrSize)((stride > 0) ? stride : -stride) * bigPages.size;
+    for (uint8_t k=1; k<=readAheadDepth; ++k)
+    {
+        if (stride < 0 && (k * step) >= page->start)
+            break;
+
+        VPtrNum t = (stride > 0) ? (page->start + k * step) : (page->start - k * step);
+        VirtPageSize tsize = bigPages.size;
+        if (bigPageGrid)
+        {
+            t = getBigGridStart(t);
+            tsize = getBigGridSize(t);
+        }
+
+        if (t < START_OFFSET || t >= poolSize)
+            break;
+
+        // NOTE: pages in the victim cache are loaded on demand without I/O
+        if (!isBigRangeCached(t, tsize) && !isBigRangeLoading(t, tsize) &&
+            (!getVictimCacheSize() || findVictimPage(t, private_utils::minimal(poolSize - t, (VPtrSize)tsize)) == -1))
+        {
+            targets[tcount] = t;
+            tsizes[tcount] = tsize;
+            ++tcount;
+        }
+    }
+
+    // NOTE: nearest pages are most useful, they are collected first
+    VirtPageIndex frames[READ_AHEAD_MAX_DEPTH];
+    tcount = findLoadFrames(frames, targets, tsizes, tcount, index);
+    loadPages(frames, targets, tsizes, tcount, false);
+}
+#endif
+
+// Returns whether a big page is being loaded into the given range
+bool BaseVAlloc::isBigRangeLoading(VPtrNum p, VPtrSize size) const
+{
+    if (!asyncReads)
+        return false;
+
+    for (VirtPageIndex i=0; i<bigPages.count; ++i)
+    {
+        const LockPage *page = &bigPages.pages[i];
+        if ((page->flags & PAGE_LOADING) && page->start < (p + size) && (page->start + page->size) > p)
+            return true;
+    }
+    return false;
+}
+
+// Returns whether a big page can be used to load data without writing: unused pages in the first pass, clean pages
+// in the second pass. Pages that were already chosen are skipped.
+bool BaseVAlloc::isLoadFrame(const VirtPageIndex *frames, uint8_t count, VirtPageIndex index, uint8_t pass) const
+{
+    for (uint8_t f=0; f<count; ++f)
+    {
+        if (frames[f] == index)
+            return false;
+    }
+    const LockPage *page = &bigPages.pages[index];
+    return (pass == 0) ? (page->start == 0) : (page->start != 0 && !page->dirty);
+}
+
+// Finds pages to load the given targets in, preferring the first targets: unused pages first, then clean pages of the
+// cache shard of each target. Targets without a page are dropped. The rest is sorted by address, and the pages of
+// each shard are assigned in ascending order, so neighbouring pages can be read at once. Returns the amount of
+// targets left.
+uint8_t BaseVAlloc::findLoadFrames(VirtPageIndex *frames, VPtrNum *targets, VirtPageSize *tsizes, uint8_t count, VirtPageIndex exclude) const
+{
+    uint8_t ret = 0;
+    for (uint8_t t=0; t<count; ++t)
+    {
+        const VPtrNum target = targets[t];
+        const VirtPageSize tsize = tsizes[t];
+        const uint8_t shard = getPageShard(target);
+        VirtPageIndex frame = -1;
+        for (uint8_t pass=0; pass<2 && frame == -1; ++pass)
+        {
+            for (VirtPageIndex i=findShardFrame(bigPages.freeIndex, shard); i!=-1 && frame == -1; i=findShardFrame(bigPages.pages[i].next, shard))
+            {
+                if (i != exclude && isLoadFrame(frames, ret, i, pass))
+                    frame = i;
+            }
+        }
+
+        if (frame != -1)
+        {
+            // insert sorted by address
+            uint8_t f = ret++;
+            for (; f > 0 && targets[f-1] > target; --f)
+            {
+                frames[f] = frames[f-1];
+                targets[f] = targets[f-1];
+                tsizes[f] = tsizes[f-1];
+            }
+            frames[f] = frame;
+            targets[f] = target;
+            tsizes[f] = tsize;
+        }
+    }
+
+    // NOTE: only pages of the same shard can be exchanged
+    for (uint8_t i=0; i<ret; ++i)
+    {
+        for (uint8_t j=i+1; j<ret; ++j)
+        {
+            if (frames[j] < frames[i] && getFrameShard(frames[j]) == getFrameShard(frames[i]))
+            {
+                const VirtPageIndex f = frames[i]; frames[i] = frames[j]; frames[j] = f;
+            }
+        }
+    }
+
+    return ret;
+}
+
+// Reads data into the given pages, sorted by their targets (see findLoadFrames()). If async is set, pages are not available until they are loaded (see
+// asyncReadDone()): they are removed from the free list, similar to locked pages. Since loading pages are not indexed, the
+// first page of each request stores the amount of pages read by the request in its indexNext field.
+void BaseVAlloc::loadPages(const VirtPageIndex *frames, const VPtrNum *targets, const VirtPageSize *tsizes, uint8_t count, bool async)
+{
+    if (!count)
+        return;
+
+    for (uint8_t i=0; i<count; ++i)
+    {
+        const VirtPageIndex index = frames[i];
+        LockPage *fpage = &bigPages.pages[index];
+        if (fpage->start != 0)
+        {
+            storeVictimPage(fpage); // NOTE: page is clean
+            unindexPage(&bigPages, index);
+        }
+        fpage->start = targets[i];
+        fpage->size = tsizes[i];
+        fpage->dirty = false;
+        fpage->cleanSkips = 0;
+        fpage->flags = PAGE_PREFETCHED;
+#ifdef VIRTMEM_PAGE_POLICIES
+        fpage->lastUse = getShard(getFrameShard(index))->pageClock;
+#endif
+
+        if (!async)
+        {
+            indexPage(&bigPages, index);
+            continue;
+        }
+
+        fpage->flags |= PAGE_LOADING;
+        if (index == bigPages.freeIndex)
+            bigPages.freeIndex = fpage->next;
+        else
+        {
+            VirtPageIndex previ = bigPages.freeIndex;
+            for (; bigPages.pages[previ].next != index; previ=bigPages.pages[previ].next)
+                ;
+            bigPages.pages[previ].next = fpage->next;
+        }
+        CacheShard *cshard = getShard(getFrameShard(index));
+        if (cshard->nextPageToSwap == index)
+            cshard->nextPageToSwap = findShardFrame(bigPages.freeIndex, getFrameShard(index));
+    }
+
+    // the translation cache may still refer to the old data of the pages
+    if (async)
+        invalidateTLB();
+
+    // read pages that are consecutive both in virtual memory and in RAM at once
+    for (uint8_t i=0; i<count; )
+    {
+        uint8_t end = i + 1;
+        VPtrSize rdsize = tsizes[i];
+        for (; end < count && targets[end] == (targets[end-1] + tsizes[end-1]) &&
+             bigPages.pages[frames[end]].pool == (bigPages.pages[frames[end-1]].pool + tsizes[end-1]); ++end)
+            rdsize += tsizes[end];
+
+        rdsize = private_utils::minimal(poolSize - targets[i], rdsize);
+        if (getVictimCacheSize())
+            syncVictimRange(targets[i], rdsize, true);
+
+        LockPage *first = &bigPages.pages[frames[i]];
+        if (!async || hasLazyZeroFill())
+        {
+            // NOTE: untouched regions are not read from the memory pool
+            readPool(first->pool, targets[i], rdsize);
+            if (async)
+            {
+                first->indexNext = end - i;
+                asyncReads += end - i;
+                asyncReadDone(this, first);
+            }
+        }
+        else
+        {
+            // NOTE: neighbouring pages in RAM have successive indices
+            first->indexNext = end - i;
+            asyncReads += end - i;
+            doReadAsync(first->pool, targets[i], rdsize, asyncReadDone, first);
+        }
+
+#ifdef VIRTMEM_TRACE_STATS
+        bigPagePrefetches += (end - i);
+        bytesRead += rdsize;
+#endif
+        i = end;
+    }
+}
+
+// Makes a page that was loaded available for regular IO
+void BaseVAlloc::finishLoad(VirtPageIndex index)
+{
+    LockPage *page = &bigPages.pages[index];
+    ASSERT(page->flags & PAGE_LOADING);
+    page->flags &= ~PAGE_LOADING;
+
+    // append, so the FIFO policy doesn't pick the new page first
+    page->next = -1;
+    if (bigPages.freeIndex == -1)
+        bigPages.freeIndex = index;
+    else
+    {
+        VirtPageIndex lasti = bigPages.freeIndex;
+        for (; bigPages.pages[lasti].next != -1; lasti=bigPages.pages[lasti].next)
+            ;
+        bigPages.pages[lasti].next = index;
+    }
+    CacheShard *cshard = getShard(getFrameShard(index));
+    if (cshard->nextPageToSwap == -1)
+        cshard->nextPageToSwap = index;
+    indexPage(&bigPages, index);
+    --asyncReads;
+}
+
+void BaseVAlloc::asyncReadDone(BaseVAlloc *alloc, void *arg)
+{
+    LockPage *first = static_cast<LockPage *>(arg);
+    const VirtPageIndex index = first - alloc->bigPages.pages;
+    const VirtPageIndex count = first->indexNext; // see loadPages()
+    first->indexNext = -1;
+    for (VirtPageIndex i=0; i<count; ++i)
+        alloc->finishLoad(index + i);
+}
+
+void BaseVAlloc::asyncWriteDone(BaseVAlloc *alloc, void *)
+{
+    --alloc->asyncWrites;
+}
+
+// Waits until all asynchronous reads and writes are completed
+void BaseVAlloc::finishAsync()
+{
+    if (asyncReads || asyncWrites)
+    {
+        doWaitAsync();
+        ASSERT(!asyncReads && !asyncWrites);
+    }
+}
+
+#ifdef VIRTMEM_VICTIM_CACHE
+// Returns the victim cache entry containing the given page, or -1 if there is none
+VirtPageIndex BaseVAlloc::findVictimPage(VPtrNum start, VirtPageSize size) const
+{
+    for (VirtPageIndex k=0, i=victimTail; k<victimUsed; ++k)
+    {
+        if (victimPages[i].start == start && victimPages[i].size == size)
+            return i;
+        if (++i == victimPageCount)
+            i = 0;
+    }
+
+    return -1;
+}
+
+// Writes modified data of a victim cache entry
+void BaseVAlloc::syncVictimPage(VictimPage *vpage)
+{
+    if (vpage->dirtyStart >= vpage->dirtyEnd)
+        return;
+
+    const VPtrNum wrstart = vpage->start + vpage->dirtyStart;
+    const VPtrSize wrsize = private_utils::minimal((poolSize - wrstart), (VPtrSize)(vpage->dirtyEnd - vpage->dirtyStart));
+    const uint8_t *data = victimPool + vpage->offset;
+
+    if (vpage->csize == vpage->size)
+        writePool(data + vpage->dirtyStart, wrstart, wrsize);
+    else
+    {
+        // decompress in chunks, so no page sized buffer is needed
+        uint8_t buf[VICTIM_WRITE_CHUNK];
+        private_utils::RLEDecoder decoder(data);
+        decoder.read(0, vpage->dirtyStart);
+        for (VPtrSize i=0; i<wrsize; i+=VICTIM_WRITE_CHUNK)
+        {
+            const VPtrSize n = private_utils::minimal(wrsize - i, (VPtrSize)VICTIM_WRITE_CHUNK);
+            decoder.read(buf, n);
+            writePool(buf, wrstart + i, n);
+        }
+    }
+
+    vpage->dirtyStart = vpage->dirtyEnd = 0;
+#ifdef VIRTMEM_TRACE_STATS
+    ++bigPageWrites;
+    bytesWritten += wrsize;
+#endif
+}
+
+// Writes modified data of all victim cache entries overlapping the given range, and optionally removes them
+void BaseVAlloc::syncVictimRange(VPtrNum p, VPtrSize size, bool drop)
+{
+    for (VirtPageIndex k=0, i=victimTail; k<victimUsed; ++k)
+    {
+        VictimPage *vpage = &victimPages[i];
+        if (vpage->start != 0 && vpage->start < (p + size) && (vpage->start + vpage->size) > p)
+        {
+            syncVictimPage(vpage);
+            if (drop)
+                vpage->start = 0;
+        }
+        if (++i == victimPageCount)
+            i = 0;
+    }
+}
+
+void BaseVAlloc::clearVictimCache()
+{
+    syncVictimRange(0, poolSize, true);
+    victimHead = 0;
+    victimTail = victimUsed = 0;
+}
+
+// Returns the victim pool offset of a free block for new data. Old entries are removed when necessary.
+VPtrSize BaseVAlloc::allocVictimSpace(VPtrSize size)
+{
+    ASSERT(size <= victimPoolSize);
+
+    while (true)
+    {
+        if (victimUsed == 0)
+        {
+            victimHead = 0;
+            return 0;
+        }
+
+        if (victimUsed < victimPageCount)
+        {
+            // data is stored in insertion order, so the free space is behind the newest and before the oldest entry
+            const VPtrSize tailoffset = victimPages[victimTail].offset;
+            if (victimHead > tailoffset)
+            {
+                if ((victimPoolSize - victimHead) >= size)
+                    return victimHead;
+                if (tailoffset >= size)
+                    return (victimHead = 0); // wrap around
+            }
+            else if ((tailoffset - victimHead) >= size)
+                return victimHead;
+        }
+
+        // remove oldest
+        VictimPage *vpage = &victimPages[victimTail];
+        if (vpage->start != 0)
+            syncVictimPage(vpage);
+        if (++victimTail == victimPageCount)
+            victimTail = 0;
+        --victimUsed;
+    }
+}
+
+// Stores the data of a big page that will be swapped out. Returns false if the victim cache is disabled or too small.
+bool BaseVAlloc::storeVictimPage(LockPage *page)
+{
+    if (!victimPool)
+        return false;
+
+    VIRTMEM_LOCK_VICTIM(); // NOTE: pages are swapped while only their cache shard is locked
+
+    const VirtPageSize size = private_utils::minimal((poolSize - page->start), (VPtrSize)page->size);
+    VPtrSize csize = private_utils::rleCompress(page->pool, size, 0);
+    if (csize >= size)
+        csize = size; // incompressible, store as is
+    if (csize > victimPoolSize)
+        return false;
+
+    const VPtrSize offset = allocVictimSpace(csize);
+    if (csize == size)
+        memcpy(victimPool + offset, page->pool, size);
+    else
+        private_utils::rleCompress(page->pool, size, victimPool + offset);
+
+    VirtPageIndex index = victimTail + victimUsed;
+    if (index >= victimPageCount)
+        index -= victimPageCount;
+    VictimPage *vpage = &victimPages[index];
+    vpage->start = page->start;
+    vpage->offset = offset;
+    vpage->size = size;
+    vpage->csize = csize;
+    if (page->dirty)
+    {
+        // written later, when the entry is removed from the cache
+        vpage->dirtyStart = private_utils::minimal(getDirtyStart(page), size);
+        vpage->dirtyEnd = private_utils::minimal(getDirtyEnd(page), size);
+        page->dirty = false;
+        page->cleanSkips = 0;
+    }
+    else
+        vpage->dirtyStart = vpage->dirtyEnd = 0;
+    ++victimUsed;
+    victimHead = offset + csize;
+
+#ifdef VIRTMEM_TRACE_STATS
+    victimRawBytes += size;
+    victimStoredBytes += csize;
+#endif
+
+    return true;
+}
+
+// Loads a big page (with its start and size set) from the victim cache. Returns false if the page was not
+// found, in which case any overlapping entries are removed so the page can be read normally.
+bool BaseVAlloc::loadVictimPage(LockPage *page)
+{
+    if (!victimPool)
+        return false;
+
+    VIRTMEM_LOCK_VICTIM();
+
+    const VirtPageSize size = private_utils::minimal((poolSize - page->start), (VPtrSize)page->size);
+    const VirtPageIndex index = findVictimPage(page->start, size);
+    if (index == -1)
+    {
+        syncVictimRange(page->start, page->size, true);
+#ifdef VIRTMEM_TRACE_STATS
+        ++victimMisses;
+#endif
+        return false;
+    }
+
+    VictimPage *vpage = &victimPages[index];
+    if (vpage->csize == size)
+        memcpy(page->pool, victimPool + vpage->offset, size);
+    else
+    {
+        private_utils::RLEDecoder decoder(victimPool + vpage->offset);
+        decoder.read(page->pool, size);
+    }
+
+    if (vpage->dirtyStart < vpage->dirtyEnd)
+        markDirty(page, vpage->dirtyStart, vpage->dirtyEnd - vpage->dirtyStart);
+    vpage->start = 0; // the data is in the big page now, space is reclaimed when the entry is the oldest
+
+#ifdef VIRTMEM_TRACE_STATS
+    ++victimHits;
+#endif
+
+    return true;
+}
+#endif
+
+#ifdef VIRTMEM_ZERO_FILL
+void BaseVAlloc::setRegionTouched(VPtrSize region, bool t)
+{
+    if (t)
+        touchedRegions[region / 8] |= (1 << (region & 7));
+    else
+        touchedRegions[region / 8] &= ~(1 << (region & 7));
+}
+
+// Writes zeros to the memory pool without using a page as buffer
+void BaseVAlloc::writeZeroData(VPtrNum start, VPtrSize n)
+{
+    uint8_t zeros[ZERO_WRITE_CHUNK];
+    memset(zeros, 0, sizeof(zeros));
+    for (VPtrSize i=0; i<n; i+=ZERO_WRITE_CHUNK)
+        doWrite(zeros, start + i, private_utils::minimal(n - i, (VPtrSize)ZERO_WRITE_CHUNK));
+}
+
+// Writes zeros to the parts of an untouched region outside the given range
+void BaseVAlloc::padRegion(VPtrSize region, VPtrNum start, VPtrNum end)
+{
+    if (isRegionTouched(region))
+        return;
+
+    const VPtrNum rstart = region * touchedRegionSize;
+    const VPtrNum rend = private_utils::minimal(rstart + touchedRegionSize, poolSize);
+    if (start > rstart)
+        writeZeroData(rstart, start - rstart);
+    if (end < rend)
+        writeZeroData(end, rend - end);
+}
+#endif
+
+// Reads from the memory pool, untouched regions are zero filled without I/O
+void BaseVAlloc::readPool(void *data, VPtrNum offset, VPtrSize size)
+{
+    VIRTMEM_LOCK_POOL();
+#ifdef VIRTMEM_ZERO_FILL
+    if (!touchedRegions)
+#endif
+    {
+        doRead(data, offset, size);
+        return;
+    }
+#ifdef VIRTMEM_ZERO_FILL
+
+    uint8_t *dest = (uint8_t *)data;
+    while (size)
+    {
+        // handle successive regions with the same state at once
+        VPtrSize region = offset / touchedRegionSize;
+        const bool touched = isRegionTouched(region);
+        VPtrNum end = (region + 1) * touchedRegionSize;
+        while (end < (offset + size) && isRegionTouched(++region) == touched)
+            end += touchedRegionSize;
+
+        const VPtrSize n = private_utils::minimal(end - offset, size);
+        if (touched)
+            doRead(dest, offset, n);
+        else
+        {
+            memset(dest, 0, n);
+#ifdef VIRTMEM_TRACE_STATS
+            zeroFilledBytes += n;
+#endif
+        }
+
+        dest += n;
+        offset += n;
+        size -= n;
+    }
+#endif
+}
+
+// Writes to the memory pool and marks the written regions as touched. If async is set, the data should not be
+// changed until finishAsync() is called.
+void BaseVAlloc::writePool(const void *data, VPtrNum offset, VPtrSize size, bool async)
+{
+    // pages being loaded should not miss the new data
+    if (asyncReads)
+        finishAsync();
+
+    VIRTMEM_LOCK_POOL();
+
+#ifdef VIRTMEM_ZERO_FILL
+    if (touchedRegions)
+    {
+        const VPtrSize first = offset / touchedRegionSize, last = (offset + size - 1) / touchedRegionSize;
+        if (!poolZeroed)
+        {
+            // the rest of a partially written region should still read as zeros
+            padRegion(first, offset, offset + size);
+            if (last != first)
+                padRegion(last, offset, offset + size);
+        }
+        for (VPtrSize r=first; r<=last; ++r)
+            setRegionTouched(r, true);
+    }
+#endif
+
+    if (async)
+    {
+        ++asyncWrites;
+        doWriteAsync(data, offset, size, asyncWriteDone, 0);
+    }
+    else
+        doWrite(data, offset, size);
+}
+
+VirtPageIndex BaseVAlloc::findUnusedLockedPage(PageInfo *pinfo)
+{
+    for (VirtPageIndex i=pinfo->lockedIndex; i!=-1; i=pinfo->pages[i].next)
     {
-        if (p >= pinfo->pages[i].start && (p - pinfo->pages[i].start) < pinfo->pages[i].size)
+        if (pinfo->pages[i].locks == 0)
             return i;
     }
 
     return -1;
 }
 
-BaseVAlloc::LockPage *BaseVAlloc::findLockedPage(VPtrNum p)
+void BaseVAlloc::syncLockedPage(BaseVAlloc::LockPage *page)
+{
+    ASSERT(page->start != 0);
+    if (page->dirty)
+    {
+#if 1
+        // NOTE: locked pages may have shrunk since they were modified
+        const VirtPageSize start = getDirtyStart(page), end = private_utils::minimal(getDirtyEnd(page), page->size);
+        if (start < end)
+            saveRawData(page->pool + start, page->start + start, end - start);
+#else
+        void *data = pullRawData(page->start, page->size, true, false);
+        const VirtPageIndex pageindex = findFreePage(&bigPages, page->start, page->size, false);
+        ASSERT(pageindex != -1);
+
+        // only copy data if regular page is already dirty or data changed
+        if (bigPages.pages[pageindex].dirty || memcmp(data, page->pool, page->size) != 0)
+        {
+            memcpy(data, page->pool, page->size);
+            bigPages.pages[pageindex].dirty = true;
+        }
+
+        // UNDONE: unset dirty?
+#endif
+    }
+}
+
+VirtPageIndex BaseVAlloc::lockPage(PageInfo *pinfo, VPtrNum ptr, VirtPageSize size)
+{
+    VirtPageIndex index;
+
+    if (pinfo == &bigPages)
+    {
+        const uint8_t shard = findLockShard(ptr);
+        if (shard == getPageShard(ptr))
+        {
+            // read in data and lock the page that was used
+            // NOTE: set readonly here, the eventual ro flag should be set afterwards
+            pullRawData(ptr, size, true, true);
+            index = findFreePage(pinfo, ptr, size, true);
+            if (size < pinfo->size)
+                syncBigPage(&bigPages.pages[index]); // synchronize if there is data outside lock range
+            unindexPage(pinfo, index); // locked pages are not used for regular IO
+        }
+        else
+        {
+            // lock a frame of another cache shard, it is dropped when it is freed (see freeLockedPage())
+            index = findShardFrame(pinfo->freeIndex, shard);
+            if (pinfo->pages[index].start != 0)
+            {
+                syncBigPage(&pinfo->pages[index]);
+                unindexPage(pinfo, index);
+            }
+            pinfo->pages[index].size = pinfo->size;
+            copyRawData(pinfo->pages[index].pool, ptr, size);
+        }
+        pinfo->pages[index].flags |= PAGE_LOCKED;
+    }
+    else
+        index = pinfo->freeIndex;
+
+    if (index == pinfo->freeIndex)
+        pinfo->freeIndex = pinfo->pages[pinfo->freeIndex].next;
+    else
+    {
+        // find previous
+        VirtPageIndex previ = pinfo->freeIndex;
+        for (; index!=pinfo->pages[previ].next; previ=pinfo->pages[previ].next)
+            ;
+        pinfo->pages[previ].next = pinfo->pages[index].next;
+    }
+
+    if (pinfo == &bigPages)
+    {
+        CacheShard *cshard = getShard(getFrameShard(index));
+        if (cshard->nextPageToSwap == index)
+            cshard->nextPageToSwap = findShardFrame(pinfo->freeIndex, getFrameShard(index)); // locked page, can't swap it anymore
+    }
+
+    pinfo->pages[index].next = pinfo->lockedIndex;
+    pinfo->lockedIndex = index;
+    pinfo->pages[index].start = ptr;
+    insertLockInterval(&pinfo->pages[index]);
+
+    return index;
+}
+
+VirtPageIndex BaseVAlloc::freeLockedPage(BaseVAlloc::PageInfo *pinfo, VirtPageIndex index)
 {
-    int8_t index = findLockedPage(&smallPages, p);
-    if (index != -1)
-        return &smallPages.pages[index];
+    removeLockInterval(&pinfo->pages[index]);
+
+    if (pinfo != &bigPages)
+        syncLockedPage(&pinfo->pages[index]);
+    else if (pinfo->pages[index].size < pinfo->size || (bigPageGrid && !isOnBigGrid(&pinfo->pages[index])) ||
+             getPageShard(pinfo->pages[index].start) != getFrameShard(index))
+    {
+        // only synchronize shrunk big pages as they cannot be used for regular IO, or pages which are
+        // not on the grid (if enabled), as these would disable fast page lookups. Pages that were moved to
+        // data of another cache shard are synchronized as well.
+        syncLockedPage(&pinfo->pages[index]);
+        // restore as regular unused free page
+        pinfo->pages[index].start = 0;
+        pinfo->pages[index].size = pinfo->size;
+    }
+
+    const VirtPageIndex ret = pinfo->pages[index].next;
+
+    if (index == pinfo->lockedIndex)
+        pinfo->lockedIndex = pinfo->pages[index].next;
+    else
+    {
+        int prevind = pinfo->lockedIndex;
+        for (; pinfo->pages[prevind].next != index; prevind=pinfo->pages[prevind].next)
+            ;
+        pinfo->pages[prevind].next = pinfo->pages[index].next;
+    }
+    pinfo->pages[index].next = pinfo->freeIndex;
+    pinfo->freeIndex = index;
+    if (pinfo == &bigPages)
+    {
+        pinfo->pages[index].flags &= ~PAGE_LOCKED;
+        if (pinfo->pages[index].start != 0)
+            indexPage(pinfo, index); // available again for regular IO
+    }
+//    printf("freeing page %d - free/used: %d/%d\n", index, pinfo->freeIndex, pinfo->usedIndex);
+
+    if (pinfo == &bigPages)
+    {
+        CacheShard *cshard = getShard(getFrameShard(index));
+        if (cshard->nextPageToSwap == -1)
+            cshard->nextPageToSwap = index;
+    }
+
+    pinfo->pages[index].locks = 0;
 
-    index = findLockedPage(&mediumPages, p);
-    if (index != -1)
-        return &mediumPages.pages[index];
+    return ret;
+}
 
-    index = findLockedPage(&bigPages, p);
-    if (index != -1)
-        return &bigPages.pages[index];
+BaseVAlloc::LockPage *BaseVAlloc::findLockedPage(VPtrNum p)
+{
+    for (VirtPageIndex l=findLockOverlap(p); l<lockIntervalCount && getLockInterval(l)->start <= p; ++l)
+    {
+        LockPage *page = getLockInterval(l);
+        if ((p - page->start) < page->size)
+            return page;
+    }
 
     return 0;
 }
 
-uint8_t BaseVAlloc::getUnlockedPages(const PageInfo *pinfo) const
+// Returns the page type (small/medium/big) of a lock page
+BaseVAlloc::PageInfo *BaseVAlloc::getPageInfo(const LockPage *page)
 {
-    uint8_t ret = 0;
+    if (page >= smallPages.pages && page < (smallPages.pages + smallPages.count))
+        return &smallPages;
+    if (page >= mediumPages.pages && page < (mediumPages.pages + mediumPages.count))
+        return &mediumPages;
+    return &bigPages;
+}
+
+// Returns the number of a lock page in the lock intervals (see getLockInterval())
+VirtPageIndex BaseVAlloc::getLockNumber(const LockPage *page) const
+{
+    if (page >= smallPages.pages && page < (smallPages.pages + smallPages.count))
+        return page - smallPages.pages;
+    if (page >= mediumPages.pages && page < (mediumPages.pages + mediumPages.count))
+        return smallPages.count + (page - mediumPages.pages);
+    return smallPages.count + mediumPages.count + (page - bigPages.pages);
+}
+
+// Returns the position of the first locked page which starts at or after the given address
+VirtPageIndex BaseVAlloc::findLockInterval(VPtrNum start) const
+{
+    VirtPageIndex low = 0, high = lockIntervalCount;
+    while (low < high)
+    {
+        const VirtPageIndex mid = low + (high - low) / 2;
+        if (getLockInterval(mid)->start < start)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low;
+}
+
+// Returns the position of the first locked page which may overlap with data starting at p
+VirtPageIndex BaseVAlloc::findLockOverlap(VPtrNum p) const
+{
+    // locked pages are never larger than the big page size
+    return findLockInterval((p > bigPages.size) ? (p - bigPages.size + 1) : 0);
+}
+
+void BaseVAlloc::insertLockInterval(LockPage *page)
+{
+    const VirtPageIndex l = findLockInterval(page->start);
+    memmove(&lockIntervals[l + 1], &lockIntervals[l], (lockIntervalCount - l) * sizeof(VirtPageIndex));
+    lockIntervals[l] = getLockNumber(page);
+    ++lockIntervalCount;
+}
+
+void BaseVAlloc::removeLockInterval(LockPage *page)
+{
+    const VirtPageIndex n = getLockNumber(page);
+    VirtPageIndex l = findLockInterval(page->start);
+    for (; lockIntervals[l] != n; ++l)
+        ASSERT(l < lockIntervalCount);
+    --lockIntervalCount;
+    memmove(&lockIntervals[l], &lockIntervals[l + 1], (lockIntervalCount - l) * sizeof(VirtPageIndex));
+}
+
+// Changes the start address of a locked page
+void BaseVAlloc::moveLockInterval(LockPage *page, VPtrNum start)
+{
+    removeLockInterval(page);
+    page->start = start;
+    insertLockInterval(page);
+}
+
+VirtPageIndex BaseVAlloc::getUnlockedPages(const PageInfo *pinfo) const
+{
+    VirtPageIndex ret = 0;
 
-    for (int8_t i=pinfo->freeIndex; i!=-1; i=pinfo->pages[i].next)
+    for (VirtPageIndex i=pinfo->freeIndex; i!=-1; i=pinfo->pages[i].next)
         ++ret;
 
     // also include unused locked pages
-    for (int8_t i=pinfo->lockedIndex; i!=-1; i=pinfo->pages[i].next)
+    for (VirtPageIndex i=pinfo->lockedIndex; i!=-1; i=pinfo->pages[i].next)
     {
         if (pinfo->pages[i].locks == 0)
             ++ret;
@@ -488,6 +1854,27 @@ uint8_t BaseVAlloc::getUnlockedPages(const PageInfo *pinfo) const
  */
 void BaseVAlloc::writeZeros(VPtrNum start, VPtrSize n)
 {
+#ifdef VIRTMEM_ZERO_FILL
+    if (touchedRegions)
+    {
+        // untouched regions already read as zeros: only reset fully covered regions and write the rest
+        const VPtrNum end = start + n;
+        for (VPtrSize r=start / touchedRegionSize; (r * touchedRegionSize) < end; ++r)
+        {
+            const VPtrNum rstart = r * touchedRegionSize;
+            const VPtrNum rend = private_utils::minimal(rstart + touchedRegionSize, poolSize);
+            if (rstart >= start && rend <= end)
+                setRegionTouched(r, false);
+            else if (isRegionTouched(r))
+            {
+                const VPtrNum wrstart = private_utils::maximal(rstart, start);
+                writeZeroData(wrstart, private_utils::minimal(rend, end) - wrstart);
+            }
+        }
+        return;
+    }
+#endif
+
     ASSERT(bigPages.pages[0].start == 0);
 
     // Use zeroed page as buffer
@@ -496,32 +1883,174 @@ void BaseVAlloc::writeZeros(VPtrNum start, VPtrSize n)
         doWrite(bigPages.pages[0].pool, start + i, private_utils::minimal(n - i, (VPtrSize)bigPages.size));
 }
 
+// Returns the start of the memory used for allocations
+VPtrNum BaseVAlloc::getDataStart() const
+{
+    if (!persistent)
+        return START_OFFSET;
+
+    // skip superblock and roots
+    const VPtrSize sbsize = sizeof(Superblock) + ROOT_COUNT * sizeof(RootEntry);
+    return START_OFFSET + (sbsize + sizeof(UMemHeader) - 1) / sizeof(UMemHeader) * sizeof(UMemHeader);
+}
+
+// Returns the index of the named root, or -1 if it does not exist
+int8_t BaseVAlloc::findRoot(const char *name)
+{
+    for (uint8_t i=0; i<ROOT_COUNT; ++i)
+    {
+        const RootEntry *root = static_cast<const RootEntry *>(read(getRootEntry(i), sizeof(RootEntry)));
+        if (root->ptr && strncmp(root->name, name, ROOT_NAME_SIZE) == 0)
+            return i;
+    }
+    return -1;
+}
+
+// Restores the allocator state from the superblock. Returns false if the pool does not contain a (compatible) superblock.
+bool BaseVAlloc::loadSuperblock()
+{
+    // NOTE: read directly, the pool may be zero filled lazily
+    Superblock sb;
+    memset(&sb, 0, sizeof(sb));
+    doRead(&sb, START_OFFSET, sizeof(sb));
+
+    if (sb.magic != SUPERBLOCK_MAGIC || sb.version != SUPERBLOCK_VERSION || sb.ptrSize != sizeof(VPtrNum) ||
+        sb.headerSize != sizeof(UMemHeader) || sb.rootCount != ROOT_COUNT || sb.poolSize != poolSize ||
+        sb.poolFreePos < getDataStart() || sb.poolFreePos > poolSize)
+        return false;
+
+    freePointer = sb.freePointer;
+    baseFreeList.s.next = sb.freeListNext;
+    baseFreeList.s.size = 0;
+    poolFreePos = sb.poolFreePos;
+
+#ifdef VIRTMEM_ZERO_FILL
+    // all memory that may contain data was written before
+    if (touchedRegions)
+    {
+        for (VPtrSize r=0; (r * touchedRegionSize) < poolFreePos; ++r)
+            setRegionTouched(r, true);
+    }
+#endif
+
+    return true;
+}
+
+void BaseVAlloc::saveSuperblock()
+{
+    Superblock sb;
+    memset(&sb, 0, sizeof(sb));
+    sb.magic = SUPERBLOCK_MAGIC;
+    sb.version = SUPERBLOCK_VERSION;
+    sb.ptrSize = sizeof(VPtrNum);
+    sb.headerSize = sizeof(UMemHeader);
+    sb.rootCount = ROOT_COUNT;
+    sb.poolSize = poolSize;
+    sb.freePointer = freePointer;
+    sb.freeListNext = baseFreeList.s.next;
+    sb.poolFreePos = poolFreePos;
+    write(START_OFFSET, &sb, sizeof(sb));
+}
+
+/**
+ * @brief Stores a named root pointer of a persistent pool.
+ *
+ * Roots are used to find data in a pool restored by \ref start() (see \ref setPersistent).
+ * @param name Name of the root, at most 15 characters.
+ * @param p Address to store, or zero to remove the root.
+ * @return `false` if all (8) roots are in use.
+ */
+bool BaseVAlloc::setRoot(const char *name, VPtrNum p)
+{
+    VIRTMEM_LOCK_CACHE();
+    ASSERT(persistent && strlen(name) < ROOT_NAME_SIZE);
+
+    int8_t index = findRoot(name);
+    if (index == -1)
+    {
+        if (!p)
+            return true;
+
+        for (uint8_t i=0; i<ROOT_COUNT && index == -1; ++i)
+        {
+            if (!static_cast<const RootEntry *>(read(getRootEntry(i), sizeof(RootEntry)))->ptr)
+                index = i;
+        }
+        if (index == -1)
+            return false;
+    }
+
+    RootEntry root;
+    memset(&root, 0, sizeof(root));
+    if (p)
+    {
+        root.ptr = p;
+        strncpy(root.name, name, ROOT_NAME_SIZE - 1);
+    }
+    write(getRootEntry(index), &root, sizeof(root));
+    return true;
+}
+
+/**
+ * @brief Returns a named root pointer of a persistent pool, or zero if it does not exist.
+ * @sa setRoot
+ */
+VPtrNum BaseVAlloc::getRoot(const char *name)
+{
+    VIRTMEM_LOCK_CACHE();
+    ASSERT(persistent);
+    const int8_t index = findRoot(name);
+    return (index == -1) ? 0 : static_cast<const RootEntry *>(read(getRootEntry(index), sizeof(RootEntry)))->ptr;
+}
+
 /**
  * @fn BaseVAlloc::start()
  * @brief Starts the allocator.
  *
  * This function should always be called during initialization, i.e. in *setup()* function of your sketch.
  * If the allocator was stopped (see \ref stop()), this function should be called again before using the allocator.
- * All used virtual memory (if any) will be cleared during initialization.
+ * All used virtual memory (if any) will be cleared during initialization, unless allocations of a persistent
+ * pool are restored (see \ref setPersistent).
  */
 void BaseVAlloc::start()
 {
+    VIRTMEM_LOCK_ALLOC();
+    VIRTMEM_LOCK_CACHE();
     freePointer = 0;
-    nextPageToSwap = 0;
+#ifdef VIRTMEM_READ_AHEAD
+    readAheadPage = 0;
+    readAheadStride = 0;
+#endif
+    resetShards();
     baseFreeList.s.next = 0;
     baseFreeList.s.size = 0;
-    poolFreePos = START_OFFSET + sizeof(UMemHeader);
+    poolFreePos = getDataStart() + sizeof(UMemHeader);
+    restored = false;
+#ifdef VIRTMEM_SIZE_CLASSES
+    for (uint8_t c=0; c<classCount; ++c)
+        classUsed[c] = 0;
+    for (uint16_t i=0; i<trackedBlockCount; ++i)
+        trackedBlocks[i] = 0;
+#endif
 #ifdef VIRTMEM_TRACE_STATS
     resetStats();
 #endif
 
+#ifdef VIRTMEM_BUDDY_ALLOC
+    if (buddyTree)
+    {
+        ASSERT(!persistent); // refused by setPersistent(), the buddy tree is not stored in the pool
+        resetBuddyTree();
+    }
+#endif
+
     PageInfo *plist[3] = { &smallPages, &mediumPages, &bigPages };
     for (uint8_t pindex=0; pindex<3; ++pindex)
     {
         plist[pindex]->freeIndex = 0;
         plist[pindex]->lockedIndex = -1;
 
-        for (uint8_t i=0; i<plist[pindex]->count; ++i)
+        for (VirtPageIndex i=0; i<plist[pindex]->count; ++i)
         {
             if (i == (plist[pindex]->count - 1))
                 plist[pindex]->pages[i].next = -1;
@@ -534,20 +2063,74 @@ void BaseVAlloc::start()
             plist[pindex]->pages[i].locks = 0;
             plist[pindex]->pages[i].cleanSkips = 0;
             plist[pindex]->pages[i].dirty = false;
+            plist[pindex]->pages[i].flags = 0;
+#ifdef VIRTMEM_PAGE_POLICIES
+            plist[pindex]->pages[i].lastUse = 0;
+#endif
+        }
+    }
+    clearPageIndex(&bigPages);
+    lockIntervalCount = 0;
+#ifdef VIRTMEM_VICTIM_CACHE
+    victimHead = 0;
+    victimTail = victimUsed = 0;
+#endif
+
+#ifdef VIRTMEM_ZERO_FILL
+    poolZeroed = false;
+    if (touchedRegions)
+    {
+        touchedRegionSize = private_utils::maximal((poolSize + touchedRegionCount - 1) / touchedRegionCount, (VPtrSize)1);
+        memset(touchedRegions, 0, (touchedRegionCount + 7) / 8);
+    }
+#endif
+
+#if defined(VIRTMEM_PAGE_TLB) || defined(VIRTMEM_THREAD_SAFE)
+    tlbShift = 0;
+    while ((bigPages.size >> (tlbShift + 1)) != 0)
+        ++tlbShift;
+#endif
+#ifdef VIRTMEM_PAGE_TLB
+    tlbGeneration = 1;
+    for (uint8_t i=0; i<PAGE_TLB_SIZE; ++i)
+    {
+        pageTLB[i].page = -1;
+        pageTLB[i].generation = 0;
+    }
+#endif
+
+    doStart();
+
+    if (persistent)
+    {
+        restored = loadSuperblock();
+        if (!restored)
+        {
+            // new pool: clear roots, the superblock is written by flush()
+            for (uint8_t i=0; i<ROOT_COUNT; ++i)
+            {
+                RootEntry root;
+                memset(&root, 0, sizeof(root));
+                write(getRootEntry(i), &root, sizeof(root));
+            }
         }
     }
-
-    doStart();
 }
 
 /**
  * @fn BaseVAlloc::stop
  * @brief Deinitializes the allocator.
  *
- * Run \ref start() before using the allocator to re-initialize it.
+ * Run \ref start() before using the allocator to re-initialize it. In persistent mode
+ * (see \ref setPersistent) all data is written by calling \ref flush() first.
  */
 void BaseVAlloc::stop()
 {
+    VIRTMEM_LOCK_ALLOC();
+    VIRTMEM_LOCK_CACHE();
+    if (persistent)
+        flush();
+    finishAsync();
     doStop();
 }
 
@@ -559,11 +2142,53 @@ void BaseVAlloc::stop()
  */
 VPtrNum BaseVAlloc::allocRaw(VPtrSize size)
 {
+    VIRTMEM_LOCK_ALLOC();
+
+#ifdef VIRTMEM_BUDDY_ALLOC
+    if (buddyTree)
+        return allocBuddy(size);
+#endif
+
     const VPtrSize quantity = (size + sizeof(UMemHeader) - 1) / sizeof(UMemHeader) + 1;
-    VPtrNum prevp = freePointer;
 
     ASSERT(size && quantity);
 
+#ifdef VIRTMEM_SIZE_CLASSES
+    // size class with a free block? (NOTE: its header is still valid)
+    const VPtrSize sclass = quantity - 2;
+    if (sclass < classCount)
+    {
+        if (classUsed[sclass])
+        {
+#ifdef VIRTMEM_TRACE_STATS
+            ++classAllocHits;
+            memUsed += (quantity * sizeof(UMemHeader));
+            maxMemUsed = private_utils::maximal(maxMemUsed, memUsed);
+#endif
+            const VPtrNum ret = classBlocks[sclass * classDepth + --classUsed[sclass]];
+            trackClassBlock(ret, sclass);
+            return ret;
+        }
+#ifdef VIRTMEM_TRACE_STATS
+        ++classAllocMisses;
+#endif
+    }
+#endif
+
+    VIRTMEM_LOCK_CACHE();
+    const VPtrNum ret = allocFromList(quantity);
+#ifdef VIRTMEM_SIZE_CLASSES
+    if (ret && sclass < classCount)
+        trackClassBlock(ret, sclass); // NOTE: blocks from the free list have exactly the requested size
+#endif
+    return ret;
+}
+
+// Returns (the start of) a block of the given amount of headers from the free list, or 0 if out of memory
+VPtrNum BaseVAlloc::allocBlock(VPtrSize quantity)
+{
+    VPtrNum prevp = freePointer;
+
     // First alloc call, and no free list yet ? Use 'base' for an initial
     // denegerate block of size 0, which points to itself
     if (prevp == 0)
@@ -572,13 +2197,13 @@ VPtrNum BaseVAlloc::allocRaw(VPtrSize size)
         baseFreeList.s.size = 0;
     }
 
-    VPtrNum p = getHeaderConst(prevp)->s.next;
+    VPtrNum p = getHeader(prevp).s.next;
     while (true)
     {
-        const UMemHeader *consth = getHeaderConst(p);
+        UMemHeader consth = getHeader(p);
 
         // big enough ?
-        if (consth->s.size >= quantity)
+        if (consth.s.size >= quantity)
         {
 #ifdef VIRTMEM_TRACE_STATS
             memUsed += (quantity * sizeof(UMemHeader));
@@ -586,11 +2211,11 @@ VPtrNum BaseVAlloc::allocRaw(VPtrSize size)
 #endif
 
             // exactly ?
-            if (consth->s.size == quantity)
+            if (consth.s.size == quantity)
             {
                 // just eliminate this block from the free list by pointing
                 // its prev's next to its next
-                VPtrNum next = consth->s.next;
+                VPtrNum next = consth.s.next;
 //                UMemHeader prevh = *getHeaderConst(prevp); // UNDONE: this seems to sometimes crash while memcpy doesn't?!?
                 UMemHeader prevh;
                 memcpy(&prevh, getHeaderConst(prevp), sizeof(UMemHeader));
@@ -600,9 +2225,7 @@ VPtrNum BaseVAlloc::allocRaw(VPtrSize size)
             }
             else // too big
             {
-                //UMemHeader h = *consth;
-                UMemHeader h;
-                memcpy(&h, consth, sizeof(UMemHeader));
+                UMemHeader h = consth;
                 h.s.size -= quantity;
                 updateHeader(p, &h);
                 p += (h.s.size * sizeof(UMemHeader));
@@ -625,16 +2248,12 @@ VPtrNum BaseVAlloc::allocRaw(VPtrSize size)
         else if (p == freePointer)
         {
             if ((p = getMem(quantity)) == 0)
-            {
-//                std::cout << "!! Memory allocation failed !!\n";
-                ASSERT(false);
                 return 0;
-            }
-            consth = getHeaderConst(p);
+            consth = getHeader(p);
         }
 
         prevp = p;
-        p = consth->s.next;
+        p = consth.s.next;
         ASSERT(p);
     }
 }
@@ -643,52 +2262,701 @@ VPtrNum BaseVAlloc::allocRaw(VPtrSize size)
  * @fn BaseVAlloc::freeRaw
  * @brief Frees a memory block for re-usage.
  * @param ptr starting address of the memory block. This function will do nothing if \a ptr is zero.
+ * @note Recently allocated blocks of the size classes are freed without accessing virtual memory (see
+ * DefaultAllocProperties::sizeClassTrackCount).
  */
 void BaseVAlloc::freeRaw(VPtrNum ptr)
 {
     if (!ptr)
         return;
 
-    // Scans the free list, starting at freePointer, looking the the place to insert the
-    // free block. This is either between two existing blocks or at the end of the
-    // list. In any case, if the block being freed is adjacent to either neighbor,
-    // the adjacent blocks are combined.
+    VIRTMEM_LOCK_ALLOC();
+#ifdef VIRTMEM_BUDDY_ALLOC
+    if (buddyTree)
+    {
+        freeBuddy(ptr);
+        return;
+    }
+#endif
+
+#ifdef VIRTMEM_SIZE_CLASSES
+    // recently allocated block of a size class? Then its header doesn't have to be read
+    const uint8_t tclass = untrackClassBlock(ptr);
+    if (tclass < classCount && classUsed[tclass] < classDepth)
+    {
+#ifdef VIRTMEM_TRACE_STATS
+        memUsed -= ((tclass + 2) * sizeof(UMemHeader));
+#endif
+        classBlocks[tclass * classDepth + classUsed[tclass]++] = ptr;
+        return;
+    }
+#endif
+
+    VIRTMEM_LOCK_CACHE();
+    // acquire pointer to block header
+    const VPtrNum hdrptr = ptr - sizeof(UMemHeader);
+    UMemHeader statheader;
+    memcpy(&statheader, getHeaderConst(hdrptr), sizeof(UMemHeader));
+
+#ifdef VIRTMEM_TRACE_STATS
+    memUsed -= (statheader.s.size * sizeof(UMemHeader));
+#endif
+
+#ifdef VIRTMEM_SIZE_CLASSES
+    // keep block in its size class if possible
+    const VPtrSize sclass = statheader.s.size - 2;
+    if (sclass < classCount && classUsed[sclass] < classDepth)
+    {
+        classBlocks[sclass * classDepth + classUsed[sclass]++] = ptr;
+        return;
+    }
+#endif
+
+    freeBlock(hdrptr, &statheader);
+}
+
+/**
+ * @fn BaseVAlloc::reallocRaw
+ * @brief Resizes a memory block, similar to the C `realloc` function.
+ *
+ * If possible, the block is resized in place: blocks are shrunk by freeing their end, and grown with
+ * an adjacent free block. Otherwise, a new block is allocated and the data is moved directly within the
+ * memory pool (in chunks of the size of a *big* page), rather than through the page cache.
+ * @param ptr starting address of the memory block. If zero, a new block is allocated (see \ref allocRaw).
+ * @param size the new size of the memory block. If zero, the block is freed (see \ref freeRaw).
+ * @return The starting address of the resized memory block, or zero if \a size is zero.
+ * @note Data of the memory block should not be locked while calling this function.
+ */
+VPtrNum BaseVAlloc::reallocRaw(VPtrNum ptr, VPtrSize size)
+{
+    VIRTMEM_LOCK_ALLOC();
+    VIRTMEM_LOCK_CACHE();
+    if (!ptr)
+        return allocRaw(size);
+    if (!size)
+    {
+        freeRaw(ptr);
+        return 0;
+    }
+
+#ifdef VIRTMEM_BUDDY_ALLOC
+    if (buddyTree)
+        return reallocBuddy(ptr, size);
+#endif
+#ifdef VIRTMEM_SIZE_CLASSES
+    untrackClassBlock(ptr); // the size of the block may change
+#endif
+
+    const VPtrSize quantity = (size + sizeof(UMemHeader) - 1) / sizeof(UMemHeader) + 1;
+    const VPtrNum hdrptr = ptr - sizeof(UMemHeader);
+    UMemHeader header;
+    memcpy(&header, getHeaderConst(hdrptr), sizeof(UMemHeader));
+
+    if (quantity <= header.s.size)
+    {
+        shrinkBlock(hdrptr, &header, quantity);
+        return ptr;
+    }
+
+    if (growBlock(hdrptr, &header, quantity))
+        return ptr;
+
+    const VPtrNum ret = allocRaw(size);
+    if (ret)
+    {
+        moveRaw(ret, ptr, (header.s.size - 1) * sizeof(UMemHeader));
+        freeRaw(ptr);
+    }
+    return ret;
+}
+
+/**
+ * @fn BaseVAlloc::allocAligned
+ * @brief Allocates a piece of raw (virtual) memory with an aligned starting address.
+ * @param size the size of the memory block
+ * @param alignment the alignment of the starting address, which should be a power of two and a multiple of the
+ * allocation granularity (the size of a block header, i.e. 8 or 16 bytes).
+ * @return The starting address of the memory block. Will return zero if out of memory.
+ * @note The block is freed as usual, see \ref freeRaw.
+ * @sa allocNoStraddle
+ */
+VPtrNum BaseVAlloc::allocAligned(VPtrSize size, VPtrSize alignment)
+{
+    VIRTMEM_LOCK_ALLOC();
+    VIRTMEM_LOCK_CACHE();
+    ASSERT(alignment && (alignment & (alignment - 1)) == 0);
+
+#ifdef VIRTMEM_BUDDY_ALLOC
+    if (buddyTree) // blocks are aligned to their size
+        return allocBuddy(private_utils::maximal(size, alignment));
+#endif
+
+    const VPtrSize quantity = (size + sizeof(UMemHeader) - 1) / sizeof(UMemHeader) + 1;
+    const VPtrSize extra = (alignment > sizeof(UMemHeader)) ? (alignment / sizeof(UMemHeader) - 1) : 0;
+    const VPtrNum ptr = allocFromList(quantity + extra);
+    if (!ptr)
+        return 0;
+
+    return placeBlock(ptr, (alignment - (ptr & (alignment - 1))) & (alignment - 1), quantity);
+}
+
+/**
+ * @fn BaseVAlloc::allocNoStraddle
+ * @brief Allocates a piece of raw (virtual) memory that is never split by *big* pages.
+ *
+ * When *big* pages are aligned to a grid (see DefaultAllocProperties::bigPageGrid), the returned block does
+ * not cross a page boundary, so it can always be accessed or locked by using a single page. Blocks that are
+ * larger than a *big* page start at a page boundary instead. Without a grid, pages can start at any address
+ * and this function is equivalent to \ref allocRaw. The same applies to the buddy engine (see AllocEngine), since
+ * its blocks are already aligned to their (power of two) size.
+ * @param size the size of the memory block
+ * @return The starting address of the memory block. Will return zero if out of memory.
+ * @note The block is freed as usual, see \ref freeRaw.
+ * @sa allocAligned
+ */
+VPtrNum BaseVAlloc::allocNoStraddle(VPtrSize size)
+{
+    VIRTMEM_LOCK_ALLOC();
+    VIRTMEM_LOCK_CACHE();
+    if (!bigPageGrid || getAllocEngine() == ALLOC_ENGINE_BUDDY)
+        return allocRaw(size);
+    if (size > bigPages.size)
+        return allocAligned(size, bigPages.size);
+
+    // allocate enough to skip the part before a page boundary
+    const VPtrSize quantity = (size + sizeof(UMemHeader) - 1) / sizeof(UMemHeader) + 1;
+    const VPtrSize extra = (size + sizeof(UMemHeader) - 1) / sizeof(UMemHeader);
+    const VPtrNum ptr = allocFromList(quantity + extra);
+    if (!ptr)
+        return 0;
+
+    const VPtrNum boundary = ((ptr >> bigPageShift) + 1) << bigPageShift;
+    return placeBlock(ptr, ((ptr + size) > boundary) ? (boundary - ptr) : 0, quantity);
+}
+
+/**
+ * @fn BaseVAlloc::allocNear
+ * @brief Allocates a piece of raw (virtual) memory close to an existing block.
+ *
+ * This function tries to place the new block in the same or an adjacent *big* page as \a hint, for instance
+ * to allocate the nodes of a linked data structure close to each other, so following links mostly accesses
+ * already loaded pages. Freed blocks of the size classes (see DefaultAllocProperties::sizeClassCount) are tried
+ * first, followed by the free blocks that surround \a hint. If these are too far away, the block is allocated
+ * as usual (see \ref allocRaw).
+ * @param hint address of an allocated block (or zero, which is equivalent to \ref allocRaw).
+ * @param size the size of the memory block
+ * @return The starting address of the memory block. Will return zero if out of memory.
+ * @note Like \ref freeRaw, this function walks the free list to find the surrounding free blocks.
+ * The buddy engine (see AllocEngine) ignores \a hint.
+ * @note The block is freed as usual, see \ref freeRaw.
+ * @sa VAllocGroup
+ */
+VPtrNum BaseVAlloc::allocNear(VPtrNum hint, VPtrSize size)
+{
+    VIRTMEM_LOCK_ALLOC();
+    VIRTMEM_LOCK_CACHE();
+    if (!hint || getAllocEngine() == ALLOC_ENGINE_BUDDY)
+        return allocRaw(size);
+
+    const VPtrSize quantity = (size + sizeof(UMemHeader) - 1) / sizeof(UMemHeader) + 1;
+    const VPtrSize maxdist = bigPages.size;
+
+#ifdef VIRTMEM_SIZE_CLASSES
+    // freed block of the size class nearby?
+    const VPtrSize sclass = quantity - 2;
+    for (uint8_t i=(sclass < classCount) ? classUsed[sclass] : 0; i>0; --i)
+    {
+        VPtrNum *block = &classBlocks[sclass * classDepth + i - 1];
+        if (((*block > hint) ? (*block - hint) : (hint - *block)) <= maxdist)
+        {
+            const VPtrNum ret = *block;
+            *block = classBlocks[sclass * classDepth + --classUsed[sclass]];
+            trackClassBlock(ret, sclass);
+#ifdef VIRTMEM_TRACE_STATS
+            ++classAllocHits;
+            memUsed += (quantity * sizeof(UMemHeader));
+            maxMemUsed = private_utils::maximal(maxMemUsed, memUsed);
+#endif
+            return ret;
+        }
+    }
+#endif
+
+    if (!freePointer)
+        return allocRaw(size);
+
+    // free blocks directly before and after the hint
+    const VPtrNum prevp = findFreeBlockBefore(hint);
+    UMemHeader prevh;
+    memcpy(&prevh, getHeaderConst(prevp), sizeof(UMemHeader));
+    const VPtrNum nextp = prevh.s.next;
+    UMemHeader nexth;
+    memcpy(&nexth, getHeaderConst(nextp), sizeof(UMemHeader));
+
+    // the end of the previous block is only used if it remains in the free list
+    const VPtrNum prevend = prevp + prevh.s.size * sizeof(UMemHeader);
+    const VPtrSize prevdist = (prevp != BASE_INDEX && prevp < hint && prevh.s.size > quantity) ?
+                (hint - private_utils::minimal(prevend, hint)) : maxdist + 1;
+    const VPtrSize nextdist = (nextp != BASE_INDEX && nextp > hint && nexth.s.size >= quantity) ? (nextp - hint) : maxdist + 1;
+    if (prevdist > maxdist && nextdist > maxdist)
+        return allocRaw(size);
+
+    VPtrNum ret;
+    if (prevdist <= nextdist)
+    {
+        // carve from the end, as allocBlock()
+        prevh.s.size -= quantity;
+        updateHeader(prevp, &prevh);
+        ret = prevend - quantity * sizeof(UMemHeader);
+    }
+    else
+    {
+        // carve from the start
+        if (nexth.s.size == quantity)
+            prevh.s.next = nexth.s.next;
+        else
+        {
+            UMemHeader resth;
+            resth.s.size = nexth.s.size - quantity;
+            resth.s.next = nexth.s.next;
+            prevh.s.next = nextp + quantity * sizeof(UMemHeader);
+            updateHeader(prevh.s.next, &resth);
+        }
+        updateHeader(prevp, &prevh);
+        ret = nextp;
+    }
+
+    UMemHeader h;
+    h.s.next = 0;
+    h.s.size = quantity;
+    updateHeader(ret, &h);
+    freePointer = prevp;
+
+#ifdef VIRTMEM_TRACE_STATS
+    memUsed += (quantity * sizeof(UMemHeader));
+    maxMemUsed = private_utils::maximal(maxMemUsed, memUsed);
+#endif
+
+    return ret + sizeof(UMemHeader);
+}
+
+/**
+ * @fn BaseVAlloc::splitRaw
+ * @brief Splits an allocated memory block in two allocated blocks.
+ *
+ * The block is shrunk to the given size, and the remaining memory becomes a new block, which can be
+ * freed separately (see \ref freeRaw). This allows handing out parts of a larger block, see VAllocGroup.
+ * @param ptr starting address of the memory block.
+ * @param size the new size of the memory block.
+ * @return The starting address of the new block with the remaining memory, or zero if the remainder is too small
+ * to hold any data (the block is unchanged in this case).
+ * @note This function is not supported by the buddy engine (see AllocEngine).
+ * @sa getRawSize
+ */
+VPtrNum BaseVAlloc::splitRaw(VPtrNum ptr, VPtrSize size)
+{
+    VIRTMEM_LOCK_ALLOC();
+    VIRTMEM_LOCK_CACHE();
+    ASSERT(getAllocEngine() == ALLOC_ENGINE_FREELIST && size);
+
+    const VPtrSize quantity = (size + sizeof(UMemHeader) - 1) / sizeof(UMemHeader) + 1;
+    const VPtrNum hdrptr = ptr - sizeof(UMemHeader);
+    UMemHeader header;
+    memcpy(&header, getHeaderConst(hdrptr), sizeof(UMemHeader));
+    if (header.s.size < quantity || (header.s.size - quantity) < 2)
+        return 0;
+
+    UMemHeader resth;
+    resth.s.next = 0;
+    resth.s.size = header.s.size - quantity;
+    header.s.size = quantity;
+    updateHeader(hdrptr, &header);
+    updateHeader(hdrptr + quantity * sizeof(UMemHeader), &resth);
+    return hdrptr + (quantity + 1) * sizeof(UMemHeader);
+}
+
+/**
+ * @fn BaseVAlloc::getRawSize
+ * @brief Returns the usable size of an allocated memory block.
+ *
+ * This is at least the size that was requested for the block, since sizes are rounded up by the allocator.
+ * @param ptr starting address of the memory block.
+ */
+VPtrSize BaseVAlloc::getRawSize(VPtrNum ptr)
+{
+    VIRTMEM_LOCK_ALLOC();
+    VIRTMEM_LOCK_CACHE();
+#ifdef VIRTMEM_BUDDY_ALLOC
+    if (buddyTree)
+    {
+        uint8_t order;
+        findBuddyNode(ptr, order);
+        return getBuddySize(order);
+    }
+#endif
+    return (getHeader(ptr - sizeof(UMemHeader)).s.size - 1) * sizeof(UMemHeader);
+}
+
+// Allocates a block of the given amount of headers from the free list (ie bypassing the size classes)
+VPtrNum BaseVAlloc::allocFromList(VPtrSize quantity)
+{
+    VPtrNum ret = allocBlock(quantity);
+    if (!ret && drainSizeClasses()) // blocks may be merged now
+        ret = allocBlock(quantity);
+
+//    if (!ret)
+//        std::cout << "!! Memory allocation failed !!\n";
+    ASSERT(ret);
+    return ret;
+}
+
+// Moves the start of an allocated block by offset bytes, and shrinks it to the given amount of headers.
+// The skipped and remaining parts are freed. Returns the new start of the block.
+VPtrNum BaseVAlloc::placeBlock(VPtrNum ptr, VPtrSize offset, VPtrSize quantity)
+{
+    ASSERT((offset % sizeof(UMemHeader)) == 0);
+
+    VPtrNum hdrptr = ptr - sizeof(UMemHeader);
+    UMemHeader header;
+    memcpy(&header, getHeaderConst(hdrptr), sizeof(UMemHeader));
+
+    if (offset)
+    {
+        // the skipped part becomes a free block (which can hold at least its header)
+        UMemHeader skiph;
+        skiph.s.size = offset / sizeof(UMemHeader);
+        header.s.size -= skiph.s.size;
+        updateHeader(hdrptr + offset, &header);
+#ifdef VIRTMEM_TRACE_STATS
+        memUsed -= offset;
+#endif
+        freeBlock(hdrptr, &skiph);
+        hdrptr += offset;
+    }
+
+    ASSERT(header.s.size >= quantity);
+    shrinkBlock(hdrptr, &header, quantity);
+    return hdrptr + sizeof(UMemHeader);
+}
+
+// Frees the end of an allocated block so it has the given amount of headers, unless the end is too small to hold any data
+void BaseVAlloc::shrinkBlock(VPtrNum hdrptr, UMemHeader *header, VPtrSize quantity)
+{
+    if ((header->s.size - quantity) < 2)
+        return;
+
+    UMemHeader resth;
+    resth.s.size = header->s.size - quantity;
+    header->s.size = quantity;
+    updateHeader(hdrptr, header);
+#ifdef VIRTMEM_TRACE_STATS
+    memUsed -= (resth.s.size * sizeof(UMemHeader));
+#endif
+    freeBlock(hdrptr + quantity * sizeof(UMemHeader), &resth);
+}
+
+#ifdef VIRTMEM_SIZE_CLASSES
+// Returns all blocks of the size classes to the free list. Returns false if there were none.
+bool BaseVAlloc::drainSizeClasses()
+{
+    bool ret = false;
+    for (uint8_t c=0; c<classCount; ++c)
+    {
+        for (; classUsed[c]; ret = true)
+        {
+            const VPtrNum hdrptr = classBlocks[c * classDepth + --classUsed[c]] - sizeof(UMemHeader);
+            UMemHeader header;
+            memcpy(&header, getHeaderConst(hdrptr), sizeof(UMemHeader));
+            freeBlock(hdrptr, &header);
+        }
+    }
+    return ret;
+}
+
+// Remembers the size class of an allocated block, so freeRaw() doesn't have to read its header
+void BaseVAlloc::trackClassBlock(VPtrNum ptr, uint8_t sclass)
+{
+    if (trackedBlockCount)
+    {
+        const uint16_t slot = getTrackedBlockSlot(ptr);
+        trackedBlocks[slot] = ptr;
+        trackedClasses[slot] = sclass;
+    }
+}
+
+// Forgets a block remembered by trackClassBlock() and returns its size class, or classCount if it is unknown
+uint8_t BaseVAlloc::untrackClassBlock(VPtrNum ptr)
+{
+    if (trackedBlockCount)
+    {
+        const uint16_t slot = getTrackedBlockSlot(ptr);
+        if (trackedBlocks[slot] == ptr)
+        {
+            trackedBlocks[slot] = 0;
+            return trackedClasses[slot];
+        }
+    }
+    return classCount;
+}
+#endif
+
+#ifdef VIRTMEM_BUDDY_ALLOC
+// Initializes the buddy tree. Blocks are addressed from the start of the pool, so they are aligned to their size.
+// The part before the data start and beyond the pool is reserved.
+void BaseVAlloc::resetBuddyTree()
+{
+    buddyLevels = 0;
+    while (((uint32_t)1 << buddyLevels) < buddyMaxBlocks && getBuddySize(buddyLevels) < poolSize)
+        ++buddyLevels;
+
+    // all blocks are free
+    for (uint8_t d=0; d<=buddyLevels; ++d)
+        memset(&buddyTree[((uint32_t)1 << d) - 1], buddyLevels - d + 1, (uint32_t)1 << d);
+
+    reserveBuddyRange(0, buddyLevels, 0, 0, (getDataStart() + buddyMinSize - 1) / buddyMinSize * buddyMinSize);
+    if (poolSize < getBuddySize(buddyLevels))
+        reserveBuddyRange(0, buddyLevels, 0, poolSize / buddyMinSize * buddyMinSize, getBuddySize(buddyLevels));
+}
+
+// Marks all blocks within the given range (aligned to the smallest block size) as allocated
+void BaseVAlloc::reserveBuddyRange(uint32_t node, uint8_t order, VPtrNum start, VPtrNum rstart, VPtrNum rend)
+{
+    const VPtrNum end = start + getBuddySize(order);
+    if (rend <= start || rstart >= end)
+        return;
+
+    if (rstart <= start && rend >= end)
+        buddyTree[node] = 0;
+    else
+    {
+        // NOTE: partially reserved blocks are never the smallest blocks
+        reserveBuddyRange(node * 2 + 1, order - 1, start, rstart, rend);
+        reserveBuddyRange(node * 2 + 2, order - 1, start + getBuddySize(order - 1), rstart, rend);
+        buddyTree[node] = private_utils::maximal(buddyTree[node * 2 + 1], buddyTree[node * 2 + 2]);
+    }
+}
+
+// Updates the ancestors of a node after it was allocated or freed
+void BaseVAlloc::updateBuddyParents(uint32_t node, uint8_t order)
+{
+    while (node)
+    {
+        node = (node - 1) / 2;
+        ++order;
+        const uint8_t left = buddyTree[node * 2 + 1], right = buddyTree[node * 2 + 2];
+        // merge if both children are completely free
+        buddyTree[node] = (left == order && right == order) ? (order + 1) : private_utils::maximal(left, right);
+    }
+}
+
+// Returns the node of an allocated block and its order
+uint32_t BaseVAlloc::findBuddyNode(VPtrNum ptr, uint8_t &order) const
+{
+    ASSERT((ptr % buddyMinSize) == 0 && ptr < getBuddySize(buddyLevels));
+
+    // the nodes below an allocated block are never modified, so find the first allocated node above its first leaf
+    uint32_t node = (((uint32_t)1 << buddyLevels) - 1) + ptr / buddyMinSize;
+    for (order=0; buddyTree[node] != 0; ++order)
+    {
+        ASSERT(node);
+        node = (node - 1) / 2;
+    }
+    return node;
+}
+
+VPtrNum BaseVAlloc::allocBuddy(VPtrSize size)
+{
+    ASSERT(size);
+
+    uint8_t order = 0;
+    while (order <= buddyLevels && getBuddySize(order) < size)
+        ++order;
+    if (buddyTree[0] < (order + 1))
+    {
+        ASSERT(false); // out of memory
+        return 0;
+    }
+
+    // descend to a free block of the right order, prefer the left child
+    uint32_t node = 0;
+    for (uint8_t o=buddyLevels; o>order; --o)
+    {
+        node = node * 2 + 1;
+        if (buddyTree[node] < (order + 1))
+            ++node;
+    }
+
+    buddyTree[node] = 0;
+    updateBuddyParents(node, order);
+
+#ifdef VIRTMEM_TRACE_STATS
+    memUsed += getBuddySize(order);
+    maxMemUsed = private_utils::maximal(maxMemUsed, memUsed);
+#endif
+
+    return (node - (((uint32_t)1 << (buddyLevels - order)) - 1)) * getBuddySize(order);
+}
+
+void BaseVAlloc::freeBuddy(VPtrNum ptr)
+{
+    uint8_t order;
+    const uint32_t node = findBuddyNode(ptr, order);
+    buddyTree[node] = order + 1;
+    updateBuddyParents(node, order);
+#ifdef VIRTMEM_TRACE_STATS
+    memUsed -= getBuddySize(order);
+#endif
+}
+
+VPtrNum BaseVAlloc::reallocBuddy(VPtrNum ptr, VPtrSize size)
+{
+    uint8_t order;
+    uint32_t node = findBuddyNode(ptr, order);
+
+    if (size <= getBuddySize(order))
+    {
+        // shrink by freeing second halves
+        if (order > 0 && size <= getBuddySize(order - 1))
+        {
+            do
+            {
+                --order;
+                node = node * 2 + 1;
+                buddyTree[node] = 0;
+                buddyTree[node + 1] = order + 1;
+#ifdef VIRTMEM_TRACE_STATS
+                memUsed -= getBuddySize(order);
+#endif
+            }
+            while (order > 0 && size <= getBuddySize(order - 1));
+            updateBuddyParents(node, order);
+        }
+        return ptr;
+    }
 
-    // acquire pointer to block header
-    const VPtrNum hdrptr = ptr - sizeof(UMemHeader);
-    UMemHeader statheader;
-    memcpy(&statheader, getHeaderConst(hdrptr), sizeof(UMemHeader));
+    // grow in place if the block is a first half, and its buddies are completely free
+    uint32_t growNode = node;
+    uint8_t growOrder = order;
+    while (size > getBuddySize(growOrder) && (growNode & 1) && buddyTree[growNode + 1] == (growOrder + 1))
+    {
+        growNode = (growNode - 1) / 2;
+        ++growOrder;
+    }
 
+    if (size <= getBuddySize(growOrder))
+    {
 #ifdef VIRTMEM_TRACE_STATS
-    memUsed -= (statheader.s.size * sizeof(UMemHeader));
+        memUsed += getBuddySize(growOrder) - getBuddySize(order);
+        maxMemUsed = private_utils::maximal(maxMemUsed, memUsed);
+#endif
+        // nodes below the new block are marked as free
+        for (; node != growNode; node = (node - 1) / 2, ++order)
+            buddyTree[node] = order + 1;
+        buddyTree[growNode] = 0;
+        updateBuddyParents(growNode, growOrder);
+        return ptr;
+    }
+
+    const VPtrNum ret = allocBuddy(size);
+    if (ret)
+    {
+        moveRaw(ret, ptr, getBuddySize(order));
+        freeBuddy(ptr);
+    }
+    return ret;
+}
 #endif
 
+// Returns the free block after which the block at hdrptr should be placed in the free list
+VPtrNum BaseVAlloc::findFreeBlockBefore(VPtrNum hdrptr)
+{
     // Find the correct place to place the block in (the free list is sorted by
     // address, increasing order)
     VPtrNum p = freePointer;
-    const UMemHeader *consth = getHeaderConst(p);
-    while (!(hdrptr > p && hdrptr < consth->s.next))
+    UMemHeader consth = getHeader(p);
+    while (!(hdrptr > p && hdrptr < consth.s.next))
     {
         // Since the free list is circular, there is one link where a
         // higher-addressed block points to a lower-addressed block.
         // This condition checks if the block should be actually
         // inserted between them
-        if (p >= consth->s.next && (hdrptr > p || hdrptr < consth->s.next))
+        if (p >= consth.s.next && (hdrptr > p || hdrptr < consth.s.next))
             break;
 
-        p = consth->s.next;
-        consth = getHeaderConst(p);
+        p = consth.s.next;
+        consth = getHeader(p);
+    }
+
+    return p;
+}
+
+// Enlarges an allocated block to the given amount of headers with the free block directly following it
+// (or unused memory at the end of the pool). Returns false if there is not enough adjacent free memory.
+bool BaseVAlloc::growBlock(VPtrNum hdrptr, UMemHeader *header, VPtrSize quantity)
+{
+    const VPtrNum nextptr = hdrptr + header->s.size * sizeof(UMemHeader);
+    const VPtrSize needed = quantity - header->s.size;
+
+    const VPtrNum p = findFreeBlockBefore(hdrptr);
+    VPtrSize avail = (getHeader(p).s.next == nextptr) ? getHeader(nextptr).s.size : 0;
+
+    // block (and its free neighbour) at the end of the used pool? Then just claim more memory
+    if (avail < needed && (nextptr + avail * sizeof(UMemHeader)) == poolFreePos)
+    {
+        if (!getMem(needed - avail))
+            return false;
+        ASSERT(getHeader(p).s.next == nextptr);
+        avail = getHeader(nextptr).s.size;
+    }
+
+    if (avail < needed)
+        return false;
+
+    UMemHeader prevh;
+    memcpy(&prevh, getHeaderConst(p), sizeof(UMemHeader));
+    if (avail == needed)
+        prevh.s.next = getHeader(nextptr).s.next;
+    else
+    {
+        // the remainder of the free block stays in the list
+        UMemHeader resth;
+        resth.s.next = getHeader(nextptr).s.next;
+        resth.s.size = avail - needed;
+        prevh.s.next = nextptr + needed * sizeof(UMemHeader);
+        updateHeader(prevh.s.next, &resth);
     }
+    updateHeader(p, &prevh);
+
+    header->s.size = quantity;
+    updateHeader(hdrptr, header);
+    freePointer = p;
+
+#ifdef VIRTMEM_TRACE_STATS
+    memUsed += (needed * sizeof(UMemHeader));
+    maxMemUsed = private_utils::maximal(maxMemUsed, memUsed);
+#endif
+    return true;
+}
+
+// Inserts a block in the free list
+void BaseVAlloc::freeBlock(VPtrNum hdrptr, UMemHeader *header)
+{
+    // Scans the free list, starting at freePointer, looking the the place to insert the
+    // free block. This is either between two existing blocks or at the end of the
+    // list. In any case, if the block being freed is adjacent to either neighbor,
+    // the adjacent blocks are combined.
+    UMemHeader &statheader = *header;
 
+    const VPtrNum p = findFreeBlockBefore(hdrptr);
     UMemHeader stath;
-    memcpy(&stath, consth, sizeof(UMemHeader));
+    memcpy(&stath, getHeaderConst(p), sizeof(UMemHeader));
 
     // Try to combine with the higher neighbor
-    if ((hdrptr + statheader.s.size) == stath.s.next)
+    if ((hdrptr + statheader.s.size * sizeof(UMemHeader)) == stath.s.next)
     {
-        const UMemHeader *nexth = getHeaderConst(stath.s.next);
-        statheader.s.size += nexth->s.size;
-        statheader.s.next = nexth->s.next;
+        const UMemHeader nexth = getHeader(stath.s.next);
+        statheader.s.size += nexth.s.size;
+        statheader.s.next = nexth.s.next;
     }
     else
         statheader.s.next = stath.s.next;
@@ -697,7 +2965,7 @@ void BaseVAlloc::freeRaw(VPtrNum ptr)
     updateHeader(hdrptr, &statheader);
 
     // Try to combine with the lower neighbor
-    if (p + stath.s.size == hdrptr)
+    if ((p + stath.s.size * sizeof(UMemHeader)) == hdrptr)
     {
         stath.s.size += statheader.s.size;
         stath.s.next = statheader.s.next;
@@ -720,44 +2988,83 @@ void BaseVAlloc::freeRaw(VPtrNum ptr)
  * @return a pointer to a memory block (a memory page) containing the data
  * @note The memory block returned by this function is temporary and may be invalidated
  * during a page swap. To use the memory accross reads and writes it should be locked.
+ * @note In concurrent mode (see \ref VIRTMEM_THREAD_SAFE) other threads may swap the page at any time, so
+ * the data should be copied with the other overload instead.
  */
 void *BaseVAlloc::read(VPtrNum p, VPtrSize size)
 {
-    PageInfo *plist[3] = { &smallPages, &mediumPages, &bigPages };
+    VIRTMEM_LOCK_RANGE(p, size);
+    // fast path: recently used big page
+    LockPage *tlbpage = findTLBPage(p, size);
+    if (tlbpage)
+    {
+        publishFrame(tlbpage - bigPages.pages, p); // may be clean again
+        return tlbpage->pool + (p - tlbpage->start);
+    }
+
     const VPtrNum pend = p + size;
 
-    for (uint8_t pindex=0; pindex<3; ++pindex)
+    for (VirtPageIndex l=findLockOverlap(p); l<lockIntervalCount && getLockInterval(l)->start < pend; ++l)
     {
-        for (int8_t i=plist[pindex]->lockedIndex; i!=-1; i=plist[pindex]->pages[i].next)
-        {
-            const bool beginoverlaps = (p >= plist[pindex]->pages[i].start &&
-                                      p < (plist[pindex]->pages[i].start + plist[pindex]->pages[i].size));
-            const bool endoverlaps = (p < plist[pindex]->pages[i].start && pend > plist[pindex]->pages[i].start);
+        LockPage *page = getLockInterval(l);
+        const bool beginoverlaps = (p >= page->start && p < (page->start + page->size));
+        const bool endoverlaps = (p < page->start && pend > page->start);
 
-            if (beginoverlaps)
+        if (beginoverlaps)
+        {
+            const VPtrNum offset = p - page->start;
+            // data fits in this page?
+            if ((offset + size) <= page->size)
             {
-                const VPtrNum offset = p - plist[pindex]->pages[i].start;
-                // data fits in this page?
-                if ((offset + size) <= plist[pindex]->pages[i].size)
-                {
-        //            std::cout << "using temp lock page " << (int)(pageindex) << ", " << p << std::endl;
-                    return (char *)plist[pindex]->pages[i].pool + offset;
-                }
+    //            std::cout << "using temp lock page " << (int)(pageindex) << ", " << p << std::endl;
+                return (char *)page->pool + offset;
             }
+        }
 
-            if (beginoverlaps || endoverlaps)
-            {
-                // only fits partially... mirror data to normal page so a continuous block can be returned
-                pushRawData(plist[pindex]->pages[i].start, plist[pindex]->pages[i].pool,
-                            plist[pindex]->pages[i].size); // UNDONE: partial copy, check dirty?
+        if (beginoverlaps || endoverlaps)
+        {
+            // only fits partially... mirror data to normal page so a continuous block can be returned
+            pushRawData(page->start, page->pool, page->size); // UNDONE: partial copy, check dirty?
 
-//                std::cout << "mirrored partial page: " << (int)pindex << "/" << (int)(i) << std::endl;
-            }
+//            std::cout << "mirrored partial page: " << (int)l << std::endl;
         }
     }
 
     // not in or too big for partial page, use regular paged memory
-    return pullRawData(p, size, true, false);
+    void *ret = pullRawData(p, size, true, false);
+    updateTLB(p, size);
+    return ret;
+}
+
+/**
+ * @brief Copies a raw block of (virtual) memory.
+ *
+ * Unlike the other overload, the data is copied while the page cache is locked, hence this function is safe
+ * to use while other threads access the allocator (see \ref VIRTMEM_THREAD_SAFE). The size is not limited
+ * by the page size.
+ *
+ * In concurrent mode, data that is inside a clean *big* page is first copied without locking: the copy is
+ * only used if the page did not change meanwhile (every page has a version that changes when the page
+ * becomes dirty, is locked or is swapped). Hence, readers of frequently used pages don't block each other.
+ * @param p starting address of memory block
+ * @param d destination buffer
+ * @param size number of bytes to read
+ */
+void BaseVAlloc::read(VPtrNum p, void *d, VPtrSize size)
+{
+#ifdef VIRTMEM_THREAD_SAFE
+    if (readOptimistic(p, d, size))
+        return;
+#endif
+
+    VIRTMEM_LOCK_RANGE(p, size); // NOTE: all cache shards are locked if the data is not within a single grid page
+
+    for (VPtrSize offset=0; offset<size; )
+    {
+        const VPtrSize chunk = private_utils::minimal(size - offset, (VPtrSize)bigPages.size);
+        memcpy(static_cast<char *>(d) + offset, read(p + offset, chunk), chunk);
+        offset += chunk;
+    }
 }
 
 /**
@@ -769,62 +3076,116 @@ void *BaseVAlloc::read(VPtrNum p, VPtrSize size)
  */
 void BaseVAlloc::write(VPtrNum p, const void *d, VPtrSize size)
 {
-    PageInfo *plist[3] = { &smallPages, &mediumPages, &bigPages };
+    VIRTMEM_LOCK_RANGE(p, size);
+    // fast path: recently used big page
+    LockPage *tlbpage = findTLBPage(p, size);
+    if (tlbpage)
+    {
+        markDirty(tlbpage, p - tlbpage->start, size);
+        memcpy(tlbpage->pool + (p - tlbpage->start), d, size);
+        return;
+    }
+
     const VPtrNum pend = p + size;
 
-    for (uint8_t pindex=0; pindex<3; ++pindex)
+    for (VirtPageIndex l=findLockOverlap(p); l<lockIntervalCount && getLockInterval(l)->start < pend; ++l)
     {
-        for (int8_t i=plist[pindex]->lockedIndex; i!=-1; i=plist[pindex]->pages[i].next)
-        {
-            const bool beginoverlaps = (p >= plist[pindex]->pages[i].start &&
-                                      p < (plist[pindex]->pages[i].start + plist[pindex]->pages[i].size));
-            const bool endoverlaps = (p < plist[pindex]->pages[i].start && pend > plist[pindex]->pages[i].start);
+        LockPage *page = getLockInterval(l);
+        const bool beginoverlaps = (p >= page->start && p < (page->start + page->size));
+        const bool endoverlaps = (p < page->start && pend > page->start);
 
-            if (!plist[pindex]->pages[i].dirty && (beginoverlaps || endoverlaps))
-                plist[pindex]->pages[i].dirty = true;
-
-            if (beginoverlaps)
+        if (beginoverlaps)
+        {
+            const VPtrNum offset = p - page->start;
+            // data fits in this page?
+            if ((offset + size) <= page->size)
             {
-                const VPtrNum offset = p - plist[pindex]->pages[i].start;
-                // data fits in this page?
-                if ((offset + size) <= plist[pindex]->pages[i].size)
-                {
-                    memcpy((char *)plist[pindex]->pages[i].pool + offset, d, size);
-                    return;
-                }
-                else
-                {
-                    // partial fit (data too large), copy stuff that fits in page
-                    memcpy((char *)plist[pindex]->pages[i].pool + offset, d, plist[pindex]->pages[i].size - offset);
-                }
+                memcpy((char *)page->pool + offset, d, size);
+                markDirty(page, offset, size);
+                return;
             }
-            else if (endoverlaps)
+            else
             {
-                // partial fit (data starts before), copy stuff that fits in page
-                const VPtrNum offset = plist[pindex]->pages[i].start - p;
-                memcpy((char *)plist[pindex]->pages[i].pool, (uint8_t *)d + offset, size - offset);
+                // partial fit (data too large), copy stuff that fits in page
+                memcpy((char *)page->pool + offset, d, page->size - offset);
+                markDirty(page, offset, page->size - offset);
             }
         }
+        else if (endoverlaps)
+        {
+            // partial fit (data starts before), copy stuff that fits in page
+            const VPtrNum offset = page->start - p;
+            const VPtrSize copysize = private_utils::minimal(size - offset, (VPtrSize)page->size);
+            memcpy((char *)page->pool, (uint8_t *)d + offset, copysize);
+            markDirty(page, 0, copysize);
+        }
     }
 
     // data was either not or partially in a lock if we are here
     // UNDONE: partial copy if data was partially in locks?
     pushRawData(p, d, size);
+    updateTLB(p, size);
 }
 
 /**
  * @fn BaseVAlloc::flush
  * @brief Synchronizes all *big* memory pages.
- * @note This function is merely used for debugging.
+ *
+ * In persistent mode (see \ref setPersistent) the state of the allocator is stored as well.
  */
 void BaseVAlloc::flush()
 {
+    VIRTMEM_LOCK_ALLOC();
+    VIRTMEM_LOCK_CACHE();
+    if (persistent)
+    {
+        drainSizeClasses(); // the superblock only knows the free list
+        saveSuperblock();
+    }
+
     // UNDONE: also flush locked pages?
-    for (int8_t i=bigPages.freeIndex; i!=-1; i=bigPages.pages[i].next)
+    for (VirtPageIndex i=bigPages.freeIndex; i!=-1; i=bigPages.pages[i].next)
     {
-        if (bigPages.pages[i].start != 0)
-            syncBigPage(&bigPages.pages[i]);
+        if (bigPages.pages[i].start == 0 || !bigPages.pages[i].dirty)
+            continue;
+
+        // page is written together with its predecessor?
+        const VirtPageIndex prev = findIndexedPage(&bigPages, bigPages.pages[i].start - 1);
+        if (prev != -1 && findFlushNext(prev) == i)
+            continue;
+
+        // write modified data of this page and any following pages at once
+        LockPage *page = &bigPages.pages[i];
+        const VirtPageSize dstart = getDirtyStart(page);
+        const VPtrNum wrstart = page->start + dstart;
+        VPtrSize wrsize = getDirtyEnd(page) - dstart;
+        VirtPageIndex wrpages = 1;
+        for (VirtPageIndex n=findFlushNext(i); n!=-1; n=findFlushNext(n))
+        {
+            wrsize += getDirtyEnd(&bigPages.pages[n]);
+            ++wrpages;
+        }
+
+        wrsize = private_utils::minimal(poolSize - wrstart, wrsize);
+        writePool(page->pool + dstart, wrstart, wrsize, true); // NOTE: pages are not modified until finished
+
+        for (VirtPageIndex n=i; n!=-1; )
+        {
+            const VirtPageIndex next = findFlushNext(n);
+            bigPages.pages[n].dirty = false;
+            bigPages.pages[n].cleanSkips = 0;
+            n = next;
+        }
+
+#ifdef VIRTMEM_TRACE_STATS
+        bigPageWrites += wrpages;
+        bytesWritten += wrsize;
+#endif
     }
+
+    if (getVictimCacheSize())
+        syncVictimRange(0, poolSize, false);
+    finishAsync();
 }
 
 /**
@@ -834,26 +3195,257 @@ void BaseVAlloc::flush()
  */
 void BaseVAlloc::clearPages()
 {
+    VIRTMEM_LOCK_CACHE();
+    finishAsync();
     // wipe all pages
-    for (int8_t i=bigPages.freeIndex; i!=-1; i=bigPages.pages[i].next)
+    for (VirtPageIndex i=bigPages.freeIndex; i!=-1; i=bigPages.pages[i].next)
     {
         if (bigPages.pages[i].start != 0)
         {
             syncBigPage(&bigPages.pages[i]);
+            unindexPage(&bigPages, i);
             bigPages.pages[i].start = 0;
         }
     }
+
+    if (getVictimCacheSize())
+        clearVictimCache();
+}
+
+// Returns an unused big page, e.g. to use its memory as a temporary buffer. A (preferably clean) page is
+// swapped out if necessary.
+VirtPageIndex BaseVAlloc::getUnusedBigPage()
+{
+    VirtPageIndex ret = -1;
+    for (VirtPageIndex i=bigPages.freeIndex; i!=-1; i=bigPages.pages[i].next)
+    {
+        if (bigPages.pages[i].start == 0)
+            return i;
+        if (ret == -1 && !bigPages.pages[i].dirty)
+            ret = i;
+    }
+
+    if (ret == -1)
+        ret = bigPages.freeIndex;
+    ASSERT(ret != -1);
+
+    if (!storeVictimPage(&bigPages.pages[ret]))
+        syncBigPage(&bigPages.pages[ret]);
+    unindexPage(&bigPages, ret);
+    bigPages.pages[ret].start = 0;
+    return ret;
+}
+
+/**
+ * @fn BaseVAlloc::moveRaw
+ * @brief Copies raw data directly within the memory pool, similar to the C `memmove` function.
+ *
+ * Data is copied in chunks of the size of a *big* page, instead of through the page cache. Cached pages
+ * containing the source data are synchronized first, and those containing destination data are updated.
+ * @param dest starting address of the destination
+ * @param src starting address of the source
+ * @param size number of bytes to copy. Source and destination may overlap.
+ * @note Source and destination data should not be locked while calling this function.
+ */
+void BaseVAlloc::moveRaw(VPtrNum dest, VPtrNum src, VPtrSize size)
+{
+    VIRTMEM_LOCK_CACHE();
+    if (!size || dest == src)
+        return;
+
+    finishAsync(); // pages should not be loaded while the pool changes
+
+    // make sure that the memory pool contains the latest source data
+    for (VirtPageIndex i=bigPages.freeIndex; i!=-1; i=bigPages.pages[i].next)
+    {
+        LockPage *page = &bigPages.pages[i];
+        if (page->start != 0 && page->start < (src + size) && (page->start + page->size) > src)
+            syncBigPage(page);
+    }
+    if (getVictimCacheSize())
+        syncVictimRange(src, size, false);
+
+    // the pool of an unused page is used as buffer
+    uint8_t *buf = bigPages.pages[getUnusedBigPage()].pool;
+
+    // cached destination data is outdated
+    discardRange(dest, size);
+    if (getVictimCacheSize())
+        syncVictimRange(dest, size, true);
+
+    // copy backwards if the end of the source would be overwritten before it's read
+    const bool backwards = (dest > src && dest < (src + size));
+    for (VPtrSize done=0; done<size; )
+    {
+        const VPtrSize n = private_utils::minimal(size - done, (VPtrSize)bigPages.size);
+        const VPtrSize i = (backwards) ? (size - done - n) : done;
+        readPool(buf, src + i, n);
+        writePool(buf, dest + i, n);
+        done += n;
+    }
+
+    // update pages which partially overlap the destination (they may still contain other modified data)
+    for (VirtPageIndex i=bigPages.freeIndex; i!=-1; i=bigPages.pages[i].next)
+    {
+        LockPage *page = &bigPages.pages[i];
+        if (page->start != 0 && page->start < (dest + size) && (page->start + page->size) > dest)
+        {
+            const VPtrNum start = private_utils::maximal(page->start, dest);
+            const VPtrNum end = private_utils::minimal(page->start + page->size, dest + size);
+            unpublishFrame(page);
+            readPool(page->pool + (start - page->start), start, end - start);
+        }
+    }
+
+#ifdef VIRTMEM_TRACE_STATS
+    bytesRead += size;
+    bytesWritten += size;
+#endif
+}
+
+/**
+ * @brief Starts loading data into the page cache ahead of use.
+ *
+ * The *big* pages containing the given range are loaded in unused or clean pages. If the allocator supports
+ * asynchronous I/O (see \ref doReadAsync()), this function returns before the data is read, so that loading
+ * overlaps with other work of the application. Pages that are already cached are skipped, and modified pages
+ * are never swapped out for prefetching.
+ * @param p Start of the memory range.
+ * @param size Size of the memory range. At most eight pages are loaded at once.
+ * @note Page misses (including accesses of data that is still being loaded) wait until all prefetched
+ * pages are loaded.
+ * @sa VAlloc::prefetch, VPtr::prefetch
+ */
+void BaseVAlloc::prefetch(VPtrNum p, VPtrSize size)
+{
+    VIRTMEM_LOCK_CACHE();
+    if (!p || !size)
+        return;
+
+    VPtrNum targets[READ_AHEAD_MAX_DEPTH];
+    VirtPageSize tsizes[READ_AHEAD_MAX_DEPTH];
+    uint8_t tcount = 0;
+    const VPtrNum end = private_utils::minimal(p + size, poolSize);
+    for (VPtrNum t=p; t<end && tcount<READ_AHEAD_MAX_DEPTH; )
+    {
+        VirtPageSize tsize = bigPages.size;
+        if (bigPageGrid)
+        {
+            t = getBigGridStart(t);
+            tsize = getBigGridSize(t);
+        }
+
+        if (!isBigRangeCached(t, tsize) && !isBigRangeLoading(t, tsize) &&
+            (!getVictimCacheSize() || findVictimPage(t, private_utils::minimal(poolSize - t, (VPtrSize)tsize)) == -1))
+        {
+            targets[tcount] = t;
+            tsizes[tcount] = tsize;
+            ++tcount;
+        }
+        t += tsize;
+    }
+
+    VirtPageIndex frames[READ_AHEAD_MAX_DEPTH];
+    tcount = findLoadFrames(frames, targets, tsizes, tcount, -1);
+    loadPages(frames, targets, tsizes, tcount, true);
+}
+
+/**
+ * @brief Returns whether a memory range can be accessed without I/O.
+ *
+ * This is the case if the whole range is in a cached *big* page, i.e. \ref read() and \ref write() do not
+ * have to swap pages. Pages that are still being loaded (see \ref prefetch()) are not resident yet.
+ * @param p Start of the memory range.
+ * @param size Size of the memory range.
+ * @sa VTaskScheduler
+ */
+bool BaseVAlloc::isResident(VPtrNum p, VPtrSize size)
+{
+    VIRTMEM_LOCK_CACHE();
+    return findIndexedPage(&bigPages, p, size) != -1;
+}
+
+// Removes the part of a modified range that overlaps with [start, end) (relative to the page), if possible
+void BaseVAlloc::clipDirtyRange(VirtPageSize &dstart, VirtPageSize &dend, VPtrSize start, VPtrSize end)
+{
+    if (start <= dstart && dend <= end)
+        dstart = dend = 0;
+    else if (start <= dstart && dstart < end)
+        dstart = end;
+    else if (start < dend && dend <= end)
+        dend = start;
+    // else the discarded range is in the middle, keep everything
+}
+
+/**
+ * @fn BaseVAlloc::discardRange
+ * @brief Drops cached data of a memory range without writing it.
+ *
+ * Unlocked *big* pages (and victim cache entries) that are fully inside the given range are removed, while
+ * partially overlapping pages only forget about modifications inside the range (if @ref VIRTMEM_DIRTY_RANGES is
+ * defined, otherwise they are kept). This function is useful
+ * when a large block of memory is freed whose contents are not needed anymore (see VArena).
+ * @param p Start of the memory range.
+ * @param size Size of the memory range.
+ * @note The data in the range is undefined afterwards. Locked data is not affected.
+ */
+void BaseVAlloc::discardRange(VPtrNum p, VPtrSize size)
+{
+    VIRTMEM_LOCK_CACHE();
+    const VPtrNum end = p + size;
+
+    for (VirtPageIndex i=bigPages.freeIndex; i!=-1; i=bigPages.pages[i].next)
+    {
+        LockPage *page = &bigPages.pages[i];
+        if (page->start == 0 || page->start >= end || (page->start + page->size) <= p)
+            continue;
+
+        if (page->start >= p && (page->start + page->size) <= end)
+        {
+            unindexPage(&bigPages, i);
+            page->start = 0;
+            page->dirty = false;
+        }
+#ifdef VIRTMEM_DIRTY_RANGES
+        else if (page->dirty)
+        {
+            clipDirtyRange(page->dirtyStart, page->dirtyEnd, (p > page->start) ? (p - page->start) : 0,
+                           private_utils::minimal(end - page->start, (VPtrSize)page->size));
+            page->dirty = (page->dirtyStart < page->dirtyEnd);
+        }
+#endif
+    }
+
+#ifdef VIRTMEM_VICTIM_CACHE
+    for (VirtPageIndex k=0, i=victimTail; k<victimUsed; ++k)
+    {
+        VictimPage *vpage = &victimPages[i];
+        if (vpage->start != 0 && vpage->start < end && (vpage->start + vpage->size) > p)
+        {
+            if (vpage->start >= p && (vpage->start + vpage->size) <= end)
+                vpage->start = 0;
+            else if (vpage->dirtyStart < vpage->dirtyEnd)
+            {
+                clipDirtyRange(vpage->dirtyStart, vpage->dirtyEnd, (p > vpage->start) ? (p - vpage->start) : 0,
+                               private_utils::minimal(end - vpage->start, (VPtrSize)vpage->size));
+            }
+        }
+        if (++i == victimPageCount)
+            i = 0;
+    }
+#endif
 }
 
 /**
  * @fn BaseVAlloc::getFreeBigPages
  * @return number of *big* pages that are not used and are not locked.
  */
-uint8_t BaseVAlloc::getFreeBigPages() const
+VirtPageIndex BaseVAlloc::getFreeBigPages() const
 {
-    uint8_t ret = 0;
+    VIRTMEM_LOCK_CACHE();
+    VirtPageIndex ret = 0;
 
-    for (int8_t i=bigPages.freeIndex; i!=-1; i=bigPages.pages[i].next)
+    for (VirtPageIndex i=bigPages.freeIndex; i!=-1; i=bigPages.pages[i].next)
     {
         if (bigPages.pages[i].start == 0)
             ++ret;
@@ -865,10 +3457,11 @@ uint8_t BaseVAlloc::getFreeBigPages() const
 // @cond HIDDEN_SYMBOLS
 void *BaseVAlloc::makeDataLock(VPtrNum ptr, VirtPageSize size, bool ro)
 {
+    VIRTMEM_LOCK_CACHE();
     ASSERT(ptr != 0);
     ASSERT(size <= bigPages.size);
 
-    PageInfo *pinfo, *secpinfo = 0;
+    PageInfo *pinfo;
     if (size <= smallPages.size)
         pinfo = &smallPages;
     else if (size <= mediumPages.size)
@@ -879,99 +3472,81 @@ void *BaseVAlloc::makeDataLock(VPtrNum ptr, VirtPageSize size, bool ro)
 //    std::cout << "request lock: " << ptr << "/" << size << "/" << pinfo->size << std::endl;
 
     PageInfo *plist[3] = { &smallPages, &mediumPages, &bigPages };
-    int8_t pageindex = -1, oldlockindex = -1, secoldlockindex = -1;
-    bool fixbeginningoverlap = false, done = false, shrunk = false;
-    for (uint8_t pindex=0; pindex<3 && !done; ++pindex)
+    VirtPageIndex pageindex = -1, oldlockindex = -1;
+    bool fixbeginningoverlap = false, shrunk = false;
+    // NOTE: locks are sorted, so the search ends as soon as the requested data is shrunk
+    for (VirtPageIndex l=findLockOverlap(ptr); l<lockIntervalCount && getLockInterval(l)->start < (ptr + size);)
     {
-        for (int8_t i=plist[pindex]->lockedIndex; i!=-1;)
+        LockPage *page = getLockInterval(l);
+        PageInfo *lpinfo = getPageInfo(page);
+        const VirtPageIndex i = page - lpinfo->pages;
+
+        // already there?
+        if (page->start == ptr)
         {
-            // already there?
-            if (plist[pindex]->pages[i].start == ptr)
+            if (pinfo != lpinfo)
             {
-                if (pinfo != plist[pindex])
+                if (page->locks == 0)
                 {
-                    if (plist[pindex]->pages[i].locks == 0)
-                    {
-                        // lock was previously created with different size, remove it
-                        i = freeLockedPage(plist[pindex], i);
-                        continue;
-                    }
-                    else // still locked, using a different, presumably larger, page size
-                    {
-//                        ASSERT(plist[pindex]->size > pinfo->size);
-                        // size smaller than asked?
-                        // this may happen if lock was resized and put in smaller page
-                        if (plist[pindex]->size < pinfo->size)
-                            size = private_utils::minimal(size, plist[pindex]->size);
+                    // lock was previously created with different size, remove it
+                    freeLockedPage(lpinfo, i);
+                    continue;
+                }
+                else // still locked, using a different, presumably larger, page size
+                {
+//                    ASSERT(lpinfo->size > pinfo->size);
+                    // size smaller than asked?
+                    // this may happen if lock was resized and put in smaller page
+                    if (lpinfo->size < pinfo->size)
+                        size = private_utils::minimal(size, lpinfo->size);
 
-                        pinfo = plist[pindex];
-//                        std::cout << "use secondary locked page\n";
+                    pinfo = lpinfo;
+//                    std::cout << "use secondary locked page\n";
 
-                        // ...fallthrough...
-                    }
+                    // ...fallthrough...
                 }
-                else if (plist[pindex]->pages[i].size > size) // requested size smaller than page?
-                {
-                    ASSERT(plist[pindex]->pages[i].locks == 0);
-                    // write excess data
+            }
+            else if (page->size > size) // requested size smaller than page?
+            {
+                ASSERT(page->locks == 0);
+                // write excess data
 #if 1
-                    saveRawData(plist[pindex]->pages[i].pool + size, plist[pindex]->pages[i].start + size,
-                                plist[pindex]->pages[i].size - size);
+                saveRawData(page->pool + size, page->start + size, page->size - size);
 #else
-                    pushRawData(plist[pindex]->pages[i].start + size, plist[pindex]->pages[i].pool + size,
-                                plist[pindex]->pages[i].size - size);
+                pushRawData(page->start + size, page->pool + size, page->size - size);
 #endif
-                    plist[pindex]->pages[i].size = size; // shrink page
-                    // NOTE: we don't have to check for overlap since we only shrunk the page
-                }
+                page->size = size; // shrink page
+                // NOTE: we don't have to check for overlap since we only shrunk the page
+            }
 
-                pageindex = i;
-                if (plist[pindex]->pages[i].size == size)
+            pageindex = i;
+            if (page->size == size)
+                break; // we're finished searching, no need to look for overlapping pages as size is already OK
+        }
+        else
+        {
+            const bool endoverlaps = (ptr < page->start && (ptr + size) > page->start);
+            const bool beginoverlaps = (ptr > page->start && ptr < (page->start + page->size));
+
+            if (page->locks)
+            {
+                if (endoverlaps)
                 {
-                    done = true;
-                    break; // we're finished searching, no need to look for overlapping pages as size is already OK
+                    size = page->start - ptr; // Shrink so it fits
+                    shrunk = true;
                 }
+                else if (beginoverlaps)
+                    fixbeginningoverlap = true;
             }
-            else
+            else if (endoverlaps || beginoverlaps)
             {
-                const bool endoverlaps = (ptr < plist[pindex]->pages[i].start && (ptr + size) > plist[pindex]->pages[i].start);
-                const bool beginoverlaps = (ptr > plist[pindex]->pages[i].start && ptr < (plist[pindex]->pages[i].start + plist[pindex]->pages[i].size));
-
-                if (plist[pindex]->pages[i].locks)
-                {
-                    if (endoverlaps)
-                    {
-                        size = plist[pindex]->pages[i].start - ptr; // Shrink so it fits
-                        shrunk = true;
-                    }
-                    else if (beginoverlaps)
-                        fixbeginningoverlap = true;
-                }
-                else
-                {
-                    if (endoverlaps || beginoverlaps)
-                    {
-                        // don't bother with unused pages. It is possible that they are never be used again, meaning they will always be in the way
-                        i = freeLockedPage(plist[pindex], i);
-                        continue;
-                    }
-
-                    if (oldlockindex == -1)
-                    {
-                        if (pinfo == plist[pindex])
-                            oldlockindex = i;
-                        else if (secoldlockindex == -1 && (pinfo->size < plist[pindex]->size))
-                        {
-                            // also keep record of bigger pages in case nothing is available in the preferred list
-                            secoldlockindex = i;
-                            secpinfo = plist[pindex];
-                        }
-                    }
-                }
+                // don't bother with unused pages. It is possible that they are never be used again, meaning they will always be in the way
+                freeLockedPage(lpinfo, i);
+                continue;
             }
-
-            i = plist[pindex]->pages[i].next;
         }
+
+        ++l;
     }
 
     ASSERT(pageindex == -1 || size >= pinfo->pages[pageindex].size);
@@ -992,7 +3567,7 @@ void *BaseVAlloc::makeDataLock(VPtrNum ptr, VirtPageSize size, bool ro)
                 pinfo = &smallPages;
             else
             {
-                const int8_t index = findUnusedLockedPage(&smallPages);
+                const VirtPageIndex index = findUnusedLockedPage(&smallPages);
                 if (index != -1)
                 {
                     pinfo = &smallPages;
@@ -1007,7 +3582,7 @@ void *BaseVAlloc::makeDataLock(VPtrNum ptr, VirtPageSize size, bool ro)
                 pinfo = &mediumPages;
             else
             {
-                const int8_t index = findUnusedLockedPage(&mediumPages);
+                const VirtPageIndex index = findUnusedLockedPage(&mediumPages);
                 if (index != -1)
                 {
                     pinfo = &mediumPages;
@@ -1030,6 +3605,9 @@ void *BaseVAlloc::makeDataLock(VPtrNum ptr, VirtPageSize size, bool ro)
     // make new or reuse old lock?
     if (pageindex == -1)
     {
+        if (pinfo->freeIndex == -1 && oldlockindex == -1)
+            oldlockindex = findUnusedLockedPage(pinfo);
+
         if (pinfo->freeIndex == -1 && oldlockindex == -1) // no space left in chosen page size?
         {
             // space left in bigger page?
@@ -1049,17 +3627,18 @@ void *BaseVAlloc::makeDataLock(VPtrNum ptr, VirtPageSize size, bool ro)
         }
         else
         {
-            if (oldlockindex == -1 && secoldlockindex != -1)
+            // also try unused pages of bigger page types in case nothing is available in the preferred list
+            for (uint8_t pindex=0; pindex<3 && oldlockindex == -1; ++pindex)
             {
-//                std::cout << "use secondary old page\n";
-                pinfo = secpinfo;
-                oldlockindex = secoldlockindex;
+                if (plist[pindex]->size > pinfo->size && (oldlockindex = findUnusedLockedPage(plist[pindex])) != -1)
+                    pinfo = plist[pindex];
             }
 
             if (oldlockindex != -1)
             {
                 syncLockedPage(&pinfo->pages[oldlockindex]);
                 pinfo->pages[oldlockindex].dirty = false;
+                moveLockInterval(&pinfo->pages[oldlockindex], ptr);
                 pageindex = oldlockindex;
             }
             else
@@ -1074,23 +3653,20 @@ void *BaseVAlloc::makeDataLock(VPtrNum ptr, VirtPageSize size, bool ro)
         {
             // check pages that overlap in the beginning and resize them if necessary
             // NOTE: we couldn't do this earlier since it was unknown which data is going to be used
-            for (uint8_t pindex=0; pindex<3; ++pindex)
+            for (VirtPageIndex l=findLockOverlap(ptr); l<lockIntervalCount && getLockInterval(l)->start < ptr; ++l)
             {
-                for (int8_t i=plist[pindex]->lockedIndex; i!=-1; i=plist[pindex]->pages[i].next)
+                LockPage *page = getLockInterval(l);
+                if (page != &pinfo->pages[pageindex] && ptr < (page->start + page->size))
                 {
-                    if ((i != pageindex || plist[pindex] != pinfo) && ptr > plist[pindex]->pages[i].start &&
-                        ptr < (plist[pindex]->pages[i].start + plist[pindex]->pages[i].size))
-                    {
-                        ASSERT(!fixed);
-
-                        // copy their overlapping data (assume this is the most up to date)
-                        const VPtrSize offsetold = ptr - plist[pindex]->pages[i].start;
-                        const VirtPageSize copysize = private_utils::minimal((VirtPageSize)(plist[pindex]->pages[i].size - offsetold), size);
-                        memcpy(pinfo->pages[pageindex].pool, (char *)plist[pindex]->pages[i].pool + offsetold, copysize);
-                        copyoffset = private_utils::maximal(copyoffset, copysize); // NOTE: take max, copyoffset might have been set earlier
-                        plist[pindex]->pages[i].size = offsetold; // shrink other so this one fits
-                        fixed = true;
-                    }
+                    ASSERT(!fixed);
+
+                    // copy their overlapping data (assume this is the most up to date)
+                    const VPtrSize offsetold = ptr - page->start;
+                    const VirtPageSize copysize = private_utils::minimal((VirtPageSize)(page->size - offsetold), size);
+                    memcpy(pinfo->pages[pageindex].pool, (char *)page->pool + offsetold, copysize);
+                    copyoffset = private_utils::maximal(copyoffset, copysize); // NOTE: take max, copyoffset might have been set earlier
+                    page->size = offsetold; // shrink other so this one fits
+                    fixed = true;
                 }
             }
         }
@@ -1105,8 +3681,6 @@ void *BaseVAlloc::makeDataLock(VPtrNum ptr, VirtPageSize size, bool ro)
             copyRawData(pinfo->pages[pageindex].pool + copyoffset, ptr + copyoffset, size - copyoffset);
 #endif
         }
-
-        pinfo->pages[pageindex].start = ptr;
     }
     else
     {
@@ -1131,11 +3705,11 @@ void *BaseVAlloc::makeDataLock(VPtrNum ptr, VirtPageSize size, bool ro)
     else
         printf("using existing page %d (%d) - free/used: %d/%d\n", pageindex, ptr, pinfo->freeIndex, pinfo->usedIndex);*/
 
-    if (!pinfo->pages[pageindex].dirty)
-        pinfo->pages[pageindex].dirty = !ro;
-
     ++pinfo->pages[pageindex].locks;
     pinfo->pages[pageindex].size = size;
+    invalidateTLB(); // the lock may cover big pages from the translation cache
+    if (!ro)
+        markDirty(&pinfo->pages[pageindex], 0, size); // data may be changed anywhere within the lock
 //    std::cout << "temp lock page: " << (int)pageindex << ", " << ptr << "/" << size << "/" << pinfo->size << std::endl;
     ASSERT(size <= pinfo->size);
     return pinfo->pages[pageindex].pool;
@@ -1145,49 +3719,46 @@ void *BaseVAlloc::makeDataLock(VPtrNum ptr, VirtPageSize size, bool ro)
 // Otherwise a new lock is created with an apropiate size to avoid overlap
 void *BaseVAlloc::makeFittingLock(VPtrNum ptr, VirtPageSize &size, bool ro)
 {
+    VIRTMEM_LOCK_CACHE();
     ASSERT(ptr != 0);
 
     size = private_utils::minimal(size, bigPages.size);
 
     PageInfo *plist[3] = { &smallPages, &mediumPages, &bigPages };
-    int8_t unusedlist[3] = { -1, -1, -1 };
-    int8_t plistindex = -1, pageindex = -1;
-    bool done = false;
-    for (uint8_t pindex=0; pindex<3 && !done; ++pindex)
+    VirtPageIndex unusedlist[3] = { -1, -1, -1 };
+    int8_t plistindex = -1;
+    VirtPageIndex pageindex = -1;
+    for (VirtPageIndex l=findLockOverlap(ptr); l<lockIntervalCount && getLockInterval(l)->start < (ptr + size);)
     {
-        for (int8_t i=plist[pindex]->lockedIndex; i!=-1;)
+        LockPage *page = getLockInterval(l);
+//        std::cout << "lock: " << (int)l << "/" << ptr << "/" << page->start << "/" << page->size << std::endl;
+        // lock within requested address?
+        if (ptr >= page->start && ptr < (page->start + page->size))
         {
-//            std::cout << "pindex: " << (int)pindex << "/" << (int)i << "/" << ptr << "/" << plist[pindex]->pages[i].start << "/" << plist[pindex]->pages[i].size << std::endl;
-            // lock within requested address?
-            if (ptr >= plist[pindex]->pages[i].start &&
-                ptr < (plist[pindex]->pages[i].start + plist[pindex]->pages[i].size))
-            {
-                plistindex = pindex;
-                pageindex = i;
-                done = true;
-                break;
-            }
+            const PageInfo *lpinfo = getPageInfo(page);
+            for (plistindex=0; plist[plistindex]!=lpinfo; ++plistindex)
+                ;
+            pageindex = page - lpinfo->pages;
+            break;
+        }
 
-            // end overlaps with this lock?
-            if (ptr < plist[pindex]->pages[i].start && (ptr + size) > plist[pindex]->pages[i].start)
+        // end overlaps with this lock?
+        if (ptr < page->start)
+        {
+            // remove unused locks
+            if (page->locks == 0)
             {
-                // remove unused locks
-                if (plist[pindex]->pages[i].locks == 0)
-                {
-                    // don't bother with unused pages. It is possible that they are never be used again, meaning they will always be in the way
-                    i = freeLockedPage(plist[pindex], i);
-                    continue;
-                }
-
-                // else shrink to avoid overlap
-                size = plist[pindex]->pages[i].start - ptr;
+                // don't bother with unused pages. It is possible that they are never be used again, meaning they will always be in the way
+                PageInfo *lpinfo = getPageInfo(page);
+                freeLockedPage(lpinfo, page - lpinfo->pages);
+                continue;
             }
 
-            if (plist[pindex]->pages[i].locks == 0 && unusedlist[pindex] == -1)
-                unusedlist[pindex] = i;
-
-            i = plist[pindex]->pages[i].next;
+            // else shrink to avoid overlap
+            size = page->start - ptr;
         }
+
+        ++l;
     }
 
     VPtrSize offset = 0;
@@ -1199,6 +3770,8 @@ void *BaseVAlloc::makeFittingLock(VPtrNum ptr, VirtPageSize &size, bool ro)
         int8_t secpli = -1;
         for (uint8_t i=0; i<3; ++i)
         {
+            if (plist[i]->freeIndex == -1)
+                unusedlist[i] = findUnusedLockedPage(plist[i]);
             if (plist[i]->freeIndex != -1 || unusedlist[i] != -1)
             {
                 if (size <= plist[i]->size)
@@ -1232,13 +3805,14 @@ void *BaseVAlloc::makeFittingLock(VPtrNum ptr, VirtPageSize &size, bool ro)
             pageindex = unusedlist[plistindex];
             syncLockedPage(&plist[plistindex]->pages[pageindex]);
             plist[plistindex]->pages[pageindex].dirty = false;
+            moveLockInterval(&plist[plistindex]->pages[pageindex], ptr);
         }
 
         if (syncpool)
             copyRawData(plist[plistindex]->pages[pageindex].pool, ptr, size);
 
-        plist[plistindex]->pages[pageindex].start = ptr;
         plist[plistindex]->pages[pageindex].size = size;
+        invalidateTLB(); // the lock may cover big pages from the translation cache
     }
     else
     {
@@ -1253,8 +3827,8 @@ void *BaseVAlloc::makeFittingLock(VPtrNum ptr, VirtPageSize &size, bool ro)
     // else add to lock count
     ++plist[plistindex]->pages[pageindex].locks;
 
-    if (!plist[plistindex]->pages[pageindex].dirty)
-        plist[plistindex]->pages[pageindex].dirty = !ro;
+    if (!ro)
+        markDirty(&plist[plistindex]->pages[pageindex], offset, size); // data may be changed anywhere within the lock
 
 //    std::cout << "fitting lock page: " << (int)pageindex << "/" << ptr << "/" << size << "/" << (int)plistindex << "/" << (int)plist[plistindex]->pages[pageindex].locks << std::endl;
 
@@ -1263,6 +3837,7 @@ void *BaseVAlloc::makeFittingLock(VPtrNum ptr, VirtPageSize &size, bool ro)
 
 void BaseVAlloc::releaseLock(VPtrNum ptr)
 {
+    VIRTMEM_LOCK_CACHE();
     LockPage *page = findLockedPage(ptr);
     ASSERT(page && page->locks);
 //    std::cout << "temp unlock page: " << (int)ptr << "/" << (int)page->locks << std::endl;
@@ -1270,9 +3845,8 @@ void BaseVAlloc::releaseLock(VPtrNum ptr)
     if (!page->locks)
     {
         // was it a big page? free it so that it can be re-used for non locked IO
-        const int8_t index = findLockedPage(&bigPages, ptr);
-        if (index != -1)
-            freeLockedPage(&bigPages, index);
+        if (getPageInfo(page) == &bigPages)
+            freeLockedPage(&bigPages, page - bigPages.pages);
     }
 }
 
@@ -1280,15 +3854,15 @@ void BaseVAlloc::printStats()
 {
 #ifdef PRINTF_STATS
     printf("------ Memory manager stats ------\n\n");
-    printf("Pool: free_pos = %u (%u bytes left)\n\n", poolFreePos, poolSize - poolFreePos);
+    printf("Pool: free_pos = %lu (%lu bytes left)\n\n", (unsigned long)poolFreePos, (unsigned long)(poolSize - poolFreePos));
 
-    VPtrNum p = START_OFFSET + sizeof(UMemHeader);
+    VPtrNum p = getDataStart() + sizeof(UMemHeader);
     while (p < poolFreePos)
     {
-        const UMemHeader *h = getHeaderConst(p);
-        printf("  * Addr: %8u; Size: %8u\n", p, h->s.size);
-        p += (h->s.size * sizeof(UMemHeader));
-        if (!h->s.size || h->s.next < p)
+        const UMemHeader h = getHeader(p);
+        printf("  * Addr: %8lu; Size: %8lu\n", (unsigned long)p, (unsigned long)h.s.size);
+        p += (h.s.size * sizeof(UMemHeader));
+        if (!h.s.size || h.s.next < p)
             break;
     }
 
@@ -1300,10 +3874,10 @@ void BaseVAlloc::printStats()
 
         while (1)
         {
-            const UMemHeader *h = getHeaderConst(p);
-            printf("  * Addr: %8u; Size: %8u; Next: %8u\n", p, h->s.size, h->s.next);
+            const UMemHeader h = getHeader(p);
+            printf("  * Addr: %8lu; Size: %8lu; Next: %8lu\n", (unsigned long)p, (unsigned long)h.s.size, (unsigned long)h.s.next);
 
-            p = h->s.next;
+            p = h.s.next;
 
             if (p == freePointer)
                 break;
@@ -0,0 +1,102 @@
+#include "internal/codec.h"
+
+#include <string.h>
+
+namespace virtmem {
+
+namespace private_utils {
+
+/* Encoding: a header byte h is followed by either
+ * - h + 1 literal bytes (0 <= h < 128)
+ * - a single byte which is repeated 257 - h times (128 < h <= 255)
+ */
+
+enum
+{
+    RLE_MAX_RUN = 128,
+    RLE_MIN_REPEAT = 3 // shorter repeats are stored as literals
+};
+
+uint32_t rleCompress(const uint8_t *src, uint32_t size, uint8_t *dest)
+{
+    uint32_t ret = 0, litstart = 0;
+
+    for (uint32_t i=0; i<=size; )
+    {
+        uint32_t rep = 1;
+        if (i < size)
+        {
+            while ((i + rep) < size && rep < RLE_MAX_RUN && src[i + rep] == src[i])
+                ++rep;
+        }
+
+        // flush pending literals before a repeated run, at the end or when the run is full
+        uint32_t litsize = i - litstart;
+        if (litsize && (rep >= RLE_MIN_REPEAT || i == size || litsize == RLE_MAX_RUN))
+        {
+            if (dest)
+            {
+                dest[ret] = (uint8_t)(litsize - 1);
+                memcpy(&dest[ret + 1], &src[litstart], litsize);
+            }
+            ret += litsize + 1;
+            litstart = i;
+        }
+
+        if (i == size)
+            break;
+
+        if (rep >= RLE_MIN_REPEAT)
+        {
+            if (dest)
+            {
+                dest[ret] = (uint8_t)(257 - rep);
+                dest[ret + 1] = src[i];
+            }
+            ret += 2;
+            i += rep;
+            litstart = i;
+        }
+        else
+            ++i;
+    }
+
+    return ret;
+}
+
+void RLEDecoder::read(uint8_t *dest, uint32_t size)
+{
+    while (size)
+    {
+        if (!left)
+        {
+            const uint8_t h = *src++;
+            repeat = (h > 128);
+            left = (repeat) ? (257 - h) : (h + 1);
+        }
+
+        const uint8_t n = (size < left) ? size : left;
+        if (repeat)
+        {
+            if (dest)
+                memset(dest, *src, n);
+            if (n == left)
+                ++src; // skip repeated byte
+        }
+        else
+        {
+            if (dest)
+                memcpy(dest, src, n);
+            src += n;
+        }
+
+        if (dest)
+            dest += n;
+        left -= n;
+        size -= n;
+    }
+}
+
+}
+
+}
@@ -13,8 +13,19 @@
 #undef VIRTMEM_WRAP_CPOINTERS
 #undef VIRTMEM_VIRT_ADDRESS_OPERATOR
 #undef VIRTMEM_TRACE_STATS
+#undef VIRTMEM_VPTR_64BIT
 #undef VIRTMEM_CPP11
 #undef VIRTMEM_EXPLICIT
+#undef VIRTMEM_THREAD_SAFE
+#undef VIRTMEM_COROUTINES
+#undef VIRTMEM_PAGE_POLICIES
+#undef VIRTMEM_READ_AHEAD
+#undef VIRTMEM_DIRTY_RANGES
+#undef VIRTMEM_PAGE_TLB
+#undef VIRTMEM_VICTIM_CACHE
+#undef VIRTMEM_ZERO_FILL
+#undef VIRTMEM_SIZE_CLASSES
+#undef VIRTMEM_BUDDY_ALLOC
 #endif
 
 /**
@@ -46,6 +57,37 @@
   */
 //#define VIRTMEM_TRACE_STATS
 
+/**
+  * @def VIRTMEM_VPTR_64BIT
+  * @brief If defined, raw virtual addresses and sizes (virtmem::VPtrNum and virtmem::VPtrSize)
+  * are 64 bit wide, which allows memory pools larger than 4 GB.
+  *
+  * This increases the size of virtual pointers and memory block headers, and is therefore
+  * disabled by default. Note that all code using virtmem should be compiled with the same setting.
+  */
+//#define VIRTMEM_VPTR_64BIT
+
+/**
+  * @def VIRTMEM_THREAD_SAFE
+  * @brief If defined, allocators can be used by multiple threads at once (requires C++11).
+  *
+  * The page cache and the allocation state (free list, size classes and buddy tree) are guarded by separate
+  * locks, so for instance allocations served from RAM (size classes and the buddy engine) do not wait for page
+  * swaps of other threads. Locked data (e.g. through virtmem::VPtrLock or member access of virtual pointers)
+  * stays valid until it is released, and can be used without locking the allocator. Plain reads and writes
+  * through virtual pointers copy data while the page cache is locked, except for reads of clean *big* pages,
+  * which are done without locking (see virtmem::BaseVAlloc::read()). The page cache can be split in shards with
+  * their own lock (see @ref DefaultAllocProperties::cacheShards), so that accesses of cached data only wait for
+  * threads using the same shard.
+  *
+  * Like \ref VIRTMEM_VPTR_64BIT, all code using virtmem should be compiled with the same setting.
+  * @note Pointers returned by virtmem::BaseVAlloc::read() may be invalidated by any other thread, use the copying
+  * overload or a lock instead.
+  * @note Locks of all threads share the same small, medium and big pages, so the page counts of the allocator
+  * should be large enough for the locks that may exist at the same time.
+  */
+//#define VIRTMEM_THREAD_SAFE
+
 /**
   * @brief The default poolsize for allocators supporting a variable sized pool.
   *
@@ -62,6 +104,98 @@
 #define VIRTMEM_CPP11
 #endif
 
+/**
+  * @def VIRTMEM_COROUTINES
+  * @brief Enabled if C++20 coroutines are supported, which are required by virtmem::VTaskScheduler.
+  */
+#if __cplusplus >= 202002L && defined(__cpp_impl_coroutine) && !defined(ARDUINO)
+#define VIRTMEM_COROUTINES
+#endif
+
+/**
+  * @def VIRTMEM_LARGE_PAGES
+  * @brief If defined, wider types are used for page indices and page sizes (see VirtPageIndex and VirtPageSize).
+  *
+  * This allows up to 32767 pages per page type and pages larger than 64 kB, at the cost of some extra
+  * RAM per page. This changes the layout of the allocator, so like \ref VIRTMEM_VPTR_64BIT it is disabled by
+  * default and all code using virtmem should be compiled with the same setting.
+  */
+//#define VIRTMEM_LARGE_PAGES
+
+/**
+  * @def VIRTMEM_PAGE_POLICIES
+  * @brief If defined, the replacement policy of *big* pages can be selected (see
+  * DefaultAllocProperties::bigPagePolicy). Otherwise only PAGE_POLICY_FIFO is available.
+  *
+  * The other policies keep track of page accesses, which takes some extra RAM per *big* page. This changes the
+  * layout of the allocator, so all code using virtmem should be compiled with the same setting.
+  */
+//#define VIRTMEM_PAGE_POLICIES
+
+/**
+  * @def VIRTMEM_READ_AHEAD
+  * @brief If defined, strided accesses of *big* pages are detected and the next pages are read ahead (see
+  * BaseVAlloc::setReadAhead). Pages can still be prefetched explicitly when this is not defined.
+  *
+  * This changes the layout of the allocator, so all code using virtmem should be compiled with the same setting.
+  */
+//#define VIRTMEM_READ_AHEAD
+
+/**
+  * @def VIRTMEM_DIRTY_RANGES
+  * @brief If defined, the modified range of each *big* page is tracked, and only that range is written back.
+  * Otherwise modified pages are written completely.
+  *
+  * This takes some extra RAM per *big* page, and changes the layout of the allocator, so all code using virtmem
+  * should be compiled with the same setting.
+  */
+//#define VIRTMEM_DIRTY_RANGES
+
+/**
+  * @def VIRTMEM_PAGE_TLB
+  * @brief If defined, BaseVAlloc::read() and BaseVAlloc::write() first look up recently used *big* pages in a
+  * small translation cache, which speeds up repeated accesses of resident data.
+  *
+  * This takes some extra RAM, and changes the layout of the allocator, so all code using virtmem should be
+  * compiled with the same setting.
+  */
+//#define VIRTMEM_PAGE_TLB
+
+/**
+  * @def VIRTMEM_VICTIM_CACHE
+  * @brief If defined, swapped out *big* pages can be kept in a compressed RAM buffer (see
+  * DefaultAllocProperties::victimCacheSize).
+  *
+  * This changes the layout of the allocator, so all code using virtmem should be compiled with the same setting.
+  */
+//#define VIRTMEM_VICTIM_CACHE
+
+/**
+  * @def VIRTMEM_ZERO_FILL
+  * @brief If defined, untouched parts of the memory pool can be zero filled lazily (see
+  * DefaultAllocProperties::zeroFillRegions).
+  *
+  * This changes the layout of the allocator, so all code using virtmem should be compiled with the same setting.
+  */
+//#define VIRTMEM_ZERO_FILL
+
+/**
+  * @def VIRTMEM_SIZE_CLASSES
+  * @brief If defined, freed blocks of small sizes can be kept in RAM for reuse (see
+  * DefaultAllocProperties::sizeClassCount).
+  *
+  * This changes the layout of the allocator, so all code using virtmem should be compiled with the same setting.
+  */
+//#define VIRTMEM_SIZE_CLASSES
+
+/**
+  * @def VIRTMEM_BUDDY_ALLOC
+  * @brief If defined, allocators can use the buddy engine (see DefaultAllocProperties::allocEngine).
+  *
+  * This changes the layout of the allocator, so all code using virtmem should be compiled with the same setting.
+  */
+//#define VIRTMEM_BUDDY_ALLOC
+
 /**
   * @def VIRTMEM_EXPLICIT
   * @brief Used for explicit conversion operators.
@@ -71,6 +205,19 @@
   */
 #define VIRTMEM_EXPLICIT explicit
 
+/**
+  * @def VIRTMEM_THREAD_LOCAL
+  * @brief Storage class of the current allocator instance of allocators with multiple instances
+  * (see DefaultAllocProperties::multiInstance).
+  *
+  * With C++11 every thread has its own current instance, otherwise there is one for the whole program.
+  */
+#if defined(VIRTMEM_CPP11) && !defined(ARDUINO)
+#define VIRTMEM_THREAD_LOCAL thread_local
+#else
+#define VIRTMEM_THREAD_LOCAL
+#endif
+
 #if defined(CORE_TEENSY) && defined(__arm__)
 
 /**
@@ -105,6 +252,33 @@ typedef uint32_t pintype_t;
 typedef uint8_t pintype_t;
 #endif
 
+/**
+ * @brief Replacement policies for *big* memory pages.
+ *
+ * The policy decides which big memory page is swapped out when data that is not yet loaded is
+ * accessed. It can be set with the optional `bigPagePolicy` member of the allocator properties.
+ * @sa DefaultAllocProperties::bigPagePolicy
+ */
+enum PagePolicy
+{
+    PAGE_POLICY_FIFO, //!< Prefers unused and clean pages, otherwise swaps pages in a FIFO way (default).
+    PAGE_POLICY_LRU, //!< Swaps the least recently used page.
+    PAGE_POLICY_CLOCK, //!< Second chance (CLOCK) replacement: cheap approximation of LRU.
+    PAGE_POLICY_2Q //!< Scan resistant: pages only become 'hot' when they are used again later or shortly after being swapped out.
+};
+
+/**
+ * @brief Engines used to manage allocated memory blocks.
+ *
+ * The engine can be set with the optional `allocEngine` member of the allocator properties.
+ * @sa DefaultAllocProperties::allocEngine
+ */
+enum AllocEngine
+{
+    ALLOC_ENGINE_FREELIST, //!< First fit free list, stored in virtual memory (default).
+    ALLOC_ENGINE_BUDDY //!< Binary buddy allocator: blocks are powers of two, and are managed by a tree stored in RAM.
+};
+
 // Default virtual memory page settings
 // NOTE: Take care of sufficiently large int types when increasing these values
 
@@ -167,7 +341,8 @@ struct DefaultAllocProperties
   * @brief This struct contains default parameters for virtual memory pages.
   *
   * The fields in this struct define the amount- and size of the *small*, *medium* and *big*
-  * memory pages for an allocator. The former two memory pages are only used for locking data.
+  * memory pages for an allocator. The amount of each page type must fit in VirtPageIndex and
+  * the page sizes in VirtPageSize, which is checked at compile time (see @ref VIRTMEM_LARGE_PAGES). The former two memory pages are only used for locking data.
   * In general it is best to make sure that they are big enough to contain any structs/classes
   * stored in virtual memory. The *big* memory pages are also used for data locking, but more importantly, they are used
   * as a cache for virtual memory access (see [basics](@ref basics)).
@@ -214,6 +389,68 @@ SDVAllocP<AllocProperties> alloc;
   * @brief The size of a *medium* page. @hideinitializer
   * @var DefaultAllocProperties::bigPageSize
   * @brief The size of a *big* page. @hideinitializer
+  *
+  * The following properties are optional and may be omitted from customized structures, in which
+  * case the default value is used.
+  *
+  * @var DefaultAllocProperties::bigPageGrid
+  * @brief If `true`, *big* pages used for regular access start at multiples of `bigPageSize`, which
+  * must be a power of two. This avoids overlapping pages and speeds up page lookups. Data crossing
+  * a page boundary is still loaded into a separate page. Default: `false`. @hideinitializer
+  * @var DefaultAllocProperties::bigPagePolicy
+  * @brief The replacement policy used for *big* pages, see PagePolicy. Policies other than PAGE_POLICY_FIFO
+  * require @ref VIRTMEM_PAGE_POLICIES. Default: PAGE_POLICY_FIFO. @hideinitializer
+  * @var DefaultAllocProperties::victimCacheSize
+  * @brief Size (in bytes) of a RAM buffer that keeps swapped out *big* pages in a compressed form. Data
+  * that is accessed again is then restored without reading it from the memory pool, and modified pages are
+  * only written when they are removed from this buffer (or by BaseVAlloc::flush()). Cached pages are only
+  * restored if a page with the same start is requested again, hence this is mainly useful in combination with
+  * @ref DefaultAllocProperties::bigPageGrid. Requires @ref VIRTMEM_VICTIM_CACHE. Default: `0` (disabled).
+  * @hideinitializer
+  * @var DefaultAllocProperties::zeroFillRegions
+  * @brief Enables lazy zero filling of the memory pool by dividing it in this amount of regions. Regions that were
+  * not written since \ref BaseVAlloc::start() are read as zeros without accessing the memory pool, hence the pool
+  * does not have to be cleared during initialization. One bit of RAM is used per region. Requires
+  * @ref VIRTMEM_ZERO_FILL. Default: `0` (disabled). @hideinitializer
+  * @var DefaultAllocProperties::sizeClassCount
+  * @brief Amount of size classes for which freed memory blocks are kept in RAM, so they can be reused by
+  * BaseVAlloc::allocRaw() without searching the free list stored in virtual memory. Each class is as large as a
+  * block header (8 or 16 bytes, depending on the platform), hence blocks up to `sizeClassCount` times this size
+  * are covered. Requires @ref VIRTMEM_SIZE_CLASSES. Default: `0` (disabled).
+  * @hideinitializer
+  * @var DefaultAllocProperties::sizeClassDepth
+  * @brief The maximum amount of free blocks kept per size class (see @ref DefaultAllocProperties::sizeClassCount).
+  * Each block uses `sizeof(VPtrNum)` bytes of RAM. Default: `8`. @hideinitializer
+  * @var DefaultAllocProperties::sizeClassTrackCount
+  * @brief The amount of recently allocated blocks of the size classes (see
+  * @ref DefaultAllocProperties::sizeClassCount) whose size is remembered in RAM (a power of two, or zero). Freeing
+  * such a block with BaseVAlloc::freeRaw() does not read its header from virtual memory. Each entry uses
+  * `sizeof(VPtrNum) + 1` bytes of RAM. Default: `32`. @hideinitializer
+  * @var DefaultAllocProperties::allocEngine
+  * @brief The engine used to manage memory blocks, see AllocEngine. The buddy engine allocates and frees blocks
+  * in O(log n) time, without accessing virtual memory, but wastes memory by rounding blocks up to a power of two.
+  * Its blocks are aligned to their size, hence they never cross a *big* page boundary if they fit in a page (and
+  * @ref DefaultAllocProperties::bigPageGrid is used). The buddy engine does not support size classes and persistent
+  * pools (see BaseVAlloc::setPersistent()). The buddy engine requires @ref VIRTMEM_BUDDY_ALLOC.
+  * Default: ALLOC_ENGINE_FREELIST. @hideinitializer
+  * @var DefaultAllocProperties::buddyMinSize
+  * @brief The size of the smallest block of the buddy engine (a power of two). Default: `32`. @hideinitializer
+  * @var DefaultAllocProperties::buddyBlockCount
+  * @brief The maximum amount of smallest blocks managed by the buddy engine (a power of two). Memory beyond
+  * `buddyBlockCount * buddyMinSize` bytes is not used. The buddy tree uses two bytes of RAM per block.
+  * Default: `1024`. @hideinitializer
+  * @var DefaultAllocProperties::multiInstance
+  * @brief If `true`, multiple instances of the allocator may exist, for instance one per thread so that each thread
+  * has its own memory pool and page cache. Virtual pointers then refer to the *current* instance of the calling
+  * thread, which is the first instance created by that thread, or set by VAlloc::makeCurrent() or VAllocScope.
+  * Virtual pointers should only be used while the instance they were allocated from is current. Default: `false`
+  * (the allocator is a singleton, see VAlloc::getInstance()). @hideinitializer
+  * @var DefaultAllocProperties::cacheShards
+  * @brief The amount of shards of the *big* page cache (a power of two, at most 8), each with its own lock and
+  * replacement state. Grid page `n` (see @ref DefaultAllocProperties::bigPageGrid, which is required) belongs to shard
+  * `n % cacheShards`, and is only cached in the *big* pages of its shard, which `bigPageCount` should divide. Reads
+  * and writes within a cached grid page only lock its shard, other accesses (e.g. page misses that read ahead,
+  * locking data and allocations) lock all shards. Requires @ref VIRTMEM_THREAD_SAFE. Default: `1`. @hideinitializer
   */
 
 /**
@@ -240,6 +477,35 @@ SDVAllocP<AllocProperties> alloc;
 #ifndef VIRTMEM_TRACE_STATS
 #define VIRTMEM_TRACE_STATS
 #endif
+
+#ifndef VIRTMEM_COROUTINES
+#define VIRTMEM_COROUTINES
+#endif
+
+#ifndef VIRTMEM_PAGE_POLICIES
+#define VIRTMEM_PAGE_POLICIES
+#endif
+#ifndef VIRTMEM_READ_AHEAD
+#define VIRTMEM_READ_AHEAD
+#endif
+#ifndef VIRTMEM_DIRTY_RANGES
+#define VIRTMEM_DIRTY_RANGES
+#endif
+#ifndef VIRTMEM_PAGE_TLB
+#define VIRTMEM_PAGE_TLB
+#endif
+#ifndef VIRTMEM_VICTIM_CACHE
+#define VIRTMEM_VICTIM_CACHE
+#endif
+#ifndef VIRTMEM_ZERO_FILL
+#define VIRTMEM_ZERO_FILL
+#endif
+#ifndef VIRTMEM_SIZE_CLASSES
+#define VIRTMEM_SIZE_CLASSES
+#endif
+#ifndef VIRTMEM_BUDDY_ALLOC
+#define VIRTMEM_BUDDY_ALLOC
+#endif
 #endif
 
 #endif // CONFIG_H
@@ -0,0 +1,10 @@
+# Optional features (see config/config.h), shared by the library, tests and benchmark. These change the layout
+# of the allocator classes, so all code using the library should be built with the same features.
+DEFINES += VIRTMEM_PAGE_POLICIES
+DEFINES += VIRTMEM_READ_AHEAD
+DEFINES += VIRTMEM_DIRTY_RANGES
+DEFINES += VIRTMEM_PAGE_TLB
+DEFINES += VIRTMEM_VICTIM_CACHE
+DEFINES += VIRTMEM_ZERO_FILL
+DEFINES += VIRTMEM_SIZE_CLASSES
+DEFINES += VIRTMEM_BUDDY_ALLOC
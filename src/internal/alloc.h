@@ -8,11 +8,33 @@
 
 #include "base_alloc.h"
 #include "config/config.h"
+#include "utils.h"
 #include "vptr.h"
 
 namespace virtmem {
 
 template <typename, typename> class VPtr;
+#ifdef VIRTMEM_COROUTINES
+template <typename, typename> class VReadAwaiter;
+#endif
+
+namespace private_utils {
+
+// Optional allocator properties, see DefaultAllocProperties
+VIRTMEM_OPTIONAL_PROPERTY(bigPagePolicy, uint8_t, PAGE_POLICY_FIFO);
+VIRTMEM_OPTIONAL_PROPERTY(bigPageGrid, bool, false);
+VIRTMEM_OPTIONAL_PROPERTY(victimCacheSize, uint32_t, 0);
+VIRTMEM_OPTIONAL_PROPERTY(zeroFillRegions, uint32_t, 0);
+VIRTMEM_OPTIONAL_PROPERTY(sizeClassCount, uint8_t, 0);
+VIRTMEM_OPTIONAL_PROPERTY(sizeClassDepth, uint8_t, 8);
+VIRTMEM_OPTIONAL_PROPERTY(sizeClassTrackCount, uint16_t, 32);
+VIRTMEM_OPTIONAL_PROPERTY(allocEngine, uint8_t, ALLOC_ENGINE_FREELIST);
+VIRTMEM_OPTIONAL_PROPERTY(buddyMinSize, uint32_t, 32);
+VIRTMEM_OPTIONAL_PROPERTY(buddyBlockCount, uint32_t, 1024);
+VIRTMEM_OPTIONAL_PROPERTY(multiInstance, bool, false);
+VIRTMEM_OPTIONAL_PROPERTY(cacheShards, uint8_t, 1);
+
+}
 
 /**
  * @brief Base template class for virtual memory allocators.
@@ -23,6 +45,7 @@ template <typename, typename> class VPtr;
  *
  * @tparam Properties Allocator properties, see DefaultAllocProperties
  * @tparam Derived Dummy parameter, used to create unique singleton instances for each derived class.
+ * @sa DefaultAllocProperties::multiInstance
  */
 template <typename Properties, typename Derived>
 class VAlloc : public BaseVAlloc
@@ -30,6 +53,92 @@ class VAlloc : public BaseVAlloc
     LockPage smallPagesData[Properties::smallPageCount];
     LockPage mediumPagesData[Properties::mediumPageCount];
     LockPage bigPagesData[Properties::bigPageCount];
+    // keep the page index at most half full
+    VirtPageIndex bigPageIndex[private_utils::NextPowerOf2<Properties::bigPageCount * 2>::value];
+    VirtPageIndex lockIntervalData[Properties::smallPageCount + Properties::mediumPageCount + Properties::bigPageCount];
+    VIRTMEM_STATIC_ASSERT(((VirtPageIndex)-1 < 0), "VirtPageIndex must be signed");
+    VIRTMEM_STATIC_ASSERT(Properties::smallPageCount > 0 && Properties::mediumPageCount > 0 && Properties::bigPageCount > 0,
+                          "at least one page of each type is required");
+    VIRTMEM_STATIC_ASSERT((private_utils::FitsInType<VirtPageIndex, Properties::smallPageCount>::value &&
+                           private_utils::FitsInType<VirtPageIndex, Properties::mediumPageCount>::value &&
+                           private_utils::FitsInType<VirtPageIndex, Properties::bigPageCount>::value),
+                          "page count too large for VirtPageIndex (see VIRTMEM_LARGE_PAGES)");
+    VIRTMEM_STATIC_ASSERT((private_utils::FitsInType<VirtPageIndex, Properties::smallPageCount + Properties::mediumPageCount +
+                                                                    Properties::bigPageCount>::value),
+                          "total page count too large for VirtPageIndex (see VIRTMEM_LARGE_PAGES)");
+    VIRTMEM_STATIC_ASSERT((private_utils::FitsInType<VirtPageSize, Properties::smallPageSize>::value &&
+                           private_utils::FitsInType<VirtPageSize, Properties::mediumPageSize>::value &&
+                           private_utils::FitsInType<VirtPageSize, Properties::bigPageSize>::value),
+                          "page size too large for VirtPageSize (see VIRTMEM_LARGE_PAGES)");
+
+    enum { bigPagePolicy = private_utils::bigPagePolicyProperty<Properties>::value };
+#ifndef VIRTMEM_PAGE_POLICIES
+    VIRTMEM_STATIC_ASSERT(bigPagePolicy == (int)PAGE_POLICY_FIFO, "bigPagePolicy requires VIRTMEM_PAGE_POLICIES");
+#endif
+    enum { bigPageGrid = private_utils::bigPageGridProperty<Properties>::value };
+    VIRTMEM_STATIC_ASSERT(!bigPageGrid || (private_utils::IsPowerOf2<Properties::bigPageSize>::value &&
+                                           Properties::bigPageSize > sizeof(TAlign)),
+                          "bigPageGrid requires a power of two bigPageSize larger than the alignment size");
+    enum { cacheShards = private_utils::cacheShardsProperty<Properties>::value };
+    VIRTMEM_STATIC_ASSERT(cacheShards == 1 || (bigPageGrid && private_utils::IsPowerOf2<cacheShards>::value &&
+                                               cacheShards <= (int)MAX_CACHE_SHARDS && (Properties::bigPageCount % cacheShards) == 0),
+                          "cacheShards should be a power of two (at most 8) that divides bigPageCount, and requires bigPageGrid");
+#ifdef VIRTMEM_THREAD_SAFE
+    CacheShard cacheShardData[cacheShards];
+#else
+    VIRTMEM_STATIC_ASSERT(cacheShards == 1, "cacheShards requires VIRTMEM_THREAD_SAFE");
+#endif
+#ifdef VIRTMEM_PAGE_POLICIES
+    enum { shardGhostCount = (bigPagePolicy == (int)PAGE_POLICY_2Q) ? (Properties::bigPageCount / 2 / cacheShards + 1) : 1 };
+    VPtrNum bigPageGhosts[(int)shardGhostCount * (int)cacheShards];
+#endif
+
+    enum { victimCacheSize = private_utils::victimCacheSizeProperty<Properties>::value };
+#ifdef VIRTMEM_VICTIM_CACHE
+    // victim cache entries: enough for an average compression ratio of 4
+    enum { victimPageCount = (victimCacheSize > 0) ? (victimCacheSize * 4 / Properties::bigPageSize + 1) : 1 };
+    VIRTMEM_STATIC_ASSERT((private_utils::FitsInType<VirtPageIndex, victimPageCount>::value),
+                          "victimCacheSize too large for VirtPageIndex (see VIRTMEM_LARGE_PAGES)");
+    uint8_t victimPool[(victimCacheSize > 0) ? victimCacheSize : 1];
+    VictimPage victimPagesData[victimPageCount];
+#else
+    VIRTMEM_STATIC_ASSERT(victimCacheSize == 0, "victimCacheSize requires VIRTMEM_VICTIM_CACHE");
+#endif
+    enum { zeroFillRegions = private_utils::zeroFillRegionsProperty<Properties>::value };
+#ifdef VIRTMEM_ZERO_FILL
+    uint8_t touchedRegionData[(zeroFillRegions > 0) ? ((zeroFillRegions + 7) / 8) : 1];
+#else
+    VIRTMEM_STATIC_ASSERT(zeroFillRegions == 0, "zeroFillRegions requires VIRTMEM_ZERO_FILL");
+#endif
+    enum { allocEngine = private_utils::allocEngineProperty<Properties>::value };
+    enum { buddyMinSize = private_utils::buddyMinSizeProperty<Properties>::value };
+    enum { buddyBlockCount = private_utils::buddyBlockCountProperty<Properties>::value };
+    VIRTMEM_STATIC_ASSERT(allocEngine != (int)ALLOC_ENGINE_BUDDY || (private_utils::IsPowerOf2<buddyMinSize>::value &&
+                                                                 private_utils::IsPowerOf2<buddyBlockCount>::value &&
+                                                                 buddyMinSize >= sizeof(TAlign)),
+                          "buddyMinSize and buddyBlockCount should be powers of two, and buddyMinSize at least the alignment size");
+#ifdef VIRTMEM_BUDDY_ALLOC
+    uint8_t buddyTreeData[(allocEngine == (int)ALLOC_ENGINE_BUDDY) ? (buddyBlockCount * 2) : 1];
+#else
+    VIRTMEM_STATIC_ASSERT(allocEngine == (int)ALLOC_ENGINE_FREELIST, "ALLOC_ENGINE_BUDDY requires VIRTMEM_BUDDY_ALLOC");
+#endif
+    // NOTE: size classes are not used by the buddy engine
+    enum { sizeClassCount = (allocEngine == (int)ALLOC_ENGINE_BUDDY) ? 0 : private_utils::sizeClassCountProperty<Properties>::value };
+    enum { sizeClassDepth = private_utils::sizeClassDepthProperty<Properties>::value };
+    enum { sizeClassTrackCount = (sizeClassCount > 0) ? private_utils::sizeClassTrackCountProperty<Properties>::value : 0 };
+#ifdef VIRTMEM_SIZE_CLASSES
+    VIRTMEM_STATIC_ASSERT(sizeClassTrackCount == 0 || private_utils::IsPowerOf2<sizeClassTrackCount>::value,
+                          "sizeClassTrackCount should be a power of two");
+    VPtrNum sizeClassBlocks[(sizeClassCount > 0) ? ((int)sizeClassCount * (int)sizeClassDepth) : 1];
+    uint8_t sizeClassUsed[(sizeClassCount > 0) ? sizeClassCount : 1];
+    VPtrNum sizeClassTrackedBlocks[(sizeClassTrackCount > 0) ? sizeClassTrackCount : 1];
+    uint8_t sizeClassTrackedClasses[(sizeClassTrackCount > 0) ? sizeClassTrackCount : 1];
+#else
+    VIRTMEM_STATIC_ASSERT(sizeClassCount == 0, "sizeClassCount requires VIRTMEM_SIZE_CLASSES");
+#endif
+#ifdef VIRTMEM_THREAD_SAFE
+    FrameVersion frameVersionData[Properties::bigPageCount];
+#endif
 #ifdef NVALGRIND
     uint8_t smallPagePool[Properties::smallPageCount * Properties::smallPageSize] __attribute__ ((aligned (sizeof(TAlign))));
     uint8_t mediumPagePool[Properties::mediumPageCount * Properties::mediumPageSize] __attribute__ ((aligned (sizeof(TAlign))));
@@ -39,27 +148,71 @@ class VAlloc : public BaseVAlloc
     uint8_t mediumPagePool[Properties::mediumPageCount * (Properties::mediumPageSize + valgrindPad * 2)];
     uint8_t bigPagePool[Properties::bigPageCount * (Properties::bigPageSize + valgrindPad * 2)];
 #endif
+    enum { multiInstance = private_utils::multiInstanceProperty<Properties>::value };
     static VAlloc *instance;
+    static VIRTMEM_THREAD_LOCAL VAlloc *currentInstance; // multiInstance only
 
 protected:
     VAlloc(void)
     {
-        ASSERT(!instance);
-        instance = this;
+        if (!multiInstance)
+        {
+            ASSERT(!instance);
+            instance = this;
+        }
+        else if (!currentInstance)
+            currentInstance = this;
+#ifdef VIRTMEM_THREAD_SAFE
+        initCacheShards(cacheShardData, cacheShards);
+#endif
+#ifdef VIRTMEM_PAGE_POLICIES
+        initBigPagePolicy(bigPagePolicy, bigPageGhosts, shardGhostCount);
+#endif
+        initLockIntervals(lockIntervalData);
+#ifdef VIRTMEM_VICTIM_CACHE
+        if (victimCacheSize > 0)
+            initVictimCache(victimPool, victimCacheSize, victimPagesData, victimPageCount);
+#endif
+#ifdef VIRTMEM_ZERO_FILL
+        if (zeroFillRegions > 0)
+            initZeroFill(touchedRegionData, zeroFillRegions);
+#endif
+#ifdef VIRTMEM_SIZE_CLASSES
+        if (sizeClassCount > 0)
+            initSizeClasses(sizeClassBlocks, sizeClassUsed, sizeClassCount, sizeClassDepth, sizeClassTrackedBlocks,
+                            sizeClassTrackedClasses, sizeClassTrackCount);
+#endif
+#ifdef VIRTMEM_BUDDY_ALLOC
+        if (allocEngine == (int)ALLOC_ENGINE_BUDDY)
+            initBuddy(buddyTreeData, buddyBlockCount, buddyMinSize);
+#endif
+#ifdef VIRTMEM_THREAD_SAFE
+        initFrameVersions(frameVersionData, Properties::bigPageCount);
+#endif
 #ifdef NVALGRIND
         initSmallPages(smallPagesData, &smallPagePool[0], Properties::smallPageCount, Properties::smallPageSize);
         initMediumPages(mediumPagesData, &mediumPagePool[0], Properties::mediumPageCount, Properties::mediumPageSize);
-        initBigPages(bigPagesData, &bigPagePool[0], Properties::bigPageCount, Properties::bigPageSize);
+        initBigPages(bigPagesData, &bigPagePool[0], Properties::bigPageCount, Properties::bigPageSize,
+                     bigPageIndex, sizeof(bigPageIndex) / sizeof(VirtPageIndex));
+        initBigPageGrid(bigPageGrid);
 #else
         initSmallPages(smallPagesData, &smallPagePool[pad], Properties::smallPageCount, Properties::smallPageSize);
         initMediumPages(mediumPagesData, &mediumPagePool[pad], Properties::mediumPageCount, Properties::mediumPageSize);
-        initBigPages(bigPagesData, &bigPagePool[pad], Properties::bigPageCount, Properties::bigPageSize);
+        initBigPages(bigPagesData, &bigPagePool[pad], Properties::bigPageCount, Properties::bigPageSize,
+                     bigPageIndex, sizeof(bigPageIndex) / sizeof(VirtPageIndex));
+        initBigPageGrid(bigPageGrid);
         VALGRIND_MAKE_MEM_NOACCESS(&smallPagePool[0], pad); VALGRIND_MAKE_MEM_NOACCESS(&smallPagePool[Properties::smallPageCount * Properties::smallPageSize + pad], pad);
         VALGRIND_MAKE_MEM_NOACCESS(&mediumPagePool[0], pad); VALGRIND_MAKE_MEM_NOACCESS(&mediumPagePool[Properties::mediumPageCount * Properties::mediumPageSize + pad], pad);
         VALGRIND_MAKE_MEM_NOACCESS(&bigPagePool[0], pad); VALGRIND_MAKE_MEM_NOACCESS(&bigPagePool[Properties::bigPageCount * Properties::bigPageSize + pad], pad);
 #endif
     }
-    ~VAlloc(void) { instance = 0; }
+    ~VAlloc(void)
+    {
+        if (!multiInstance)
+            instance = 0;
+        else if (currentInstance == this)
+            currentInstance = 0;
+    }
 
 public:
     /**
@@ -75,8 +228,26 @@ public:
      * @endcode
      * In this case, `alloc1` and `alloc2` are variables with a *different* type, hence getInstance()
      * will return a different instance for both classes.
+     *
+     * If the `multiInstance` property is set, the current instance of the calling thread is returned instead.
+     * @sa DefaultAllocProperties::multiInstance, makeCurrent
+     */
+    static VAlloc *getInstance(void) { return (multiInstance) ? currentInstance : instance; }
+
+    /**
+     * @brief Sets the current instance of the calling thread, which is used by virtual pointers.
+     * @param alloc The new current instance (may be zero).
+     * @note Only available for allocators with the `multiInstance` property (see DefaultAllocProperties::multiInstance).
+     * @sa makeCurrent, VAllocScope
      */
-    static VAlloc *getInstance(void) { return instance; }
+    static void setCurrentInstance(VAlloc *alloc)
+    {
+        VIRTMEM_STATIC_ASSERT(multiInstance, "allocator does not have the multiInstance property");
+        currentInstance = alloc;
+    }
+
+    //! Makes this allocator the current instance of the calling thread, see \ref setCurrentInstance().
+    void makeCurrent(void) { setCurrentInstance(this); }
 
     // C style malloc/free
     /**
@@ -100,6 +271,88 @@ public:
         return ret;
     }
 
+    using BaseVAlloc::allocAligned;
+    using BaseVAlloc::allocNoStraddle;
+    using BaseVAlloc::allocNear;
+    using BaseVAlloc::prefetch;
+
+    /**
+     * @brief Allocates a block of virtual memory with an aligned starting address
+     * @param size the size of the block
+     * @param alignment the alignment, see BaseVAlloc::allocAligned
+     * @return virtual pointer to the block, which should be freed with \ref free.
+     * @sa alloc, allocNoStraddle, BaseVAlloc::allocAligned
+     */
+    template <typename T> VPtr<T, Derived> allocAligned(VPtrSize size, VPtrSize alignment)
+    {
+        virtmem::VPtr<T, Derived> ret;
+        ret.setRawNum(allocAligned(size, alignment));
+        return ret;
+    }
+
+    /**
+     * @brief Allocates a block of virtual memory that does not cross *big* page boundaries
+     * @param size the size of the block
+     * @return virtual pointer to the block, which should be freed with \ref free.
+     *
+     * Such blocks can always be accessed or locked as a whole, for instance to make frequently used
+     * data structures fit in a single page.
+     * @sa alloc, allocAligned, BaseVAlloc::allocNoStraddle
+     */
+    template <typename T> VPtr<T, Derived> allocNoStraddle(VPtrSize size=sizeof(T))
+    {
+        virtmem::VPtr<T, Derived> ret;
+        ret.setRawNum(allocNoStraddle(size));
+        return ret;
+    }
+
+    /**
+     * @brief Allocates a block of virtual memory close to an existing block
+     * @param hint virtual pointer to an allocated block, e.g. the previous node of a list
+     * @param size the size of the block
+     * @return virtual pointer to the block, which should be freed with \ref free.
+     * @sa alloc, BaseVAlloc::allocNear, VAllocGroup
+     */
+    template <typename T, typename T2> VPtr<T, Derived> allocNear(const VPtr<T2, Derived> &hint, VPtrSize size=sizeof(T))
+    {
+        virtmem::VPtr<T, Derived> ret;
+        ret.setRawNum(allocNear(hint.getRawNum(), size));
+        return ret;
+    }
+
+    /**
+     * @brief Starts loading data into the page cache ahead of use
+     * @param p virtual pointer to the data
+     * @param size the amount of bytes to load
+     * @sa BaseVAlloc::prefetch, VPtr::prefetch
+     */
+    template <typename T> void prefetch(const VPtr<T, Derived> &p, VPtrSize size=sizeof(T))
+    {
+#ifdef VIRTMEM_WRAP_CPOINTERS
+        if (p.isWrapped())
+            return;
+#endif
+        prefetch(p.getRawNum(), size);
+    }
+
+#ifdef VIRTMEM_COROUTINES
+    /**
+     * @brief Reads data from a coroutine, without blocking other tasks if the data is not resident.
+     *
+     * Example:
+     * @code{.cpp}
+     * const int *values = co_await sdvAlloc.readAsync(vptr, 4);
+     * @endcode
+     * @param p virtual pointer to the data
+     * @param count the number of elements to read
+     * @return Awaitable (VReadAwaiter) that results in a pointer to the data, valid until the allocator is used again.
+     * @note Only available with @ref VIRTMEM_COROUTINES.
+     * @sa VTask, VTaskScheduler, lockAsync
+     */
+    template <typename T> VReadAwaiter<T, Derived> readAsync(const VPtr<T, Derived> &p, VPtrSize count=1)
+    { return VReadAwaiter<T, Derived>(p, count); }
+#endif
+
     /**
      * @brief Frees a block of virtual memory
      * @param p virtual pointer that points to block to be freed
@@ -113,6 +366,79 @@ public:
         p.setRawNum(0);
     }
 
+    /**
+     * @brief Resizes a block of virtual memory
+     * @param p virtual pointer that points to the block to be resized (may be null)
+     * @param size the new size of the block
+     * @return virtual pointer to the resized block, which may be different from \a p.
+     *
+     * This function is the equivelant of the C `realloc` function. The block is resized in place if
+     * possible, otherwise its data is moved to a new block.
+     * @sa alloc, free, BaseVAlloc::reallocRaw
+     */
+    template <typename T> VPtr<T, Derived> realloc(const VPtr<T, Derived> &p, VPtrSize size)
+    {
+        virtmem::VPtr<T, Derived> ret;
+        ret.setRawNum(reallocRaw(p.getRawNum(), size));
+        return ret;
+    }
+
+    using BaseVAlloc::setRoot;
+    using BaseVAlloc::getRoot;
+
+    /**
+     * @brief Stores a virtual pointer as named root of a persistent pool.
+     * @sa BaseVAlloc::setRoot, BaseVAlloc::setPersistent
+     */
+    template <typename T> bool setRoot(const char *name, const VPtr<T, Derived> &p) { return setRoot(name, p.getRawNum()); }
+
+    /**
+     * @brief Returns a virtual pointer stored as named root of a persistent pool.
+     *
+     * Example:
+     * @code{.cpp}
+     * alloc.setPersistent(true);
+     * alloc.start();
+     * virtmem::VPtr<int, StdioVAlloc> data = alloc.getRoot<int>("data");
+     * if (!data) // new pool?
+     * {
+     *     data = alloc.alloc<int>(100 * sizeof(int));
+     *     alloc.setRoot("data", data);
+     * }
+     * @endcode
+     * @return The stored pointer, or a null pointer if the root does not exist.
+     * @sa BaseVAlloc::getRoot, BaseVAlloc::setPersistent
+     */
+    template <typename T> VPtr<T, Derived> getRoot(const char *name)
+    {
+        virtmem::VPtr<T, Derived> ret;
+        ret.setRawNum(getRoot(name));
+        return ret;
+    }
+
+    // \cond HIDDEN_SYMBOLS
+    // Constructs or destructs an object in place. In concurrent mode the data is locked while doing so,
+    // since other threads may swap pages at any time (see VIRTMEM_THREAD_SAFE).
+    template <typename T> void constructObject(VPtrNum p)
+    {
+#ifdef VIRTMEM_THREAD_SAFE
+        new (makeDataLock(p, sizeof(T))) T;
+        releaseLock(p);
+#else
+        new (read(p, sizeof(T))) T; // UNDONE: can this be ro?
+#endif
+    }
+    template <typename T> void destructObject(VPtrNum p)
+    {
+#ifdef VIRTMEM_THREAD_SAFE
+        static_cast<T *>(makeDataLock(p, sizeof(T)))->~T();
+        releaseLock(p);
+#else
+        static_cast<T *>(read(p, sizeof(T)))->~T();
+#endif
+    }
+    // \endcond
+
     // C++ style new/delete --> call constructors (by placement new) and destructors
     /**
      * @brief Allocates memory and constructs data type
@@ -129,8 +455,7 @@ public:
     template <typename T> VPtr<T, Derived> newClass(VPtrSize size=sizeof(T))
     {
         virtmem::VPtr<T, Derived> ret = alloc<T>(size);
-        T *ptr = static_cast<T *>(read(ret.getRawNum(), sizeof(T)));
-        new (ptr) T; // UNDONE: can this be ro?
+        constructObject<T>(ret.getRawNum());
         return ret;
     }
 
@@ -168,7 +493,7 @@ public:
         write(p, &elements, sizeof(VPtrSize));
         p += sizeof(VPtrSize);
         for (VPtrSize s=0; s<elements; ++s)
-            new (read(p + (s * sizeof(T)), sizeof(T))) T; // UNDONE: can this be ro?
+            constructObject<T>(p + (s * sizeof(T)));
 
         virtmem::VPtr<T, Derived> ret;
         ret.setRawNum(p);
@@ -186,12 +511,10 @@ public:
     template <typename T> void deleteArray(VPtr<T, Derived> &p)
     {
         const VPtrNum soffset = p.getRawNum() - sizeof(VPtrSize); // pointer to size offset
-        VPtrSize *size = static_cast<VPtrSize *>(read(soffset, sizeof(VPtrSize)));
-        for (VPtrSize s=0; s<*size; ++s)
-        {
-            T *ptr = static_cast<T *>(read(p.getRawNum() + (s * sizeof(T)), sizeof(T)));
-            ptr->~T();
-        }
+        VPtrSize size;
+        read(soffset, &size, sizeof(VPtrSize));
+        for (VPtrSize s=0; s<size; ++s)
+            destructObject<T>(p.getRawNum() + (s * sizeof(T)));
         freeRaw(soffset); // soffset points at beginning of actual block
     }
 
@@ -225,6 +548,40 @@ public:
 template <typename Properties, typename Derived>
 VAlloc<Properties, Derived> *VAlloc<Properties, Derived>::instance = 0;
 
+template <typename Properties, typename Derived>
+VIRTMEM_THREAD_LOCAL VAlloc<Properties, Derived> *VAlloc<Properties, Derived>::currentInstance = 0;
+
+/**
+ * @brief Makes an allocator the current instance of the calling thread until the end of a scope.
+ *
+ * The previous current instance is restored by the destructor. Example:
+ * @code{.cpp}
+ * struct ShardProperties : public virtmem::DefaultAllocProperties { static const bool multiInstance = true; };
+ * typedef virtmem::StdioVAllocP<ShardProperties> ShardAlloc;
+ *
+ * ShardAlloc shards[2];
+ * {
+ *     virtmem::VAllocScope<ShardAlloc> scope(shards[1]);
+ *     virtmem::VPtr<int, ShardAlloc> p = shards[1].alloc<int>(); // virtual pointers now refer to shards[1]
+ *     *p = 10;
+ * }
+ * @endcode
+ * @tparam Allocator Allocator class with the `multiInstance` property (see DefaultAllocProperties::multiInstance).
+ */
+template <typename Allocator>
+class VAllocScope
+{
+    Allocator *previous;
+
+    VAllocScope(const VAllocScope &);
+    VAllocScope &operator=(const VAllocScope &);
+
+public:
+    //! Makes the given allocator the current instance
+    VAllocScope(Allocator &alloc) : previous(static_cast<Allocator *>(Allocator::getInstance())) { alloc.makeCurrent(); }
+    ~VAllocScope(void) { Allocator::setCurrentInstance(previous); } //!< Restores the previous current instance
+};
+
 }
 
 #endif // VIRTMEM_ALLOC_H
@@ -16,11 +16,30 @@
 
 #include <stdint.h>
 
+#ifdef VIRTMEM_THREAD_SAFE
+#ifndef VIRTMEM_CPP11
+#error "VIRTMEM_THREAD_SAFE requires C++11"
+#endif
+#include <atomic>
+#include <mutex>
+#endif
+
 namespace virtmem {
 
-typedef uint32_t VPtrNum; //!< Numeric type used to store raw virtual pointer addresses
-typedef uint32_t VPtrSize; //!< Numeric type used to store the size of a virtual memory block
-typedef uint16_t VirtPageSize; //!< Numeric type used to store the size of a virtual memory page
+#ifdef VIRTMEM_VPTR_64BIT
+typedef uint64_t VPtrNum; //!< Numeric type used to store raw virtual pointer addresses
+typedef uint64_t VPtrSize; //!< Numeric type used to store the size of a virtual memory block
+#else
+typedef uint32_t VPtrNum;
+typedef uint32_t VPtrSize;
+#endif
+#ifdef VIRTMEM_LARGE_PAGES
+typedef uint32_t VirtPageSize; //!< Numeric type used to store the size of a virtual memory page
+typedef int16_t VirtPageIndex; //!< Signed numeric type used to store page indices and -amounts (-1: no page)
+#else
+typedef uint16_t VirtPageSize;
+typedef int8_t VirtPageIndex;
+#endif
 
 /**
  * @brief Base class for virtual memory allocators.
@@ -42,6 +61,15 @@ private:
     enum
     {
         PAGE_MAX_CLEAN_SKIPS = 5, // if page is dirty: max tries for finding another clean page when swapping
+        READ_AHEAD_MAX_DEPTH = 8, // maximum amount of pages that are read ahead at once
+        READ_AHEAD_MAX_STRIDE = 16, // maximum distance (in pages) between page misses of a stream
+        PAGE_TLB_SIZE = 8, // entries of the big page translation cache (power of two)
+        VICTIM_WRITE_CHUNK = 64, // buffer size used to decompress dirty victim pages when they are written
+        ZERO_WRITE_CHUNK = 64, // buffer size used to pad untouched regions with zeros
+        SUPERBLOCK_MAGIC = 0x42534d56, // "VMSB"
+        SUPERBLOCK_VERSION = 1,
+        ROOT_COUNT = 8, // named roots stored in the superblock
+        ROOT_NAME_SIZE = 16, // including terminating zero
         START_OFFSET = sizeof(TAlign), // don't start at zero so we can have NULL pointers
         BASE_INDEX = 1, // Special pointer to baseFreeList, not actually stored in file
         MIN_ALLOC_SIZE = 16
@@ -64,6 +92,15 @@ protected:
 #endif
 
     // \cond HIDDEN_SYMBOLS
+    enum PageFlags
+    {
+        PAGE_LOCKED = 1 << 0, // big page is in locked list
+        PAGE_REFERENCED = 1 << 1, // CLOCK policy: accessed since the clock hand passed
+        PAGE_HOT = 1 << 2, // 2Q policy: page is in the hot (Am) queue
+        PAGE_PREFETCHED = 1 << 3, // page was read ahead and not accessed yet
+        PAGE_LOADING = 1 << 4 // big page is read asynchronously, it's neither in the free list nor in the page index
+    };
+
     struct LockPage
     {
         VPtrNum start;
@@ -71,19 +108,88 @@ protected:
         uint8_t *pool;
         uint8_t locks, cleanSkips;
         bool dirty;
-        int8_t next;
+        uint8_t flags; // see PageFlags
+#ifdef VIRTMEM_DIRTY_RANGES
+        VirtPageSize dirtyStart, dirtyEnd; // modified range (relative to start) if dirty
+#endif
+#ifdef VIRTMEM_PAGE_POLICIES
+        uint32_t lastUse; // used by replacement policies
+#endif
+        VirtPageIndex next;
+        VirtPageIndex indexNext; // next page in the same page index bucket (loading: see loadPages())
 
-        LockPage(void) : start(0), size(0), pool(0), locks(0), cleanSkips(0), dirty(false), next(-1) { }
+        LockPage(void) : start(0), size(0), pool(0), locks(0), cleanSkips(0), dirty(false), flags(0),
+#ifdef VIRTMEM_DIRTY_RANGES
+            dirtyStart(0), dirtyEnd(0),
+#endif
+#ifdef VIRTMEM_PAGE_POLICIES
+            lastUse(0),
+#endif
+            next(-1), indexNext(-1) { }
     };
+
+#ifdef VIRTMEM_VICTIM_CACHE
+    // Swapped out big page, stored (compressed) in the victim cache
+    struct VictimPage
+    {
+        VPtrNum start; // 0 if dropped
+        VPtrSize offset; // position in victim pool
+        VirtPageSize size, csize; // csize == size: stored uncompressed
+        VirtPageSize dirtyStart, dirtyEnd; // modified range that still needs to be written, empty if clean
+    };
+#endif
+
+#ifdef VIRTMEM_THREAD_SAFE
+    // Published state of a big page for optimistic (lock free) readers, see readOptimistic()
+    struct FrameVersion
+    {
+        std::atomic<uint32_t> version; // odd: frame may change, readers should take the cache lock
+        std::atomic<VPtrNum> start, end; // range of the frame while the version is even
+    };
+#endif
+
+    // Part of the big page cache: big page i belongs to shard i % shards, and only holds pages with a page number
+    // (start / page size) in the same shard. Only used in concurrent mode, otherwise there is a single shard.
+    struct CacheShard
+    {
+        VirtPageIndex nextPageToSwap; // FIFO policy
+#ifdef VIRTMEM_PAGE_POLICIES
+        VirtPageIndex clockHand; // CLOCK policy
+        VirtPageIndex nextPageGhost; // 2Q policy
+        uint32_t pageClock; // LRU and 2Q policies
+#endif
+#ifdef VIRTMEM_THREAD_SAFE
+        std::recursive_mutex mutex;
+#endif
+    };
+
+    enum { MAX_CACHE_SHARDS = 8 }; // shards should not share entries of the translation cache (PAGE_TLB_SIZE)
     // \endcond
 
 private:
+    // Allocator state stored at the start of persistent pools, followed by the named roots
+    struct Superblock
+    {
+        uint32_t magic;
+        uint8_t version, ptrSize, headerSize, rootCount;
+        VPtrSize poolSize;
+        VPtrNum freePointer, freeListNext, poolFreePos;
+    };
+
+    struct RootEntry
+    {
+        VPtrNum ptr; // 0 if unused
+        char name[ROOT_NAME_SIZE];
+    };
+
     struct PageInfo
     {
         LockPage *pages;
         VirtPageSize size;
-        uint8_t count;
-        int8_t freeIndex, lockedIndex;
+        VirtPageIndex count;
+        VirtPageIndex freeIndex, lockedIndex;
+        VirtPageIndex *index; // hash buckets (keyed by page number) of unlocked pages in use, may be 0
+        uint32_t indexMask;
     };
 
     // Stuff configured from VAlloc
@@ -93,42 +199,371 @@ private:
     UMemHeader baseFreeList;
     VPtrNum freePointer;
     VPtrNum poolFreePos;
-    int8_t nextPageToSwap;
+
+    // Grid aligned big pages
+    bool bigPageGrid;
+    uint8_t bigPageShift;
+    VirtPageIndex unalignedBigPages; // indexed big pages that are not on the grid
+
+    // Locked pages of all types, sorted by their start address. Small, medium and big pages are numbered
+    // consecutively (see getLockInterval())
+    VirtPageIndex *lockIntervals;
+    VirtPageIndex lockIntervalCount;
+
+    // Big page replacement
+#ifdef VIRTMEM_PAGE_POLICIES
+    uint8_t bigPagePolicy;
+    VPtrNum *pageGhosts; // 2Q: page numbers (+1) of pages recently swapped out from the cold queue
+    VirtPageIndex pageGhostCount; // per cache shard
+#endif
+#ifndef VIRTMEM_THREAD_SAFE
+    CacheShard cacheShard;
+#endif
+
+#ifdef VIRTMEM_PAGE_TLB
+    // Translation cache of read()/write(): maps page numbers to big pages without locks in their range
+    struct TLBEntry
+    {
+        VirtPageIndex page;
+        uint8_t generation; // valid if equal to tlbGeneration, 0: unused
+    };
+    TLBEntry pageTLB[PAGE_TLB_SIZE];
+    uint8_t tlbGeneration;
+#endif
+#if defined(VIRTMEM_PAGE_TLB) || defined(VIRTMEM_THREAD_SAFE)
+    uint8_t tlbShift; // log2 of the big page size, maps page numbers to TLB entries and frame hints
+#endif
+
+#ifdef VIRTMEM_VICTIM_CACHE
+    // Victim cache: ring buffer of swapped out big pages
+    uint8_t *victimPool;
+    VPtrSize victimPoolSize, victimHead;
+    VictimPage *victimPages;
+    VirtPageIndex victimPageCount, victimTail, victimUsed;
+#endif
+
+#ifdef VIRTMEM_ZERO_FILL
+    // Lazy zero fill: bitmap of pool regions written since start(), other regions read as zeros without I/O
+    uint8_t *touchedRegions;
+    VPtrSize touchedRegionCount, touchedRegionSize;
+    bool poolZeroed; // unwritten data in the memory pool already reads as zeros
+#endif
+
+    // Persistent pools
+    bool persistent, restored;
+
+#ifdef VIRTMEM_SIZE_CLASSES
+    // Size class free lists: stacks of freed blocks kept in RAM, class i contains blocks of i + 2 headers
+    VPtrNum *classBlocks;
+    uint8_t *classUsed;
+    uint8_t classCount, classDepth;
+    // Size classes of recently allocated blocks (hashed by address), so freeing them doesn't read their header
+    VPtrNum *trackedBlocks;
+    uint8_t *trackedClasses;
+    uint16_t trackedBlockCount;
+#endif
+
+#ifdef VIRTMEM_BUDDY_ALLOC
+    // Buddy engine: complete binary tree of blocks (root: 0, children of i: 2i+1 and 2i+2), each node contains
+    // the order of the largest free block in its subtree plus one (zero: allocated or completely used)
+    uint8_t *buddyTree;
+    uint32_t buddyMaxBlocks;
+    VPtrSize buddyMinSize;
+    uint8_t buddyLevels; // order of the root
+#endif
+
+#ifdef VIRTMEM_THREAD_SAFE
+    // NOTE: locks are taken in this order: allocMutex, cache shards (ascending), victimMutex, poolMutex
+    std::recursive_mutex allocMutex; // free list, size classes, buddy tree
+    CacheShard *cacheShards;
+    uint8_t shardMask; // shards - 1
+#ifdef VIRTMEM_VICTIM_CACHE
+    std::mutex victimMutex; // victim cache, if used while only a single shard is locked
+#endif
+    std::mutex poolMutex; // readPool() and writePool(), including the zero fill bitmap
+
+    // Scoped lock of a single cache shard or, if shard is -1, of all shards. Structures that are shared by the shards
+    // (e.g. the free list, locks and asynchronous I/O) are only changed while all shards are locked.
+    class CacheGuard
+    {
+        CacheShard *first, *last;
+
+    public:
+        CacheGuard(const BaseVAlloc *alloc, int shard=-1) :
+            first(&alloc->cacheShards[(shard == -1) ? 0 : shard]), last(&alloc->cacheShards[(shard == -1) ? alloc->shardMask : shard])
+        { for (CacheShard *s=first; s<=last; ++s) s->mutex.lock(); }
+        CacheGuard(const BaseVAlloc *alloc, VPtrNum p, VPtrSize size);
+        ~CacheGuard(void) { for (CacheShard *s=last; s>=first; --s) s->mutex.unlock(); }
+    };
+
+    // Seqlock of each big page: clean, unlocked big pages are published so read() can copy their data
+    // without locking, as long as the version did not change while copying
+    FrameVersion *frameVersions;
+    std::atomic<VirtPageIndex> frameHints[PAGE_TLB_SIZE]; // published big page for each TLB entry
+#endif
+
+#ifdef VIRTMEM_READ_AHEAD
+    bool readAheadEnabled;
+    uint8_t readAheadDepth;
+    VPtrNum readAheadPage; // page number of the last page miss (or prefetched page hit)
+    int32_t readAheadStride;
+#endif
+
+    // Asynchronous I/O started by prefetch() and flush(), completed by finishAsync()
+    VirtPageIndex asyncReads; // pages being loaded
+    uint16_t asyncWrites;
 
 #ifdef VIRTMEM_TRACE_STATS
+#ifdef VIRTMEM_THREAD_SAFE
+    typedef std::atomic<uint32_t> TStatCounter; // updated by threads that lock different cache shards
+#else
+    typedef uint32_t TStatCounter;
+#endif
     VPtrSize memUsed, maxMemUsed;
-    uint32_t bigPageReads, bigPageWrites, bytesRead, bytesWritten;
+    TStatCounter bigPageReads, bigPageWrites, bigPageHits, bytesRead, bytesWritten;
+    TStatCounter bigPagePrefetches, usefulPrefetches, wastedPrefetches;
+#ifdef VIRTMEM_VICTIM_CACHE
+    TStatCounter victimHits, victimMisses, victimRawBytes, victimStoredBytes;
+#endif
+#ifdef VIRTMEM_ZERO_FILL
+    TStatCounter zeroFilledBytes;
+#endif
+#ifdef VIRTMEM_SIZE_CLASSES
+    TStatCounter classAllocHits, classAllocMisses;
+#endif
 #endif
 
-    void initPages(PageInfo *info, LockPage *pages, uint8_t *pool, uint8_t pcount, VirtPageSize psize);
+    void initPages(PageInfo *info, LockPage *pages, uint8_t *pool, VirtPageIndex pcount, VirtPageSize psize);
+    void clearPageIndex(PageInfo *pinfo);
+    void indexPage(PageInfo *pinfo, VirtPageIndex index);
+    void unindexPage(PageInfo *pinfo, VirtPageIndex index);
+    VirtPageIndex findIndexedPageStart(const PageInfo *pinfo, VPtrNum start, VPtrNum end) const;
+    VirtPageIndex findIndexedPage(const PageInfo *pinfo, VPtrNum p, VPtrSize size=1) const;
     VPtrNum getMem(VPtrSize size);
+    VPtrNum allocBlock(VPtrSize quantity);
+    VPtrNum allocFromList(VPtrSize quantity);
+    VPtrNum placeBlock(VPtrNum ptr, VPtrSize offset, VPtrSize quantity);
+    void shrinkBlock(VPtrNum hdrptr, UMemHeader *header, VPtrSize quantity);
+    VPtrNum findFreeBlockBefore(VPtrNum hdrptr);
+    bool growBlock(VPtrNum hdrptr, UMemHeader *header, VPtrSize quantity);
+    void freeBlock(VPtrNum hdrptr, UMemHeader *header);
+#ifdef VIRTMEM_SIZE_CLASSES
+    bool drainSizeClasses(void);
+    uint16_t getTrackedBlockSlot(VPtrNum ptr) const { return (ptr / sizeof(UMemHeader)) & (trackedBlockCount - 1); }
+    void trackClassBlock(VPtrNum ptr, uint8_t sclass);
+    uint8_t untrackClassBlock(VPtrNum ptr);
+#else
+    bool drainSizeClasses(void) { return false; }
+#endif
+#ifdef VIRTMEM_BUDDY_ALLOC
+    VPtrSize getBuddySize(uint8_t order) const { return buddyMinSize << order; }
+    void resetBuddyTree(void);
+    void reserveBuddyRange(uint32_t node, uint8_t order, VPtrNum start, VPtrNum rstart, VPtrNum rend);
+    void updateBuddyParents(uint32_t node, uint8_t order);
+    uint32_t findBuddyNode(VPtrNum ptr, uint8_t &order) const;
+    VPtrNum allocBuddy(VPtrSize size);
+    void freeBuddy(VPtrNum ptr);
+    VPtrNum reallocBuddy(VPtrNum ptr, VPtrSize size);
+#endif
+    VPtrNum getDataStart(void) const;
+    VPtrNum getRootEntry(uint8_t index) const { return START_OFFSET + sizeof(Superblock) + index * sizeof(RootEntry); }
+    int8_t findRoot(const char *name);
+    bool loadSuperblock(void);
+    void saveSuperblock(void);
+    void markDirty(LockPage *page, VPtrSize offset, VPtrSize size);
+#ifdef VIRTMEM_DIRTY_RANGES
+    static VirtPageSize getDirtyStart(const LockPage *page) { return page->dirtyStart; }
+    static VirtPageSize getDirtyEnd(const LockPage *page) { return page->dirtyEnd; }
+#else
+    static VirtPageSize getDirtyStart(const LockPage *) { return 0; }
+    static VirtPageSize getDirtyEnd(const LockPage *page) { return page->size; }
+#endif
+    VirtPageIndex getUnusedBigPage(void);
+    static void clipDirtyRange(VirtPageSize &dstart, VirtPageSize &dend, VPtrSize start, VPtrSize end);
     void syncBigPage(LockPage *page);
+    VirtPageIndex findFlushNext(VirtPageIndex index) const;
     void copyRawData(void *dest, VPtrNum p, VPtrSize size);
     void saveRawData(void *src, VPtrNum p, VPtrSize size);
     void *pullRawData(VPtrNum p, VPtrSize size, bool readonly, bool forcestart);
     void pushRawData(VPtrNum p, const void *d, VPtrSize size);
     const UMemHeader *getHeaderConst(VPtrNum p);
+    UMemHeader getHeader(VPtrNum p);
     void updateHeader(VPtrNum p, UMemHeader *h);
-    int8_t findFreePage(PageInfo *pinfo, VPtrNum p, VPtrSize size, bool atstart);
-    int8_t findUnusedLockedPage(PageInfo *pinfo);
+    VirtPageIndex findFreePage(PageInfo *pinfo, VPtrNum p, VPtrSize size, bool atstart);
+#ifdef VIRTMEM_PAGE_TLB
+    TLBEntry *getTLBEntry(VPtrNum p) { return &pageTLB[(p >> tlbShift) & (PAGE_TLB_SIZE - 1)]; }
+    LockPage *findTLBPage(VPtrNum p, VPtrSize size);
+#else
+    LockPage *findTLBPage(VPtrNum, VPtrSize) { return 0; }
+#endif
+#if defined(VIRTMEM_PAGE_TLB) || defined(VIRTMEM_THREAD_SAFE)
+    void updateTLB(VPtrNum p, VPtrSize size);
+#else
+    void updateTLB(VPtrNum, VPtrSize) { }
+#endif
+    void invalidateTLB(void);
+    void publishFrame(VirtPageIndex index, VPtrNum p);
+    void unpublishFrame(const LockPage *page);
+    void unpublishFrames(void);
+#ifdef VIRTMEM_THREAD_SAFE
+    bool readOptimistic(VPtrNum p, void *d, VPtrSize size) const;
+#endif
+    VPtrNum getBigGridStart(VPtrNum p) const;
+    VirtPageSize getBigGridSize(VPtrNum gridstart) const;
+    bool isOnBigGrid(const LockPage *page) const;
+    VirtPageIndex findGridPage(VPtrNum gridstart) const;
+#ifdef VIRTMEM_THREAD_SAFE
+    uint8_t getShardCount(void) const { return shardMask + 1; }
+    uint8_t getPageShard(VPtrNum start) const { return (start >> bigPageShift) & shardMask; }
+    uint8_t getFrameShard(VirtPageIndex index) const { return index & shardMask; }
+    CacheShard *getShard(uint8_t shard) { return &cacheShards[shard]; }
+    int getRangeShard(VPtrNum p, VPtrSize size) const;
+    bool isShardAccessible(VPtrNum p, VPtrSize size) const;
+#else
+    uint8_t getShardCount(void) const { return 1; }
+    uint8_t getPageShard(VPtrNum) const { return 0; }
+    uint8_t getFrameShard(VirtPageIndex) const { return 0; }
+    CacheShard *getShard(uint8_t) { return &cacheShard; }
+#endif
+    VirtPageIndex findShardFrame(VirtPageIndex index, uint8_t shard) const;
+    uint8_t findLockShard(VPtrNum ptr) const;
+    void resetShards(void);
+#ifdef VIRTMEM_PAGE_POLICIES
+    VirtPageIndex findSwapPage(uint8_t shard);
+    void updatePageUse(VirtPageIndex index, bool swapped);
+#else
+    void updatePageUse(VirtPageIndex, bool) { }
+#endif
+    bool isBigRangeCached(VPtrNum p, VPtrSize size) const;
+#ifdef VIRTMEM_READ_AHEAD
+    void readAhead(VirtPageIndex index);
+#endif
+    bool isBigRangeLoading(VPtrNum p, VPtrSize size) const;
+    bool isLoadFrame(const VirtPageIndex *frames, uint8_t count, VirtPageIndex index, uint8_t pass) const;
+    uint8_t findLoadFrames(VirtPageIndex *frames, VPtrNum *targets, VirtPageSize *tsizes, uint8_t count, VirtPageIndex exclude) const;
+    void loadPages(const VirtPageIndex *frames, const VPtrNum *targets, const VirtPageSize *tsizes, uint8_t count, bool async);
+    void finishLoad(VirtPageIndex index);
+    void finishAsync(void);
+    static void asyncReadDone(BaseVAlloc *alloc, void *arg);
+    static void asyncWriteDone(BaseVAlloc *alloc, void *arg);
+#ifdef VIRTMEM_VICTIM_CACHE
+    VirtPageIndex findVictimPage(VPtrNum start, VirtPageSize size) const;
+    void syncVictimPage(VictimPage *vpage);
+    void syncVictimRange(VPtrNum p, VPtrSize size, bool drop);
+    void clearVictimCache(void);
+    VPtrSize allocVictimSpace(VPtrSize size);
+    bool storeVictimPage(LockPage *page);
+    bool loadVictimPage(LockPage *page);
+#else
+    VirtPageIndex findVictimPage(VPtrNum, VirtPageSize) const { return -1; }
+    void syncVictimRange(VPtrNum, VPtrSize, bool) { }
+    void clearVictimCache(void) { }
+    bool storeVictimPage(LockPage *) { return false; }
+    bool loadVictimPage(LockPage *) { return false; }
+#endif
+#ifdef VIRTMEM_ZERO_FILL
+    bool isRegionTouched(VPtrSize region) const { return touchedRegions[region / 8] & (1 << (region & 7)); }
+    void setRegionTouched(VPtrSize region, bool t);
+    void writeZeroData(VPtrNum start, VPtrSize n);
+    void padRegion(VPtrSize region, VPtrNum start, VPtrNum end);
+#endif
+    void readPool(void *data, VPtrNum offset, VPtrSize size);
+    void writePool(const void *data, VPtrNum offset, VPtrSize size, bool async=false);
+    VirtPageIndex findUnusedLockedPage(PageInfo *pinfo);
     void syncLockedPage(LockPage *page);
-    int8_t lockPage(PageInfo *pinfo, VPtrNum ptr, VirtPageSize size);
-    int8_t freeLockedPage(PageInfo *pinfo, int8_t index);
-    int8_t findLockedPage(PageInfo *pinfo, VPtrNum p);
+    VirtPageIndex lockPage(PageInfo *pinfo, VPtrNum ptr, VirtPageSize size);
+    VirtPageIndex freeLockedPage(PageInfo *pinfo, VirtPageIndex index);
     LockPage *findLockedPage(VPtrNum p);
-    uint8_t getFreePages(const PageInfo *pinfo) const;
-    uint8_t getUnlockedPages(const PageInfo *pinfo) const;
+    PageInfo *getPageInfo(const LockPage *page);
+    LockPage *getLockInterval(VirtPageIndex l) const
+    {
+        VirtPageIndex n = lockIntervals[l];
+        if (n < smallPages.count)
+            return &smallPages.pages[n];
+        n -= smallPages.count;
+        return (n < mediumPages.count) ? &mediumPages.pages[n] : &bigPages.pages[n - mediumPages.count];
+    }
+    VirtPageIndex getLockNumber(const LockPage *page) const;
+    VirtPageIndex findLockInterval(VPtrNum start) const;
+    VirtPageIndex findLockOverlap(VPtrNum p) const;
+    void insertLockInterval(LockPage *page);
+    void removeLockInterval(LockPage *page);
+    void moveLockInterval(LockPage *page, VPtrNum start);
+    VirtPageIndex getFreePages(const PageInfo *pinfo) const;
+    VirtPageIndex getUnlockedPages(const PageInfo *pinfo) const;
 
 protected:
-    BaseVAlloc(void) : poolSize(0) { }
+    BaseVAlloc(void) : poolSize(0), bigPageGrid(false), bigPageShift(0), unalignedBigPages(0), lockIntervals(0), lockIntervalCount(0),
+#ifdef VIRTMEM_PAGE_POLICIES
+        bigPagePolicy(PAGE_POLICY_FIFO), pageGhosts(0), pageGhostCount(0),
+#endif
+#ifdef VIRTMEM_PAGE_TLB
+        tlbGeneration(1),
+#endif
+#if defined(VIRTMEM_PAGE_TLB) || defined(VIRTMEM_THREAD_SAFE)
+        tlbShift(0),
+#endif
+#ifdef VIRTMEM_VICTIM_CACHE
+        victimPool(0), victimPoolSize(0), victimHead(0), victimPages(0), victimPageCount(0), victimTail(0), victimUsed(0),
+#endif
+#ifdef VIRTMEM_ZERO_FILL
+        touchedRegions(0), touchedRegionCount(0), touchedRegionSize(0), poolZeroed(false),
+#endif
+        persistent(false), restored(false),
+#ifdef VIRTMEM_SIZE_CLASSES
+        classBlocks(0), classUsed(0), classCount(0), classDepth(0), trackedBlocks(0), trackedClasses(0), trackedBlockCount(0),
+#endif
+#ifdef VIRTMEM_BUDDY_ALLOC
+        buddyTree(0), buddyMaxBlocks(0), buddyMinSize(0), buddyLevels(0),
+#endif
+#ifdef VIRTMEM_READ_AHEAD
+        readAheadEnabled(true), readAheadDepth(2),
+#endif
+        asyncReads(0), asyncWrites(0) { }
 
     // \cond HIDDEN_SYMBOLS
-    void initSmallPages(LockPage *pages, uint8_t *pool, uint8_t pcount, VirtPageSize psize) { initPages(&smallPages, pages, pool, pcount, psize); }
-    void initMediumPages(LockPage *pages, uint8_t *pool, uint8_t pcount, VirtPageSize psize) { initPages(&mediumPages, pages, pool, pcount, psize); }
-    void initBigPages(LockPage *pages, uint8_t *pool, uint8_t pcount, VirtPageSize psize) { initPages(&bigPages, pages, pool, pcount, psize); }
+    void initSmallPages(LockPage *pages, uint8_t *pool, VirtPageIndex pcount, VirtPageSize psize) { initPages(&smallPages, pages, pool, pcount, psize); }
+    void initMediumPages(LockPage *pages, uint8_t *pool, VirtPageIndex pcount, VirtPageSize psize) { initPages(&mediumPages, pages, pool, pcount, psize); }
+    void initBigPages(LockPage *pages, uint8_t *pool, VirtPageIndex pcount, VirtPageSize psize, VirtPageIndex *index, uint32_t indexsize)
+    { initPages(&bigPages, pages, pool, pcount, psize); bigPages.index = index; bigPages.indexMask = indexsize - 1; }
+    void initBigPageGrid(bool grid);
+    void initLockIntervals(VirtPageIndex *intervals) { lockIntervals = intervals; lockIntervalCount = 0; }
+#ifdef VIRTMEM_VICTIM_CACHE
+    void initVictimCache(uint8_t *pool, VPtrSize poolsize, VictimPage *pages, VirtPageIndex pcount)
+    { victimPool = pool; victimPoolSize = poolsize; victimPages = pages; victimPageCount = pcount; }
+#endif
+#ifdef VIRTMEM_PAGE_POLICIES
+    void initBigPagePolicy(uint8_t policy, VPtrNum *ghosts, VirtPageIndex ghostcount)
+    { bigPagePolicy = policy; pageGhosts = ghosts; pageGhostCount = ghostcount; }
+#endif
+#ifdef VIRTMEM_ZERO_FILL
+    void initZeroFill(uint8_t *regions, VPtrSize count) { touchedRegions = regions; touchedRegionCount = count; }
+#endif
+#ifdef VIRTMEM_SIZE_CLASSES
+    void initSizeClasses(VPtrNum *blocks, uint8_t *used, uint8_t count, uint8_t depth, VPtrNum *tracked, uint8_t *trackedclasses,
+                         uint16_t trackcount)
+    {
+        classBlocks = blocks; classUsed = used; classCount = count; classDepth = depth;
+        trackedBlocks = tracked; trackedClasses = trackedclasses; trackedBlockCount = trackcount;
+    }
+#endif
+#ifdef VIRTMEM_BUDDY_ALLOC
+    void initBuddy(uint8_t *tree, uint32_t maxblocks, VPtrSize minsize)
+    { buddyTree = tree; buddyMaxBlocks = maxblocks; buddyMinSize = minsize; }
+#endif
+#ifdef VIRTMEM_THREAD_SAFE
+    void initFrameVersions(FrameVersion *versions, VirtPageIndex count);
+    void initCacheShards(CacheShard *shards, uint8_t count) { cacheShards = shards; shardMask = count - 1; }
+#endif
     // \endcond
 
     void writeZeros(VPtrNum start, VPtrSize n); // NOTE: only call this in doStart()
+    //! Tells that unwritten parts of the memory pool already read as zeros (e.g. a new sparse file). Call this in doStart().
+#ifdef VIRTMEM_ZERO_FILL
+    void setPoolZeroed(bool z) { poolZeroed = z; }
+#else
+    void setPoolZeroed(bool) { }
+#endif
 
     /**
      * @name Pure virtual functions
@@ -141,6 +576,35 @@ protected:
     virtual void doWrite(const void *data, VPtrSize offset, VPtrSize size) = 0;
     //! @}
 
+    /**
+     * @brief Completion callback of asynchronous I/O.
+     * @param alloc The allocator that started the transfer.
+     * @param arg The argument given to \ref doReadAsync() or \ref doWriteAsync().
+     * @sa doReadAsync
+     */
+    typedef void (*AsyncCallback)(BaseVAlloc *alloc, void *arg);
+
+    /**
+     * @name Asynchronous I/O
+     * Derived allocator classes may override these functions to transfer data in the background, so that
+     * (for instance) pages are loaded while the application continues (see \ref prefetch()). The default
+     * implementations simply use \ref doRead() and \ref doWrite().
+     *
+     * The given buffer is not accessed by the allocator until the transfer is completed. The completion callback
+     * should be called by \ref doReadAsync() or \ref doWriteAsync() when the transfer is done at once, or
+     * otherwise by \ref doWaitAsync(), i.e. it's always called by the thread that uses the allocator.
+     * Transfers should be performed in the order they were started, and after transfers started by
+     * \ref doRead() or \ref doWrite() before them.
+     * @{
+     */
+    virtual void doReadAsync(void *data, VPtrSize offset, VPtrSize size, AsyncCallback callback, void *arg)
+    { doRead(data, offset, size); callback(this, arg); }
+    virtual void doWriteAsync(const void *data, VPtrSize offset, VPtrSize size, AsyncCallback callback, void *arg)
+    { doWrite(data, offset, size); callback(this, arg); }
+    //! Waits until all transfers are completed and calls their completion callbacks.
+    virtual void doWaitAsync(void) { }
+    //! @}
+
 public:
     void start(void);
     void stop(void);
@@ -156,15 +620,54 @@ public:
 
     VPtrNum allocRaw(VPtrSize size);
     void freeRaw(VPtrNum ptr);
+    VPtrNum reallocRaw(VPtrNum ptr, VPtrSize size);
+    VPtrNum allocAligned(VPtrSize size, VPtrSize alignment);
+    VPtrNum allocNoStraddle(VPtrSize size);
+    VPtrNum allocNear(VPtrNum hint, VPtrSize size);
+    VPtrNum splitRaw(VPtrNum ptr, VPtrSize size);
+    VPtrSize getRawSize(VPtrNum ptr);
+    void moveRaw(VPtrNum dest, VPtrNum src, VPtrSize size);
+    void prefetch(VPtrNum p, VPtrSize size);
+    bool isResident(VPtrNum p, VPtrSize size);
+
+    /**
+     * @brief Enables or disables persistent mode (disabled by default).
+     *
+     * In persistent mode the state of the allocator (i.e. which memory is allocated) and the
+     * named roots (see \ref setRoot) are stored in a small header at the start of the memory pool
+     * by \ref flush() and \ref stop(). When the allocator is started again with an existing pool of the
+     * same size (e.g. a file used by StdioVAllocP or SDVAllocP), all allocations are restored.
+     * @param p Whether persistent mode should be enabled.
+     * @return `false` if persistent mode is not supported, i.e. with the buddy engine (see AllocEngine), as the
+     * buddy tree is not stored in the memory pool.
+     * @note This function should always be called before \ref start().
+     * @note Data is only consistent after calling \ref flush() or \ref stop(), and locked data
+     * should be released before.
+     * @sa isRestored
+     */
+    bool setPersistent(bool p)
+    {
+        if (p && getAllocEngine() == ALLOC_ENGINE_BUDDY)
+            return false;
+        persistent = p;
+        return true;
+    }
+    bool isPersistent(void) const { return persistent; } //!< Returns whether persistent mode is enabled (see \ref setPersistent).
+    //! Returns whether \ref start() restored the allocations of an existing pool in persistent mode.
+    bool isRestored(void) const { return restored; }
+    bool setRoot(const char *name, VPtrNum p);
+    VPtrNum getRoot(const char *name);
 
     void *read(VPtrNum p, VPtrSize size);
+    void read(VPtrNum p, void *d, VPtrSize size);
     void write(VPtrNum p, const void *d, VPtrSize size);
     void flush(void);
     void clearPages(void);
-    uint8_t getFreeBigPages(void) const;
-    uint8_t getUnlockedSmallPages(void) const { return getUnlockedPages(&smallPages); } //!< Returns amount of *small* pages which are not locked.
-    uint8_t getUnlockedMediumPages(void) const { return getUnlockedPages(&mediumPages); } //!< Returns amount of *medium* pages which are not locked.
-    uint8_t getUnlockedBigPages(void) const { return getUnlockedPages(&bigPages); } //!< Returns amount of *big* pages which are not locked.
+    void discardRange(VPtrNum p, VPtrSize size);
+    VirtPageIndex getFreeBigPages(void) const;
+    VirtPageIndex getUnlockedSmallPages(void) const { return getUnlockedPages(&smallPages); } //!< Returns amount of *small* pages which are not locked.
+    VirtPageIndex getUnlockedMediumPages(void) const { return getUnlockedPages(&mediumPages); } //!< Returns amount of *medium* pages which are not locked.
+    VirtPageIndex getUnlockedBigPages(void) const { return getUnlockedPages(&bigPages); } //!< Returns amount of *big* pages which are not locked.
 
     // \cond HIDDEN_SYMBOLS
     void *makeDataLock(VPtrNum ptr, VirtPageSize size, bool ro=false);
@@ -172,12 +675,66 @@ public:
     void releaseLock(VPtrNum ptr);
     // \endcond
 
-    uint8_t getSmallPageCount(void) const { return smallPages.count; } //!< Returns total amount of *small* pages.
-    uint8_t getMediumPageCount(void) const { return mediumPages.count; } //!< Returns total amount of *medium* pages.
-    uint8_t getBigPageCount(void) const { return bigPages.count; } //!< Returns total amount of *big* pages.
+    VirtPageIndex getSmallPageCount(void) const { return smallPages.count; } //!< Returns total amount of *small* pages.
+    VirtPageIndex getMediumPageCount(void) const { return mediumPages.count; } //!< Returns total amount of *medium* pages.
+    VirtPageIndex getBigPageCount(void) const { return bigPages.count; } //!< Returns total amount of *big* pages.
     VirtPageSize getSmallPageSize(void) const { return smallPages.size; } //!< Returns the size of a *small* page.
     VirtPageSize getMediumPageSize(void) const { return mediumPages.size; } //!< Returns the size of a *medium* page.
     VirtPageSize getBigPageSize(void) const { return bigPages.size; } //!< Returns the size of a *big* page.
+    bool hasBigPageGrid(void) const { return bigPageGrid; } //!< Returns whether *big* pages are aligned to a fixed grid.
+#ifdef VIRTMEM_PAGE_POLICIES
+    uint8_t getBigPagePolicy(void) const { return bigPagePolicy; } //!< Returns the replacement policy of *big* pages (see PagePolicy).
+#else
+    uint8_t getBigPagePolicy(void) const { return PAGE_POLICY_FIFO; }
+#endif
+    //! Returns the engine used to manage memory blocks (see AllocEngine).
+#ifdef VIRTMEM_BUDDY_ALLOC
+    uint8_t getAllocEngine(void) const { return (buddyTree) ? ALLOC_ENGINE_BUDDY : ALLOC_ENGINE_FREELIST; }
+#else
+    uint8_t getAllocEngine(void) const { return ALLOC_ENGINE_FREELIST; }
+#endif
+#ifdef VIRTMEM_VICTIM_CACHE
+    VPtrSize getVictimCacheSize(void) const { return victimPoolSize; } //!< Returns the size of the victim cache (0 if disabled).
+#else
+    VPtrSize getVictimCacheSize(void) const { return 0; }
+#endif
+#ifdef VIRTMEM_ZERO_FILL
+    bool hasLazyZeroFill(void) const { return touchedRegions != 0; } //!< Returns whether untouched memory is zero filled lazily (see DefaultAllocProperties::zeroFillRegions).
+#else
+    bool hasLazyZeroFill(void) const { return false; }
+#endif
+
+#ifdef VIRTMEM_READ_AHEAD
+    /**
+     * @brief Enables or disables reading ahead of *big* pages (enabled by default).
+     *
+     * When enabled, sequential or strided access of *big* pages is detected, and the following
+     * pages are read in advance, in as few reads as possible. Only unused and unmodified (clean)
+     * pages are used for reading ahead.
+     * @note Only available when @ref VIRTMEM_READ_AHEAD is defined.
+     * @sa setReadAheadDepth
+     */
+    void setReadAhead(bool e)
+    {
+#ifdef VIRTMEM_THREAD_SAFE
+        CacheGuard guard(this); // see isShardAccessible()
+#endif
+        readAheadEnabled = e;
+    }
+    bool getReadAhead(void) const { return readAheadEnabled; } //!< Returns whether reading ahead is enabled (see \ref setReadAhead).
+    /**
+     * @brief Sets the maximum amount of *big* pages read ahead at once (default: 2).
+     * @param d Amount of pages, at most 8. Zero disables reading ahead.
+     */
+    void setReadAheadDepth(uint8_t d)
+    {
+#ifdef VIRTMEM_THREAD_SAFE
+        CacheGuard guard(this);
+#endif
+        readAheadDepth = (d > READ_AHEAD_MAX_DEPTH) ? (uint8_t)READ_AHEAD_MAX_DEPTH : d;
+    }
+    uint8_t getReadAheadDepth(void) const { return readAheadDepth; } //!< Returns the read-ahead depth (see \ref setReadAheadDepth).
+#endif
 
     /**
      * @brief Returns the size of the memory pool.
@@ -201,9 +758,40 @@ public:
     VPtrSize getMaxMemUsed(void) const { return maxMemUsed; } //!< Returns the maximum memory used so far.
     uint32_t getBigPageReads(void) const { return bigPageReads; } //!< Returns the times *big* pages were read (swapped).
     uint32_t getBigPageWrites(void) const { return bigPageWrites; } //!< Returns the times *big* pages written (synchronized).
+    uint32_t getBigPageHits(void) const { return bigPageHits; } //!< Returns the times data was found in an already loaded *big* page.
     uint32_t getBytesRead(void) const { return bytesRead; } //!< Returns the amount of bytes read as a result of page swaps.
     uint32_t getBytesWritten(void) const { return bytesWritten; } //!< Returns the amount of bytes written as a results of page swaps.
-    void resetStats(void) { memUsed = maxMemUsed = 0; bigPageReads = bigPageWrites = bytesRead = bytesWritten = 0; } //!< Reset all statistics. Called by \ref start()
+    uint32_t getBigPagePrefetches(void) const { return bigPagePrefetches; } //!< Returns the amount of *big* pages that were read ahead.
+    uint32_t getUsefulPrefetches(void) const { return usefulPrefetches; } //!< Returns the amount of *big* pages read ahead that were accessed later.
+    uint32_t getWastedPrefetches(void) const { return wastedPrefetches; } //!< Returns the amount of *big* pages read ahead that were swapped without being accessed.
+#ifdef VIRTMEM_VICTIM_CACHE
+    uint32_t getVictimCacheHits(void) const { return victimHits; } //!< Returns the times a swapped in *big* page was found in the victim cache.
+    uint32_t getVictimCacheMisses(void) const { return victimMisses; } //!< Returns the times a swapped in *big* page was not found in the victim cache.
+    uint32_t getVictimCacheRawBytes(void) const { return victimRawBytes; } //!< Returns the amount of (uncompressed) bytes stored in the victim cache.
+    uint32_t getVictimCacheStoredBytes(void) const { return victimStoredBytes; } //!< Returns the amount of (compressed) bytes used to store data in the victim cache.
+#endif
+#ifdef VIRTMEM_ZERO_FILL
+    uint32_t getZeroFilledBytes(void) const { return zeroFilledBytes; } //!< Returns the amount of bytes of untouched memory that were zero filled instead of read.
+#endif
+#ifdef VIRTMEM_SIZE_CLASSES
+    uint32_t getSizeClassHits(void) const { return classAllocHits; } //!< Returns the times an allocation was served from the size class free lists.
+    uint32_t getSizeClassMisses(void) const { return classAllocMisses; } //!< Returns the times an allocation of a size class had to search the free list in virtual memory.
+#endif
+    //! Reset all statistics. Called by \ref start()
+    void resetStats(void)
+    {
+        memUsed = maxMemUsed = 0; bigPageReads = bigPageWrites = bigPageHits = bytesRead = bytesWritten = 0;
+        bigPagePrefetches = usefulPrefetches = wastedPrefetches = 0;
+#ifdef VIRTMEM_VICTIM_CACHE
+        victimHits = victimMisses = victimRawBytes = victimStoredBytes = 0;
+#endif
+#ifdef VIRTMEM_ZERO_FILL
+        zeroFilledBytes = 0;
+#endif
+#ifdef VIRTMEM_SIZE_CLASSES
+        classAllocHits = classAllocMisses = 0;
+#endif
+    }
     //@}
 #endif
 };
@@ -100,12 +100,12 @@ protected:
 #ifdef VIRTMEM_WRAP_CPOINTERS
     // Return 'real' address of pointer, ie without wrapping bit
     // static so that ValueWrapper can use it as well
-    static intptr_t getPtrNum(PtrNum p) { return p & ~((PtrNum)1 << WRAP_BIT); }
-    static void *unwrap(PtrNum p) { ASSERT(isWrapped(p)); return reinterpret_cast<void *>(getPtrNum(p)); }
+    static PtrNum getPtrNum(PtrNum p) { return p & ~((PtrNum)1 << WRAP_BIT); }
+    static void *unwrap(PtrNum p) { ASSERT(isWrapped(p)); return reinterpret_cast<void *>((intptr_t)getPtrNum(p)); }
 #else
-    static intptr_t getPtrNum(PtrNum p) { return p; }
+    static PtrNum getPtrNum(PtrNum p) { return p; }
 #endif
-    intptr_t getPtrNum(void) const { return getPtrNum(ptr); } // Shortcut
+    PtrNum getPtrNum(void) const { return getPtrNum(ptr); } // Shortcut
     // @endcond
 
 public:
@@ -0,0 +1,37 @@
+#ifndef VIRTMEM_CODEC_H
+#define VIRTMEM_CODEC_H
+
+/**
+  @file
+  @brief Simple run length codec used to compress memory pages
+*/
+
+#include <stdint.h>
+
+namespace virtmem {
+
+namespace private_utils {
+
+// Compresses data with a PackBits like run length encoding. Returns the size of the compressed data,
+// which is only written if dest is non-zero. Worst case the output is size / 128 + 1 bytes larger.
+uint32_t rleCompress(const uint8_t *src, uint32_t size, uint8_t *dest);
+
+// Decompresses data from rleCompress() in successive chunks
+class RLEDecoder
+{
+    const uint8_t *src;
+    uint8_t left; // bytes left in current run
+    bool repeat; // current run repeats a single byte?
+
+public:
+    RLEDecoder(const uint8_t *s) : src(s), left(0), repeat(false) { }
+
+    // Decompresses the next size bytes. If dest is zero the data is skipped.
+    void read(uint8_t *dest, uint32_t size);
+};
+
+}
+
+}
+
+#endif // VIRTMEM_CODEC_H
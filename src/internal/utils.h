@@ -1,6 +1,10 @@
 #ifndef VIRTMEM_UTILS_H
 #define VIRTMEM_UTILS_H
 
+#include "config/config.h"
+
+#include <stdint.h>
+
 #ifndef ARDUINO
 #include <assert.h>
 #define ASSERT assert
@@ -57,8 +61,50 @@ template <typename T> T maximal(const T &v1, const T &v2) { return (v1 > v2) ? v
 template <typename T> struct AntiConst { typedef T type; };
 template <typename T> struct AntiConst<const T> { typedef T type; };
 
+// Smallest power of two that is equal to or larger than N (compile time)
+template <uint32_t N, uint32_t P=1, bool done=(P >= N)> struct NextPowerOf2
+{ static const uint32_t value = NextPowerOf2<N, P * 2>::value; };
+template <uint32_t N, uint32_t P> struct NextPowerOf2<N, P, true> { static const uint32_t value = P; };
+
+template <unsigned> struct SizeToVoid { typedef void type; };
+
+template <uint32_t N> struct IsPowerOf2 { static const bool value = (N != 0 && (N & (N - 1)) == 0); };
+
+// Whether N can be stored by the (signed or unsigned) integral type T
+template <typename T, uint32_t N> struct FitsInType
+{
+    static const bool isSigned = ((T)-1 < (T)0);
+    static const uint32_t bits = sizeof(T) * 8 - (isSigned ? 1 : 0);
+    static const bool value = (bits >= 32) || (N <= ((1ul << (bits % 32)) - 1));
+};
+
+// Compile time assertion, usable at namespace and class scope
+#ifdef VIRTMEM_CPP11
+#define VIRTMEM_STATIC_ASSERT(cond, msg) static_assert(cond, msg)
+#else
+template <bool> struct StaticAssert;
+template <> struct StaticAssert<true> { };
+#define VIRTMEM_STATIC_ASSERT(cond, msg) enum { VIRTMEM_CONCAT(staticAssert, __LINE__) = sizeof(private_utils::StaticAssert<(cond)>) }
+#define VIRTMEM_CONCAT(a, b) VIRTMEM_CONCAT2(a, b)
+#define VIRTMEM_CONCAT2(a, b) a##b
+#endif
+
 }
 
+// Declares a trait for an optional allocator property: <name>Property<Properties>::value equals
+// Properties::<name> if the properties struct defines it, and defval otherwise. This allows
+// customized allocator properties to omit newer settings.
+#define VIRTMEM_OPTIONAL_PROPERTY(name, type, defval) \
+    template <typename P> struct name##PropertyCheck \
+    { \
+        template <typename U> static char check(SizeToVoid<sizeof(U::name)> *); \
+        template <typename U> static long check(...); \
+        enum { present = (sizeof(check<P>(0)) == sizeof(char)) }; \
+    }; \
+    template <typename P, bool = name##PropertyCheck<P>::present> struct name##Property \
+    { static const type value = (defval); }; \
+    template <typename P> struct name##Property<P, true> { static const type value = P::name; }
+
 }
 
 #endif // VIRTMEM_UTILS_H
@@ -0,0 +1,119 @@
+#ifndef VIRTMEM_VALLOC_GROUP_H
+#define VIRTMEM_VALLOC_GROUP_H
+
+/**
+  @file
+  @brief This header contains the class definition of the VAllocGroup class
+  */
+
+#include "config/config.h"
+#include "utils.h"
+#include "vptr.h"
+
+namespace virtmem {
+
+/**
+ * @brief Allocation group that keeps related blocks of virtual memory close together.
+ *
+ * Blocks that are accessed together, such as the nodes of a linked list or tree, are often spread over the
+ * whole memory pool when they are allocated as usual, so that following links requires loading a different
+ * page for almost every node. An allocation group reserves a *region* (by default, the size of a *big* page
+ * that does not cross page boundaries, see BaseVAlloc::allocNoStraddle()) and hands out blocks by simply
+ * splitting them from its start (see BaseVAlloc::splitRaw()). When the region is used, its remainder is
+ * freed and a new region is allocated. Each data structure can use its own group.
+ *
+ * Unlike VArena, the blocks are regular blocks of the allocator, which are freed as usual (e.g. with
+ * VAlloc::free() or BaseVAlloc::freeRaw()).
+ *
+ * Example:
+ * @code{.cpp}
+ * virtmem::VAllocGroup<SDVAlloc> group;
+ * virtmem::VPtr<Node, SDVAlloc> head = group.alloc<Node>();
+ * head->next = group.alloc<Node>();
+ * // ...
+ * group.release(); // frees the unused part of the region
+ * @endcode
+ *
+ * @tparam Allocator The allocator used by the group, which should be started before using the group.
+ *
+ * @note Blocks larger than half the region size are allocated with BaseVAlloc::allocNear(), using the
+ * previously allocated block as hint.
+ * @note With the buddy engine (see AllocEngine) blocks cannot be split, and they are simply allocated
+ * with BaseVAlloc::allocNear().
+ * @note Like VArena, the destructor does not free any memory, call \ref release() for this.
+ */
+template <typename Allocator>
+class VAllocGroup
+{
+    VPtrNum region; // unused part of the current region (an allocated block), zero if none
+    VPtrNum lastBlock; // last allocated block, used as hint for large blocks
+    VPtrSize regionSize;
+
+    static Allocator *getAlloc(void) { return static_cast<Allocator *>(Allocator::getInstance()); }
+
+public:
+    /**
+     * @brief Constructs the group.
+     * @param rsize Size of the regions. If zero, the size of a *big* page is used.
+     */
+    VAllocGroup(VPtrSize rsize=0) : region(0), lastBlock(0), regionSize(rsize) { }
+
+    /**
+     * @brief Allocates a block of raw virtual memory close to other blocks of the group.
+     * @param size Size of the block.
+     * @return Start of the block, or zero if out of memory.
+     * @sa alloc
+     */
+    VPtrNum allocRaw(VPtrSize size)
+    {
+        Allocator *alloc = getAlloc();
+        const VPtrSize rsize = (regionSize) ? regionSize : alloc->getBigPageSize();
+
+        if (alloc->getAllocEngine() == ALLOC_ENGINE_BUDDY || size > (rsize / 2))
+            return (lastBlock = alloc->allocNear(lastBlock, size));
+
+        if (!region || alloc->getRawSize(region) < size)
+        {
+            // NOTE: the unused part is freed first, so the new region may include it
+            alloc->freeRaw(region);
+            region = alloc->allocNoStraddle(rsize);
+            if (!region)
+                return 0;
+        }
+
+        // the block gets the whole region if the remainder is too small
+        lastBlock = region;
+        region = alloc->splitRaw(region, size);
+        return lastBlock;
+    }
+
+    /**
+     * @brief Allocates virtual memory close to other blocks of the group, similar to VAlloc::alloc().
+     * @param size Size of the block.
+     * @return Virtual pointer to the block, or a null pointer if out of memory.
+     * @note No constructors are called.
+     */
+    template <typename T> VPtr<T, Allocator> alloc(VPtrSize size=sizeof(T))
+    {
+        VPtr<T, Allocator> ret;
+        ret.setRawNum(allocRaw(size));
+        return ret;
+    }
+
+    /**
+     * @brief Frees the unused part of the current region.
+     *
+     * Blocks allocated from the group remain valid.
+     */
+    void release(void)
+    {
+        getAlloc()->freeRaw(region);
+        region = lastBlock = 0;
+    }
+
+    VPtrSize getRegionSize(void) const { return regionSize; } //!< Returns the region size given to the constructor.
+};
+
+}
+
+#endif // VIRTMEM_VALLOC_GROUP_H
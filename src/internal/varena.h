@@ -0,0 +1,159 @@
+#ifndef VIRTMEM_VARENA_H
+#define VIRTMEM_VARENA_H
+
+/**
+  @file
+  @brief This header contains the class definition of the VArena class
+  */
+
+#include "config/config.h"
+#include "utils.h"
+#include "vptr.h"
+
+namespace virtmem {
+
+/**
+ * @brief Region based allocator for virtual memory that is freed at once.
+ *
+ * This class allocates large *chunks* of virtual memory (with BaseVAlloc::allocRaw()) and hands out
+ * parts of these by simply increasing an offset. Individual allocations cannot be freed: instead, all
+ * memory is released at once by \ref reset(). This is much faster than freeing many separate blocks,
+ * since only the chunks are returned to the allocator. Furthermore, cached pages of the released
+ * memory are dropped without writing them (see BaseVAlloc::discardRange()).
+ *
+ * Example:
+ * @code{.cpp}
+ * virtmem::VArena<SDVAlloc> arena(4096);
+ * for (int i=0; i<100; ++i)
+ * {
+ *     virtmem::VPtr<Node, SDVAlloc> node = arena.alloc<Node>();
+ *     // ...
+ * }
+ * arena.reset(); // frees all nodes
+ * @endcode
+ *
+ * @tparam Allocator The allocator used for the chunks, which should be started before using the arena.
+ * @tparam maxChunks The maximum amount of chunks.
+ *
+ * @note Allocations that are larger than the chunk size get their own chunk.
+ * @note Like VObjectPool, the destructor does not free any memory, call \ref reset() for this.
+ */
+template <typename Allocator, uint8_t maxChunks=16>
+class VArena
+{
+    enum { ALIGNMENT = 8 };
+
+    struct Chunk
+    {
+        VPtrNum start;
+        VPtrSize size;
+    };
+
+    Chunk chunks[maxChunks];
+    uint8_t chunkCount;
+    VPtrSize chunkSize;
+    VPtrNum nextPtr, endPtr; // free part of the last regular chunk
+    VPtrSize used;
+
+    static Allocator *getAlloc(void) { return static_cast<Allocator *>(Allocator::getInstance()); }
+
+    // Adds a new chunk, returns its start or zero if out of memory
+    VPtrNum addChunk(VPtrSize size)
+    {
+        if (chunkCount == maxChunks)
+            return 0;
+        const VPtrNum ret = getAlloc()->allocRaw(size);
+        if (ret)
+        {
+            chunks[chunkCount].start = ret;
+            chunks[chunkCount].size = size;
+            ++chunkCount;
+        }
+        return ret;
+    }
+
+public:
+    /**
+     * @brief Constructs the arena.
+     * @param csize Size of each chunk. Larger chunks require less calls to the allocator, but may waste more memory.
+     */
+    VArena(VPtrSize csize=1024) : chunkCount(0), chunkSize(csize), nextPtr(0), endPtr(0), used(0)
+    {
+        VIRTMEM_STATIC_ASSERT(maxChunks > 0, "maxChunks should be non-zero");
+    }
+
+    /**
+     * @brief Allocates a block of raw virtual memory from the arena.
+     * @param size Size of the block.
+     * @return Start of the block, or zero if out of memory or all chunks are used.
+     * @sa alloc
+     */
+    VPtrNum allocRaw(VPtrSize size)
+    {
+        size = (size + (ALIGNMENT - 1)) & ~((VPtrSize)ALIGNMENT - 1);
+
+        if (size > chunkSize)
+        {
+            const VPtrNum ret = addChunk(size);
+            if (ret)
+                used += size;
+            return ret;
+        }
+
+        if ((endPtr - nextPtr) < size)
+        {
+            nextPtr = addChunk(chunkSize);
+            if (!nextPtr)
+            {
+                endPtr = 0;
+                return 0;
+            }
+            endPtr = nextPtr + chunkSize;
+        }
+
+        const VPtrNum ret = nextPtr;
+        nextPtr += size;
+        used += size;
+        return ret;
+    }
+
+    /**
+     * @brief Allocates virtual memory from the arena, similar to VAlloc::alloc().
+     * @param size Size of the block.
+     * @return Virtual pointer to the block, or a null pointer if out of memory or all chunks are used.
+     * @note No constructors are called.
+     */
+    template <typename T> VPtr<T, Allocator> alloc(VPtrSize size=sizeof(T))
+    {
+        VPtr<T, Allocator> ret;
+        ret.setRawNum(allocRaw(size));
+        return ret;
+    }
+
+    /**
+     * @brief Releases all memory allocated from the arena.
+     *
+     * All chunks are returned to the allocator, and their cached pages are dropped without writing them.
+     * Any pointers to arena memory are invalid afterwards.
+     * @note Data of arena memory should not be locked while calling this function.
+     */
+    void reset(void)
+    {
+        for (uint8_t i=0; i<chunkCount; ++i)
+        {
+            getAlloc()->discardRange(chunks[i].start, chunks[i].size);
+            getAlloc()->freeRaw(chunks[i].start);
+        }
+        chunkCount = 0;
+        nextPtr = endPtr = 0;
+        used = 0;
+    }
+
+    VPtrSize getUsed(void) const { return used; } //!< Returns the amount of bytes allocated from the arena (including alignment).
+    uint8_t getChunkCount(void) const { return chunkCount; } //!< Returns the amount of chunks allocated by the arena.
+    VPtrSize getChunkSize(void) const { return chunkSize; } //!< Returns the size of regular chunks.
+};
+
+}
+
+#endif // VIRTMEM_VARENA_H
@@ -0,0 +1,279 @@
+#ifndef VIRTMEM_VHANDLE_H
+#define VIRTMEM_VHANDLE_H
+
+/**
+  @file
+  @brief This header contains the class definitions of the VHandleHeap and VHandle classes
+  */
+
+#include "config/config.h"
+#include "utils.h"
+#include "vptr.h"
+
+namespace virtmem {
+
+template <typename, typename> class VHandle;
+
+/**
+ * @brief Heap of relocatable virtual memory blocks, which are accessed through handles.
+ *
+ * Blocks allocated from this class are referred to by a *handle* (see VHandle), which is resolved to a
+ * virtual pointer through a table in regular RAM. Since only the handle table refers to the location
+ * of blocks, they can be moved: this allows the heap to be *compacted*, i.e. live blocks are moved
+ * together, which removes the gaps left by freed blocks.
+ *
+ * All blocks are stored in a single *region*, which is allocated from the allocator (see
+ * BaseVAlloc::allocRaw()). New blocks are simply placed after the last block. When the region is
+ * full, it's compacted first if that gives enough space, and grown otherwise (see BaseVAlloc::reallocRaw()).
+ * Compaction is done incrementally by \ref compactStep(), for instance when the application is idle.
+ * When compaction finishes, unused memory at the end of a (grown) region is returned to the allocator.
+ *
+ * Example:
+ * @code{.cpp}
+ * typedef virtmem::VHandleHeap<SDVAlloc> Heap;
+ * Heap heap;
+ * virtmem::VHandle<MyRecord, Heap> rec = heap.alloc<MyRecord>();
+ * rec->value = 10; // or: rec.get()->value = 10;
+ * heap.free(rec);
+ *
+ * // in the main loop
+ * heap.compactStep();
+ * @endcode
+ *
+ * @tparam Allocator The allocator used for the region, which should be started before using the heap.
+ * @tparam maxHandles The maximum amount of blocks.
+ *
+ * @note Virtual pointers obtained from handles become invalid when the heap is compacted or grown. Therefore,
+ * they (and data locked through them) should not be kept when \ref alloc() or \ref compactStep() is called.
+ * @note Like VObjectPool, the destructor does not free any memory, call \ref clear() for this.
+ */
+template <typename Allocator, uint16_t maxHandles=64>
+class VHandleHeap
+{
+public:
+    typedef Allocator AllocatorType; //!< Allocator type used by this heap.
+
+private:
+    enum { ALIGNMENT = 8 };
+
+    struct Entry
+    {
+        VPtrSize offset; // relative to the region start
+        VPtrSize size; // 0 if unused
+    };
+
+    Entry entries[maxHandles];
+    VPtrNum region;
+    VPtrSize regionSize, initialSize;
+    VPtrSize top; // end of the last block
+    VPtrSize packedEnd; // all blocks before this offset are moved together
+    VPtrSize used;
+
+    static Allocator *getAlloc(void) { return static_cast<Allocator *>(Allocator::getInstance()); }
+
+    // Returns the unpacked block with the lowest offset, or maxHandles if there is none
+    uint16_t findNextBlock(void) const
+    {
+        uint16_t ret = maxHandles;
+        for (uint16_t i=0; i<maxHandles; ++i)
+        {
+            if (entries[i].size && entries[i].offset >= packedEnd && (ret == maxHandles || entries[i].offset < entries[ret].offset))
+                ret = i;
+        }
+        return ret;
+    }
+
+    // Returns false if the region could not be resized, in which case it's kept as is
+    bool resizeRegion(VPtrSize size)
+    {
+        const VPtrNum newregion = getAlloc()->reallocRaw(region, size);
+        if (!newregion)
+            return false;
+        region = newregion;
+        regionSize = size;
+        return true;
+    }
+
+public:
+    /**
+     * @brief Constructs the heap.
+     * @param isize Initial size of the region. The region is allocated when the first block is allocated.
+     */
+    VHandleHeap(VPtrSize isize=1024) : region(0), regionSize(0), initialSize(isize), top(0), packedEnd(0), used(0)
+    {
+        VIRTMEM_STATIC_ASSERT(maxHandles > 0, "maxHandles should be non-zero");
+        for (uint16_t i=0; i<maxHandles; ++i)
+            entries[i].size = 0;
+    }
+
+    /**
+     * @brief Allocates a relocatable block.
+     * @param size Size of the block.
+     * @return Handle index of the block (see \ref getRaw()), or zero if all handles are used or out of memory.
+     * @sa alloc
+     */
+    uint16_t allocRaw(VPtrSize size)
+    {
+        ASSERT(size);
+        size = (size + (ALIGNMENT - 1)) & ~((VPtrSize)ALIGNMENT - 1);
+
+        uint16_t index = 0;
+        for (; index<maxHandles && entries[index].size; ++index)
+            ;
+        if (index == maxHandles)
+            return 0;
+
+        if ((regionSize - top) < size)
+        {
+            if ((regionSize - used) >= size)
+                compact();
+            if ((regionSize - top) < size &&
+                !resizeRegion(private_utils::maximal(private_utils::maximal(regionSize * 2, initialSize), top + size)))
+                return 0;
+        }
+
+        if (packedEnd == top)
+            packedEnd += size;
+        entries[index].offset = top;
+        entries[index].size = size;
+        top += size;
+        used += size;
+        return index + 1;
+    }
+
+    /**
+     * @brief Frees a relocatable block.
+     * @param index Handle index of the block (may be zero).
+     */
+    void freeRaw(uint16_t index)
+    {
+        if (!index)
+            return;
+
+        Entry *entry = &entries[index - 1];
+        ASSERT(entry->size);
+        if ((entry->offset + entry->size) == top)
+            top = entry->offset;
+        packedEnd = private_utils::minimal(packedEnd, entry->offset);
+        used -= entry->size;
+        entry->size = 0;
+    }
+
+    //! Returns the current virtual memory address of a block from its handle index.
+    VPtrNum getRaw(uint16_t index) const { return (index) ? (region + entries[index - 1].offset) : 0; }
+
+    /**
+     * @brief Allocates a relocatable block.
+     * @param size Size of the block.
+     * @return Handle to the block, or a null handle if all handles are used or out of memory.
+     * @note No constructors are called.
+     * @sa free
+     */
+    template <typename T> VHandle<T, VHandleHeap> alloc(VPtrSize size=sizeof(T))
+    {
+        return VHandle<T, VHandleHeap>(this, allocRaw(size));
+    }
+
+    /**
+     * @brief Frees a relocatable block.
+     * @param h Handle to the block, which is set to null.
+     * @sa alloc
+     */
+    template <typename T> void free(VHandle<T, VHandleHeap> &h)
+    {
+        freeRaw(h.getIndex());
+        h = VHandle<T, VHandleHeap>();
+    }
+
+    /**
+     * @brief Performs a step of the compaction of the heap.
+     *
+     * Blocks are moved to the start of the region (see BaseVAlloc::moveRaw()) until the given amount of data
+     * was moved, or the compaction is finished. In the latter case, the region is shrunk if it's mostly unused.
+     * @param maxbytes Amount of data to move. At least one block is moved. If zero, the size of a *big* page is used.
+     * @return `true` if compaction should continue, `false` if the heap is compacted.
+     */
+    bool compactStep(VPtrSize maxbytes=0)
+    {
+        if (!maxbytes)
+            maxbytes = getAlloc()->getBigPageSize();
+
+        for (VPtrSize moved=0; moved<maxbytes; )
+        {
+            const uint16_t next = findNextBlock();
+            if (next == maxHandles)
+            {
+                top = packedEnd;
+                if (regionSize > initialSize && top < (regionSize / 4))
+                    resizeRegion(private_utils::maximal(initialSize, top * 2)); // NOTE: the region is kept if this fails
+                return false;
+            }
+
+            Entry *entry = &entries[next];
+            if (entry->offset != packedEnd)
+            {
+                getAlloc()->moveRaw(region + packedEnd, region + entry->offset, entry->size);
+                entry->offset = packedEnd;
+                moved += entry->size;
+            }
+            packedEnd += entry->size;
+        }
+
+        return true;
+    }
+
+    //! Compacts the heap at once (see \ref compactStep()).
+    void compact(void) { while (compactStep()) ; }
+
+    /**
+     * @brief Frees all blocks and the region.
+     *
+     * All handles of this heap are invalid afterwards.
+     */
+    void clear(void)
+    {
+        getAlloc()->freeRaw(region);
+        region = 0;
+        regionSize = top = packedEnd = used = 0;
+        for (uint16_t i=0; i<maxHandles; ++i)
+            entries[i].size = 0;
+    }
+
+    VPtrSize getUsed(void) const { return used; } //!< Returns the amount of bytes used by blocks (including alignment).
+    VPtrSize getRegionSize(void) const { return regionSize; } //!< Returns the size of the region.
+    VPtrSize getGapSize(void) const { return top - used; } //!< Returns the amount of bytes of freed blocks, which is reclaimed by compaction.
+};
+
+/**
+ * @brief Handle to a relocatable block of a VHandleHeap.
+ *
+ * Handles are small objects that remain valid when blocks are moved. They are resolved to a virtual pointer
+ * by \ref get() (or `operator->`), which should not be kept across allocations and compaction (see VHandleHeap).
+ * @tparam T Type of the data the handle refers to.
+ * @tparam Heap The VHandleHeap class.
+ */
+template <typename T, typename Heap>
+class VHandle
+{
+    typedef VPtr<T, typename Heap::AllocatorType> Ptr;
+
+    Heap *heap;
+    uint16_t index;
+
+public:
+    VHandle(void) : heap(0), index(0) { } //!< Constructs a null handle.
+    VHandle(Heap *h, uint16_t i) : heap(h), index(i) { } //!< Constructs a handle from a handle index (see VHandleHeap::allocRaw()).
+
+    //! Returns a virtual pointer to the current location of the block.
+    Ptr get(void) const { Ptr ret; ret.setRawNum((heap) ? heap->getRaw(index) : 0); return ret; }
+    Ptr operator->(void) const { return get(); } //!< Provides access to members of the block, see \ref get()
+    uint16_t getIndex(void) const { return index; } //!< Returns the handle index.
+    bool isNull(void) const { return index == 0; } //!< Returns whether the handle is a null handle.
+
+    bool operator==(const VHandle &other) const { return heap == other.heap && index == other.index; }
+    bool operator!=(const VHandle &other) const { return !(*this == other); }
+};
+
+}
+
+#endif // VIRTMEM_VHANDLE_H
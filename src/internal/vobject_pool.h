@@ -0,0 +1,270 @@
+#ifndef VIRTMEM_VOBJECT_POOL_H
+#define VIRTMEM_VOBJECT_POOL_H
+
+/**
+  @file
+  @brief This header contains the class definition of the VObjectPool class
+  */
+
+#include "config/config.h"
+#include "utils.h"
+#include "vptr.h"
+
+#include <string.h>
+
+namespace virtmem {
+
+/**
+ * @brief Pool for virtual memory objects of a fixed size.
+ *
+ * This class allocates objects in *slabs*: blocks of virtual memory that are allocated (with
+ * BaseVAlloc::allocRaw()) for multiple objects at once. Which objects of a slab are in use is kept in
+ * a bitmap in regular RAM. Compared to VAlloc::alloc() and VAlloc::newClass(), this removes the
+ * header that is stored with every allocated block, and allocating and freeing objects does not require
+ * searching the free list stored in virtual memory. Furthermore, objects never cross the boundary
+ * of a *big* page, so accessing an object never requires loading two pages.
+ *
+ * Example:
+ * @code{.cpp}
+ * virtmem::VObjectPool<MyRecord, SDVAlloc> pool;
+ * virtmem::VPtr<MyRecord, SDVAlloc> rec = pool.newClass();
+ * rec->value = 10;
+ * pool.deleteClass(rec);
+ * @endcode
+ *
+ * @tparam T Type of the objects. Its size should not exceed the size of a *big* page.
+ * @tparam Allocator The allocator used for the slabs, which should be started before using the pool.
+ * @tparam slabObjects The amount of objects per slab.
+ * @tparam maxSlabs The maximum amount of slabs. The pool can contain `slabObjects * maxSlabs` objects.
+ *
+ * @note Slabs are not freed by the destructor of this class, since the allocator may already be
+ * stopped: call clear() for this. Similarly, the RAM bitmap is not stored in persistent pools
+ * (see BaseVAlloc::setPersistent()).
+ */
+template <typename T, typename Allocator, uint16_t slabObjects=64, uint16_t maxSlabs=16>
+class VObjectPool
+{
+public:
+    typedef VPtr<T, Allocator> Ptr; //!< Virtual pointer type of the objects in this pool.
+
+private:
+    enum { BITMAP_SIZE = (slabObjects + 7) / 8 };
+
+    struct Slab
+    {
+        VPtrNum start; // start of the block allocated for this slab, sorted
+        uint16_t used;
+        uint8_t bitmap[BITMAP_SIZE];
+    };
+
+    Slab slabs[maxSlabs];
+    uint16_t slabCount, freeSlab; // freeSlab: slab with unused objects, slabCount if none known
+    uint32_t usedObjects;
+
+    static Allocator *getAlloc(void) { return static_cast<Allocator *>(Allocator::getInstance()); }
+    static VPtrSize getPageSize(void) { return getAlloc()->getBigPageSize(); }
+
+    // Objects are stored sequentially, except that objects which would cross a multiple of the
+    // big page size (i.e. a boundary of grid aligned big pages) start at the next page
+    static VPtrNum getFirstBoundary(VPtrNum start) { return (start / getPageSize() + 1) * getPageSize(); }
+    static VPtrSize getFirstObjects(VPtrNum start) { return (getFirstBoundary(start) - start) / sizeof(T); }
+    static VPtrSize getPageObjects(void) { return getPageSize() / sizeof(T); }
+    static VPtrSize getSlabSize(void)
+    {
+        // worst case: every page boundary wastes (almost) a whole object
+        return (VPtrSize)slabObjects * sizeof(T) + ((VPtrSize)slabObjects / getPageObjects() + 2) * sizeof(T);
+    }
+
+    static VPtrNum getObject(const Slab *slab, uint16_t index)
+    {
+        const VPtrSize first = getFirstObjects(slab->start);
+        if (index < first)
+            return slab->start + index * sizeof(T);
+        const VPtrSize i = index - first;
+        return getFirstBoundary(slab->start) + (i / getPageObjects()) * getPageSize() + (i % getPageObjects()) * sizeof(T);
+    }
+
+    static uint16_t getIndex(const Slab *slab, VPtrNum p)
+    {
+        const VPtrNum boundary = getFirstBoundary(slab->start);
+        if (p < boundary)
+            return (p - slab->start) / sizeof(T);
+        const VPtrSize offset = p - boundary;
+        return getFirstObjects(slab->start) + (offset / getPageSize()) * getPageObjects() + (offset % getPageSize()) / sizeof(T);
+    }
+
+    // Returns the slab containing p (binary search), or slabCount if there is none
+    uint16_t findSlab(VPtrNum p) const
+    {
+        uint16_t low = 0, high = slabCount;
+        while (low < high)
+        {
+            const uint16_t mid = (low + high) / 2;
+            if (slabs[mid].start <= p)
+                low = mid + 1;
+            else
+                high = mid;
+        }
+        return (low > 0 && p < (slabs[low - 1].start + getSlabSize())) ? (low - 1) : slabCount;
+    }
+
+    // Returns a slab with unused objects, a new slab is allocated if necessary. Returns slabCount if out of memory.
+    uint16_t getFreeSlab(void)
+    {
+        if (freeSlab < slabCount && slabs[freeSlab].used < slabObjects)
+            return freeSlab;
+
+        for (freeSlab=0; freeSlab<slabCount; ++freeSlab)
+        {
+            if (slabs[freeSlab].used < slabObjects)
+                return freeSlab;
+        }
+
+        if (slabCount == maxSlabs)
+            return slabCount;
+        const VPtrNum start = getAlloc()->allocRaw(getSlabSize());
+        if (!start)
+            return slabCount;
+
+        // insert sorted
+        uint16_t index = slabCount;
+        for (; index > 0 && slabs[index - 1].start > start; --index)
+            slabs[index] = slabs[index - 1];
+        slabs[index].start = start;
+        slabs[index].used = 0;
+        ::memset(slabs[index].bitmap, 0, BITMAP_SIZE);
+        ++slabCount;
+        return (freeSlab = index);
+    }
+
+    void freeSlabMemory(uint16_t index)
+    {
+        getAlloc()->freeRaw(slabs[index].start);
+        --slabCount;
+        for (uint16_t i=index; i<slabCount; ++i)
+            slabs[i] = slabs[i + 1];
+        freeSlab = slabCount;
+    }
+
+public:
+    VObjectPool(void) : slabCount(0), freeSlab(0), usedObjects(0)
+    {
+        VIRTMEM_STATIC_ASSERT(slabObjects > 0 && maxSlabs > 0, "slabObjects and maxSlabs should be non-zero");
+    }
+
+    /**
+     * @brief Allocates an object (without constructing it).
+     * @return Virtual pointer to the object, or a null pointer if the pool is full or out of memory.
+     * @sa free, newClass
+     */
+    Ptr alloc(void)
+    {
+        ASSERT(sizeof(T) <= getPageSize());
+
+        Ptr ret;
+        ret.setRawNum(0);
+
+        const uint16_t s = getFreeSlab();
+        if (s == slabCount)
+            return ret;
+
+        // find unused object, skipping full bytes
+        Slab *slab = &slabs[s];
+        uint16_t byte = 0;
+        while (slab->bitmap[byte] == 0xFF)
+            ++byte;
+        uint8_t bit = 0;
+        while (slab->bitmap[byte] & (1 << bit))
+            ++bit;
+        ASSERT((byte * 8 + bit) < slabObjects);
+
+        slab->bitmap[byte] |= (1 << bit);
+        ++slab->used;
+        ++usedObjects;
+        ret.setRawNum(getObject(slab, byte * 8 + bit));
+        return ret;
+    }
+
+    /**
+     * @brief Frees an object (without destructing it).
+     * @param p Virtual pointer to an object of this pool, which is set to null. Null pointers are ignored.
+     * @sa alloc, deleteClass
+     */
+    void free(Ptr &p)
+    {
+        const VPtrNum ptr = p.getRawNum();
+        if (!ptr)
+            return;
+
+        const uint16_t s = findSlab(ptr);
+        ASSERT(s < slabCount);
+        Slab *slab = &slabs[s];
+        const uint16_t index = getIndex(slab, ptr);
+        ASSERT(getObject(slab, index) == ptr && (slab->bitmap[index / 8] & (1 << (index & 7))));
+
+        slab->bitmap[index / 8] &= ~(1 << (index & 7));
+        --slab->used;
+        --usedObjects;
+        p.setRawNum(0);
+
+        if (slab->used == 0)
+        {
+            // keep at most one empty slab
+            for (uint16_t i=0; i<slabCount; ++i)
+            {
+                if (i != s && slabs[i].used == 0)
+                {
+                    freeSlabMemory(s);
+                    return;
+                }
+            }
+        }
+        freeSlab = s;
+    }
+
+    /**
+     * @brief Allocates and constructs an object, similar to VAlloc::newClass().
+     * @return Virtual pointer to the object, or a null pointer if the pool is full or out of memory.
+     * @sa deleteClass
+     */
+    Ptr newClass(void)
+    {
+        Ptr ret = alloc();
+        if (ret.getRawNum())
+            getAlloc()->template constructObject<T>(ret.getRawNum());
+        return ret;
+    }
+
+    /**
+     * @brief Destructs and frees an object, similar to VAlloc::deleteClass().
+     * @param p Virtual pointer to an object of this pool, which is set to null.
+     * @sa newClass
+     */
+    void deleteClass(Ptr &p)
+    {
+        if (!p.getRawNum())
+            return;
+        getAlloc()->template destructObject<T>(p.getRawNum());
+        free(p);
+    }
+
+    /**
+     * @brief Frees all slabs (without destructing objects).
+     *
+     * All pointers to objects of this pool are invalid afterwards.
+     */
+    void clear(void)
+    {
+        while (slabCount)
+            freeSlabMemory(slabCount - 1);
+        usedObjects = 0;
+    }
+
+    uint32_t getUsed(void) const { return usedObjects; } //!< Returns the amount of allocated objects.
+    uint32_t getCapacity(void) const { return (uint32_t)slabCount * slabObjects; } //!< Returns the amount of objects that fit in the current slabs.
+    uint16_t getSlabCount(void) const { return slabCount; } //!< Returns the amount of allocated slabs.
+};
+
+}
+
+#endif // VIRTMEM_VOBJECT_POOL_H
@@ -91,12 +91,31 @@ public:
 
         template <typename, typename> friend class VPtr;
 
+        // Returns a copy of the data. In concurrent mode, this is done while the page cache is locked,
+        // since another thread may swap the page at any time (see VIRTMEM_THREAD_SAFE)
+        static T readValue(PtrNum p)
+        {
+#ifdef VIRTMEM_THREAD_SAFE
+            bool copy = (p != 0);
+#ifdef VIRTMEM_WRAP_CPOINTERS
+            copy = copy && !isWrapped(p);
+#endif
+            if (copy)
+            {
+                union { char data[sizeof(T)]; long double align1; uint64_t align2; void *align3; } buf;
+                getAlloc()->read(p, buf.data, sizeof(T));
+                return *reinterpret_cast<const T *>(buf.data);
+            }
+#endif
+            return *read(p);
+        }
+
     public:
         /**
          * @name Proxy operators
          * @{
          */
-        inline operator T(void) const { return *read(ptr); }
+        inline operator T(void) const { return readValue(ptr); }
         template <typename T2> VIRTMEM_EXPLICIT inline operator T2(void) const { return static_cast<T2>(operator T()); }
 
 //        ValueWrapper &operator=(const ValueWrapper &v)
@@ -107,7 +126,7 @@ public:
             ASSERT(ptr != 0);
             if (ptr != v.ptr)
             {
-                const T val = *read(v.ptr);
+                const T val = readValue(v.ptr);
                 write(ptr, &val);
             }
             return *this;
@@ -118,7 +137,7 @@ public:
             ASSERT(ptr != 0);
             if (ptr != v.ptr)
             {
-                const T val = *read(v.ptr);
+                const T val = readValue(v.ptr);
                 write(ptr, &val);
             }
             return *this;
@@ -323,6 +342,13 @@ public:
     //! @}
 //    inline bool operator!=(const TVirtPtr &p) const { return ptr != p.ptr; } UNDONE: need this?
 
+    /**
+     * @brief Starts loading the data pointed to into the page cache, so it is available when it's used later.
+     * @param count the number of elements to load
+     * @sa VAlloc::prefetch, BaseVAlloc::prefetch
+     */
+    void prefetch(VPtrSize count=1) const { getAlloc()->prefetch(*this, count * sizeof(T)); }
+
     /**
      * @brief Returns instance of allocator bound to this virtual pointer.
      * @sa VAlloc::getInstance
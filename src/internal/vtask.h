@@ -0,0 +1,320 @@
+#ifndef VIRTMEM_VTASK_H
+#define VIRTMEM_VTASK_H
+
+/**
+  @file
+  @brief This header contains the coroutine based access API: the VTask and VTaskScheduler classes (C++20)
+  */
+
+#include "config/config.h"
+
+#ifdef VIRTMEM_COROUTINES
+
+#include "utils.h"
+#include "vptr.h"
+#include "vptr_utils.h"
+
+#include <algorithm>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <vector>
+
+namespace virtmem {
+
+class VTaskScheduler;
+
+/**
+ * @brief Coroutine that accesses virtual memory, which is run by a VTaskScheduler.
+ *
+ * Functions returning VTask are coroutines, which can access virtual memory with `co_await` and
+ * VAlloc::readAsync() or lockAsync(). If the data is not resident (see BaseVAlloc::isResident()), the task is
+ * suspended while other tasks continue, and the data is loaded in the background (see BaseVAlloc::prefetch()).
+ *
+ * Example:
+ * @code{.cpp}
+ * virtmem::VTask sumTask(virtmem::VPtr<int, SDVAlloc> values, int count, int *result)
+ * {
+ *     for (int i=0; i<count; ++i)
+ *         *result += *co_await sdvAlloc.readAsync(values + i);
+ * }
+ *
+ * virtmem::VTaskScheduler scheduler;
+ * scheduler.spawn(sumTask(values1, 100, &sum1));
+ * scheduler.spawn(sumTask(values2, 100, &sum2));
+ * scheduler.run();
+ * @endcode
+ *
+ * Tasks are started when they are given to VTaskScheduler::spawn(), and destroyed when they are finished.
+ * @note Coroutines are only available if @ref VIRTMEM_COROUTINES is defined.
+ */
+class VTask
+{
+public:
+    // \cond HIDDEN_SYMBOLS
+    struct promise_type
+    {
+        VTaskScheduler *scheduler;
+
+        promise_type(void) : scheduler(0) { }
+        VTask get_return_object(void) { return VTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend(void) noexcept { return std::suspend_always(); }
+        std::suspend_always final_suspend(void) noexcept { return std::suspend_always(); }
+        void return_void(void) { }
+        void unhandled_exception(void) { std::terminate(); }
+    };
+    typedef std::coroutine_handle<promise_type> Handle;
+    // \endcond
+
+private:
+    Handle handle;
+
+    explicit VTask(Handle h) : handle(h) { }
+
+    friend class VTaskScheduler;
+
+public:
+    VTask(VTask &&other) noexcept : handle(other.handle) { other.handle = nullptr; }
+    VTask(const VTask &) = delete;
+    VTask &operator=(const VTask &) = delete;
+    ~VTask(void) { if (handle) handle.destroy(); } //!< Destroys the task if it was not given to a scheduler.
+};
+
+namespace private_utils {
+
+// Common part of virtual memory awaitables: the task is suspended if the data is not resident
+class VAccessAwaiter
+{
+protected:
+    BaseVAlloc *alloc;
+    VPtrNum ptr; // zero for null and wrapped pointers
+    VPtrSize size;
+
+    VAccessAwaiter(BaseVAlloc *a, VPtrNum p, VPtrSize s) : alloc(a), ptr(p), size(s) { }
+
+    template <typename TV> static VPtrNum getAccessNum(const TV &p)
+    {
+#ifdef VIRTMEM_WRAP_CPOINTERS
+        if (p.isWrapped())
+            return 0;
+#endif
+        return p.getRawNum();
+    }
+
+public:
+    bool await_ready(void) const { return !ptr || alloc->isResident(ptr, size); }
+    inline void await_suspend(VTask::Handle h);
+};
+
+}
+
+/**
+ * @brief Awaitable returned by VAlloc::readAsync().
+ *
+ * The result of `co_await` is a pointer to the data, which (like BaseVAlloc::read()) is valid until
+ * the allocator is used again.
+ */
+template <typename T, typename Allocator>
+class VReadAwaiter : public private_utils::VAccessAwaiter
+{
+    VPtr<T, Allocator> vptr;
+
+public:
+    // \cond HIDDEN_SYMBOLS
+    VReadAwaiter(const VPtr<T, Allocator> &p, VPtrSize count) :
+        VAccessAwaiter(VPtr<T, Allocator>::getAlloc(), getAccessNum(p), count * sizeof(T)), vptr(p) { }
+
+    const T *await_resume(void) const
+    {
+#ifdef VIRTMEM_WRAP_CPOINTERS
+        if (vptr.isWrapped())
+            return static_cast<const T *>(vptr.unwrap());
+#endif
+        return (ptr) ? static_cast<const T *>(alloc->read(ptr, size)) : 0;
+    }
+    // \endcond
+};
+
+/**
+ * @brief Awaitable returned by lockAsync().
+ *
+ * The result of `co_await` is a VPtrLock to the data.
+ */
+template <typename TV>
+class VLockAwaiter : public private_utils::VAccessAwaiter
+{
+    TV vptr;
+    VirtPageSize lockSize;
+    bool readOnly;
+
+public:
+    // \cond HIDDEN_SYMBOLS
+    VLockAwaiter(const TV &p, VirtPageSize s, bool ro) :
+        VAccessAwaiter(TV::getAlloc(), getAccessNum(p), s), vptr(p), lockSize(s), readOnly(ro) { }
+
+    VPtrLock<TV> await_resume(void) const { return VPtrLock<TV>(vptr, lockSize, readOnly); }
+    // \endcond
+};
+
+/**
+ * @brief Creates a virtual lock from a coroutine, without blocking other tasks if the data is not resident.
+ *
+ * Example:
+ * @code{.cpp}
+ * virtmem::VPtrLock<virtmem::VPtr<char, SDVAlloc> > lock = co_await virtmem::lockAsync(buffer, 64);
+ * @endcode
+ * The parameters are the same as makeVirtPtrLock().
+ * @sa VTask, VAlloc::readAsync
+ */
+template <typename TV> VLockAwaiter<TV> lockAsync(const TV &p, VirtPageSize s, bool ro=false)
+{ return VLockAwaiter<TV>(p, s, ro); }
+
+/**
+ * @brief Single-threaded scheduler of coroutines (VTask) that access virtual memory.
+ *
+ * The scheduler runs tasks in rounds. Every round, all runnable tasks are resumed until they are finished or suspended
+ * because their data is not resident. The data of all suspended tasks is then loaded at once: ranges are sorted,
+ * and ranges in neighbouring *big* pages are combined, so that they are read by a single request (see
+ * BaseVAlloc::prefetch()). The suspended tasks are resumed in the next round, while the data is loaded in the
+ * background if the allocator supports asynchronous I/O (see BaseVAlloc::doReadAsync()).
+ *
+ * @note The data of a suspended task may be swapped out again before it's resumed if many tasks are waiting,
+ * in which case it's simply loaded on access. Therefore, the amount of tasks should be well below the amount of
+ * *big* pages.
+ * @note Data that crosses a *big* page boundary is always loaded on access.
+ * @sa VTask
+ */
+class VTaskScheduler
+{
+    enum { MAX_REQUEST_PAGES = 8 }; // maximum amount of pages loaded by BaseVAlloc::prefetch()
+
+    struct Miss
+    {
+        BaseVAlloc *alloc;
+        VPtrNum start;
+        VPtrSize size;
+
+        bool operator<(const Miss &other) const { return (alloc != other.alloc) ? (alloc < other.alloc) : (start < other.start); }
+    };
+
+    std::deque<VTask::Handle> ready;
+    std::vector<VTask::Handle> waiting;
+    std::vector<Miss> misses;
+    size_t taskCount;
+    uint32_t requestCount;
+
+    void resume(VTask::Handle h)
+    {
+        h.resume();
+        if (h.done())
+        {
+            h.destroy();
+            --taskCount;
+        }
+    }
+
+    void loadMisses(void)
+    {
+        std::sort(misses.begin(), misses.end());
+        for (size_t i=0; i<misses.size(); )
+        {
+            BaseVAlloc *alloc = misses[i].alloc;
+            const VPtrSize psize = alloc->getBigPageSize();
+            const VPtrNum start = misses[i].start;
+            VPtrNum end = start + misses[i].size;
+
+            // combine ranges that start in the same or the next page
+            size_t j = i + 1;
+            for (; j<misses.size() && misses[j].alloc == alloc && (misses[j].start / psize) <= ((end - 1) / psize + 1); ++j)
+            {
+                const VPtrNum e = std::max(end, misses[j].start + misses[j].size);
+                if (((e - 1) / psize - start / psize) >= MAX_REQUEST_PAGES)
+                    break;
+                end = e;
+            }
+
+            alloc->prefetch(start, end - start);
+            ++requestCount;
+            i = j;
+        }
+        misses.clear();
+    }
+
+public:
+    VTaskScheduler(void) : taskCount(0), requestCount(0) { }
+    VTaskScheduler(const VTaskScheduler &) = delete;
+    VTaskScheduler &operator=(const VTaskScheduler &) = delete;
+
+    //! Destroys all unfinished tasks.
+    ~VTaskScheduler(void)
+    {
+        for (size_t i=0; i<ready.size(); ++i)
+            ready[i].destroy();
+        for (size_t i=0; i<waiting.size(); ++i)
+            waiting[i].destroy();
+    }
+
+    /**
+     * @brief Adds a task to the scheduler.
+     * @param task The task, which is started by the next call to \ref runOnce() or \ref run().
+     */
+    void spawn(VTask &&task)
+    {
+        VTask::Handle h = task.handle;
+        task.handle = nullptr;
+        h.promise().scheduler = this;
+        ready.push_back(h);
+        ++taskCount;
+    }
+
+    // \cond HIDDEN_SYMBOLS
+    void addMiss(BaseVAlloc *alloc, VPtrNum p, VPtrSize size, VTask::Handle h)
+    {
+        const Miss miss = { alloc, p, size };
+        misses.push_back(miss);
+        waiting.push_back(h);
+    }
+    // \endcond
+
+    /**
+     * @brief Runs a single round: resumes all runnable tasks, and starts loading the data of suspended tasks.
+     * @return `true` if there are unfinished tasks.
+     */
+    bool runOnce(void)
+    {
+        while (!ready.empty())
+        {
+            const VTask::Handle h = ready.front();
+            ready.pop_front();
+            resume(h);
+        }
+
+        if (!waiting.empty())
+        {
+            loadMisses();
+            ready.insert(ready.end(), waiting.begin(), waiting.end());
+            waiting.clear();
+        }
+
+        return taskCount != 0;
+    }
+
+    //! Runs all tasks until they are finished.
+    void run(void) { while (runOnce()) ; }
+
+    size_t getTaskCount(void) const { return taskCount; } //!< Returns the amount of unfinished tasks.
+    //! Returns the amount of load requests (see BaseVAlloc::prefetch()) made for suspended tasks.
+    uint32_t getRequestCount(void) const { return requestCount; }
+};
+
+inline void private_utils::VAccessAwaiter::await_suspend(VTask::Handle h)
+{
+    ASSERT(h.promise().scheduler);
+    h.promise().scheduler->addMiss(alloc, ptr, size, h);
+}
+
+}
+
+#endif // VIRTMEM_COROUTINES
+
+#endif // VIRTMEM_VTASK_H
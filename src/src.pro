@@ -12,12 +12,14 @@ CONFIG += staticlib
 
 SOURCES += \
     base_alloc.cpp \
+    codec.cpp \
     utils.cpp \
 
 HEADERS += \
     virtmem-continued.h \
     internal/utils.h \
     internal/base_alloc.h \
+    internal/codec.h \
     config/config.h \
     alloc/stdio_alloc.h \
     internal/alloc.h \
@@ -28,6 +30,11 @@ HEADERS += \
     internal/vptr.h \
     internal/base_vptr.h \
     internal/vptr_utils.hpp \
+    internal/vobject_pool.h \
+    internal/varena.h \
+    internal/vhandle.h \
+    internal/valloc_group.h \
+    internal/vtask.h \
     alloc/serial_alloc.h \
     internal/serial_utils.h \
     internal/serial_utils.hpp
@@ -47,6 +54,8 @@ OTHER_FILES += \
     ../examples/alloc_properties/alloc_properties.ino \
     ../examples/locking/locking.ino
 
+include(features.pri)
+
 QMAKE_CXXFLAGS_RELEASE += -Os
 #QMAKE_CXXFLAGS_DEBUG += -Og
 QMAKE_CXXFLAGS +=  -std=gnu++11 -ffunction-sections -fdata-sections
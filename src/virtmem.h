@@ -5,6 +5,11 @@
 #include "internal/utils.h"
 #include "internal/vptr.h"
 #include "internal/vptr_utils.h"
+#include "internal/vobject_pool.h"
+#include "internal/varena.h"
+#include "internal/vhandle.h"
+#include "internal/valloc_group.h"
+#include "internal/vtask.h"
 
 /**
   @file
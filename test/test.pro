@@ -22,7 +22,10 @@ unix:!macx: PRE_TARGETDEPS += $$PWD/../src/libvirtmem.a
 
 INCLUDEPATH += ../gtest/gtest/include
 LIBS += -L$$PWD/../gtest/gtest/build -lgtest -lgtest_main
+include($$PWD/../src/features.pri)
 DEFINES += __STDC_FORMAT_MACROS
+# enable to include the large page test (src.pro must use the same setting)
+# DEFINES += VIRTMEM_LARGE_PAGES
 QMAKE_CXXFLAGS_RELEASE += -Os
 QMAKE_CXXFLAGS +=  -std=gnu++11 -pthread
 QMAKE_LFLAGS +=  -pthread
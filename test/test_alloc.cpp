@@ -1,9 +1,18 @@
 #include "virtmem-continued.h"
+#include "alloc/static_alloc.h"
 #include "alloc/stdio_alloc.h"
+#include "internal/codec.h"
 #include "test.h"
 
+#include <map>
 #include <vector>
 
+#ifdef VIRTMEM_CPP11
+#include <atomic>
+#include <chrono>
+#include <thread>
+#endif
+
 
 TEST_F(VAllocFixture, SimpleAllocTest)
 {
@@ -60,6 +69,32 @@ TEST_F(VAllocFixture, MultiAllocTest)
     }
 }
 
+TEST_F(VAllocFixture, FreeMergeTest)
+{
+    // orders in which three adjacent blocks are freed: merge with the lower, the higher and both neighbours
+    const int orders[3][3] = { { 0, 1, -1 }, { 1, 0, -1 }, { 0, 2, 1 } };
+    // NOTE: large enough so that the blocks are claimed from the pool one by one, hence they are adjacent
+    const VPtrSize size = 1000;
+
+    for (int o=0; o<3; ++o)
+    {
+        // the fourth block keeps the others away from the end of the pool
+        VPtrNum blocks[4];
+        for (int i=0; i<4; ++i)
+            blocks[i] = vAlloc.allocRaw(size);
+        const VPtrSize stride = blocks[1] - blocks[0];
+        ASSERT_EQ(blocks[2] - blocks[1], stride);
+        ASSERT_EQ(blocks[3] - blocks[2], stride);
+
+        int freed = 0;
+        for (; freed<3 && orders[o][freed] != -1; ++freed)
+            vAlloc.freeRaw(blocks[orders[o][freed]]);
+
+        // the merged block is used for an allocation that fits all freed blocks
+        EXPECT_EQ(vAlloc.allocRaw(stride * (freed - 1) + size), blocks[0]);
+    }
+}
+
 TEST_F(VAllocFixture, SimplePageTest)
 {
     EXPECT_EQ(vAlloc.getFreeBigPages(), vAlloc.getBigPageCount());
@@ -128,6 +163,31 @@ TEST_F(VAllocFixture, PageLockTest)
     EXPECT_EQ(vAlloc.getUnlockedMediumPages(), vAlloc.getMediumPageCount());
 }
 
+TEST_F(VAllocFixture, LockedReadWriteTest)
+{
+    const VPtrNum ptr = vAlloc.allocRaw(sizeof(int) * 2);
+    ASSERT_NE(ptr, 0);
+
+    // access page regularly first, so it's used by fast lookups
+    int val = 55;
+    vAlloc.write(ptr, &val, sizeof(val));
+    vAlloc.write(ptr + sizeof(int), &val, sizeof(val));
+    EXPECT_EQ(*(int *)vAlloc.read(ptr, sizeof(val)), val);
+
+    // data from a lock within the same page should be used now
+    int *lock = (int *)vAlloc.makeDataLock(ptr + sizeof(int), sizeof(int));
+    *lock = 66;
+    EXPECT_EQ(*(int *)vAlloc.read(ptr + sizeof(int), sizeof(int)), 66);
+    val = 77;
+    vAlloc.write(ptr + sizeof(int), &val, sizeof(val));
+    EXPECT_EQ(*lock, val);
+    EXPECT_EQ(*(int *)vAlloc.read(ptr, sizeof(int)), 55);
+
+    vAlloc.releaseLock(ptr + sizeof(int));
+    vAlloc.clearPages();
+    EXPECT_EQ(*(int *)vAlloc.read(ptr + sizeof(int), sizeof(int)), val);
+}
+
 TEST_F(VAllocFixture, LargeDataTest)
 {
     const VPtrSize size = 1024 * 1024 * 8; // 8 mb data block
@@ -194,3 +254,2110 @@ TEST_F(VAllocFixture, LargeRandomDataTest)
     }
 }
 
+
+template <uint8_t policy, bool grid=false> struct ManyPagesProperties
+{
+    static const uint8_t smallPageCount = 4, smallPageSize = 32;
+    static const uint8_t mediumPageCount = 4, mediumPageSize = 64;
+    static const uint8_t bigPageCount = 32, bigPageSize = 128;
+    static const uint8_t bigPagePolicy = policy;
+    static const bool bigPageGrid = grid;
+};
+
+// replacement policy of the tests of other features
+#ifdef VIRTMEM_PAGE_POLICIES
+enum { TEST_PAGE_POLICY = PAGE_POLICY_LRU };
+#else
+enum { TEST_PAGE_POLICY = PAGE_POLICY_FIFO };
+#endif
+
+template <typename> class ManyPagesFixture: public ::testing::Test { };
+
+#ifdef VIRTMEM_PAGE_POLICIES
+typedef ::testing::Types<ManyPagesProperties<PAGE_POLICY_FIFO>, ManyPagesProperties<PAGE_POLICY_LRU>,
+                         ManyPagesProperties<PAGE_POLICY_CLOCK>, ManyPagesProperties<PAGE_POLICY_2Q>,
+                         ManyPagesProperties<PAGE_POLICY_FIFO, true>, ManyPagesProperties<PAGE_POLICY_2Q, true> > PagePolicyTypes;
+#else
+typedef ::testing::Types<ManyPagesProperties<PAGE_POLICY_FIFO>, ManyPagesProperties<PAGE_POLICY_FIFO, true> > PagePolicyTypes;
+#endif
+TYPED_TEST_CASE(ManyPagesFixture, PagePolicyTypes);
+
+TYPED_TEST(ManyPagesFixture, RandomAccessTest)
+{
+    typedef StaticVAllocP<1024 * 64, TypeParam> Alloc;
+    Alloc alloc;
+    EXPECT_EQ(alloc.getBigPagePolicy(), (uint8_t)TypeParam::bigPagePolicy);
+    EXPECT_EQ(alloc.hasBigPageGrid(), (bool)TypeParam::bigPageGrid);
+    alloc.start();
+
+    const VPtrSize size = 1024 * 32;
+    const VPtrNum vbuffer = alloc.allocRaw(size);
+    std::vector<char> buffer(size, 0);
+    for (VPtrSize i=0; i<size; ++i)
+        alloc.write(vbuffer + i, &buffer[i], sizeof(char));
+
+    srand(::testing::UnitTest::GetInstance()->random_seed());
+    for (int i=0; i<20000; ++i)
+    {
+        const VPtrSize datasize = 1 + rand() % 16;
+        const VPtrSize index = rand() % (size - datasize);
+
+        if (rand() % 2)
+        {
+            for (VPtrSize j=0; j<datasize; ++j)
+                buffer[index + j] = rand();
+            alloc.write(vbuffer + index, &buffer[index], datasize);
+        }
+        else
+            ASSERT_EQ(memcmp(alloc.read(vbuffer + index, datasize), &buffer[index], datasize), 0);
+
+        if ((i % 1000) == 0)
+        {
+            // locks make big pages start at unaligned addresses
+            const VPtrNum lockp = vbuffer + (rand() % (size - alloc.getBigPageSize()));
+            alloc.makeDataLock(lockp, alloc.getBigPageSize(), true);
+            alloc.releaseLock(lockp);
+        }
+    }
+
+    alloc.clearPages();
+    for (VPtrSize i=0; i<size; ++i)
+        ASSERT_EQ(*(char *)alloc.read(vbuffer + i, sizeof(char)), buffer[i]);
+
+    alloc.stop();
+}
+
+#ifdef VIRTMEM_READ_AHEAD
+TYPED_TEST(ManyPagesFixture, ReadAheadTest)
+{
+    typedef StaticVAllocP<1024 * 64, TypeParam> Alloc;
+    Alloc alloc;
+    alloc.start();
+    alloc.setReadAheadDepth(4);
+
+    const VPtrSize size = 1024 * 32;
+    const VPtrNum vbuffer = alloc.allocRaw(size);
+    for (VPtrSize i=0; i<size; ++i)
+    {
+        const char c = (char)(i * 7);
+        alloc.write(vbuffer + i, &c, sizeof(c));
+    }
+    alloc.clearPages();
+
+    // sequential scan, with some writes so not all pages stay clean
+    for (VPtrSize i=0; i<size; ++i)
+    {
+        ASSERT_EQ(*(char *)alloc.read(vbuffer + i, sizeof(char)), (char)(i * 7));
+        if ((i % 1000) == 0)
+        {
+            const char c = (char)(i * 7);
+            alloc.write(vbuffer + i, &c, sizeof(c));
+        }
+    }
+
+    // backwards, strided scans
+    for (VPtrSize stride=1; stride<=3; ++stride)
+    {
+        const VPtrSize step = stride * alloc.getBigPageSize() + 3;
+        for (VPtrSize i=size-1; i>=step; i-=step)
+            ASSERT_EQ(*(char *)alloc.read(vbuffer + i, sizeof(char)), (char)(i * 7));
+    }
+
+    // read ahead pages must not hide modifications
+    for (VPtrSize i=0; i<size; i+=5)
+    {
+        const char c = (char)(i * 3);
+        alloc.write(vbuffer + i, &c, sizeof(c));
+    }
+    alloc.setReadAhead(false);
+    alloc.clearPages();
+    for (VPtrSize i=0; i<size; ++i)
+        ASSERT_EQ(*(char *)alloc.read(vbuffer + i, sizeof(char)), (char)(i * (((i % 5) == 0) ? 3 : 7)));
+
+    alloc.stop();
+}
+#endif
+
+// Allocator that keeps track of reads and writes to its (RAM) storage
+template <typename Properties> class CountingVAlloc : public VAlloc<Properties, CountingVAlloc<Properties> >
+{
+    enum { POOL_SIZE = 1024 * 16 };
+    char data[POOL_SIZE];
+
+    void doStart(void) { }
+    void doSuspend(void) { }
+    void doStop(void) { }
+    void doRead(void *d, VPtrSize offset, VPtrSize size) { memcpy(d, &data[offset], size); ++reads; }
+    void doWrite(const void *d, VPtrSize offset, VPtrSize size) { memcpy(&data[offset], d, size); ++writes; bytesWritten += size; }
+
+public:
+    uint32_t reads, writes, bytesWritten;
+
+    CountingVAlloc(void) : reads(0), writes(0), bytesWritten(0) { this->setPoolSize(POOL_SIZE); }
+    void resetCounters(void) { reads = writes = bytesWritten = 0; }
+    void fillPool(char c) { memset(data, c, POOL_SIZE); } // e.g. to simulate old data
+};
+
+#ifdef VIRTMEM_DIRTY_RANGES
+TEST(DirtyRangeTest, PartialWriteTest)
+{
+    typedef CountingVAlloc<ManyPagesProperties<TEST_PAGE_POLICY, true> > Alloc;
+    Alloc alloc;
+    alloc.start();
+
+    const VPtrSize size = 1024;
+    const VPtrNum vbuffer = alloc.allocRaw(size);
+    alloc.flush();
+    alloc.resetCounters();
+
+    // only modified bytes are written
+    const char c = 55;
+    alloc.write(vbuffer + 200, &c, sizeof(c));
+    alloc.write(vbuffer + 203, &c, sizeof(c));
+    alloc.flush();
+    EXPECT_EQ(alloc.writes, 1);
+    EXPECT_EQ(alloc.bytesWritten, 4);
+    EXPECT_EQ(*(char *)alloc.read(vbuffer + 203, sizeof(char)), c);
+
+    // sequential writes over multiple pages are merged
+    alloc.resetCounters();
+    for (VPtrSize i=0; i<size; ++i)
+    {
+        const char d = (char)i;
+        alloc.write(vbuffer + i, &d, sizeof(d));
+    }
+    alloc.flush();
+    EXPECT_EQ(alloc.bytesWritten, size);
+#ifdef VIRTMEM_READ_AHEAD
+    // only pages read ahead are loaded in adjacent frames
+    EXPECT_LT(alloc.writes, size / alloc.getBigPageSize());
+#endif
+
+    // locked data
+    alloc.resetCounters();
+    char *lock = (char *)alloc.makeDataLock(vbuffer + 10, 8);
+    lock[0] = 1;
+    alloc.releaseLock(vbuffer + 10);
+    alloc.flush();
+    EXPECT_LE(alloc.bytesWritten, 8);
+
+    alloc.clearPages();
+    EXPECT_EQ(*(char *)alloc.read(vbuffer + 10, sizeof(char)), 1);
+    for (VPtrSize i=11; i<size; ++i)
+        ASSERT_EQ(*(char *)alloc.read(vbuffer + i, sizeof(char)), (char)i);
+
+    alloc.stop();
+}
+#endif
+
+struct VictimCacheProperties
+{
+    static const uint8_t smallPageCount = 4, smallPageSize = 32;
+    static const uint8_t mediumPageCount = 4, mediumPageSize = 64;
+    static const uint8_t bigPageCount = 4, bigPageSize = 128;
+    static const bool bigPageGrid = true;
+#ifdef VIRTMEM_VICTIM_CACHE
+    static const uint16_t victimCacheSize = 512;
+#endif
+};
+
+TEST(VictimCacheTest, CodecTest)
+{
+    std::vector<uint8_t> data(1024), packed(1024 + 1024 / 128 + 1), unpacked(1024);
+    srand(1);
+    for (int i=0; i<50; ++i)
+    {
+        // mix of random data and runs of various lengths
+        for (size_t j=0; j<data.size(); )
+        {
+            const size_t n = std::min((size_t)(1 + rand() % 300), data.size() - j);
+            const bool run = (rand() % 2);
+            for (size_t k=0; k<n; ++k, ++j)
+                data[j] = (run) ? (uint8_t)n : (uint8_t)rand();
+        }
+
+        const uint32_t size = 1 + rand() % data.size();
+        const uint32_t csize = private_utils::rleCompress(&data[0], size, 0);
+        ASSERT_LE(csize, size + size / 128 + 1);
+        ASSERT_EQ(private_utils::rleCompress(&data[0], size, &packed[0]), csize);
+
+        // decode in random chunks, skipping some of them
+        private_utils::RLEDecoder decoder(&packed[0]);
+        for (uint32_t j=0; j<size; )
+        {
+            const uint32_t n = std::min((uint32_t)(1 + rand() % 200), size - j);
+            if (rand() % 4)
+            {
+                decoder.read(&unpacked[j], n);
+                for (uint32_t k=j; k<(j+n); ++k)
+                    ASSERT_EQ(unpacked[k], data[k]);
+            }
+            else
+                decoder.read(0, n);
+            j += n;
+        }
+    }
+
+    std::fill(data.begin(), data.end(), 0);
+    EXPECT_LE(private_utils::rleCompress(&data[0], data.size(), 0), data.size() / 128 * 2);
+}
+
+#ifdef VIRTMEM_VICTIM_CACHE
+TEST(VictimCacheTest, SwapTest)
+{
+    typedef CountingVAlloc<VictimCacheProperties> Alloc;
+    Alloc alloc;
+    alloc.start();
+    EXPECT_EQ(alloc.getVictimCacheSize(), (uint32_t)VictimCacheProperties::victimCacheSize);
+
+    // compressible data for more pages than fit in RAM
+    const VPtrSize size = alloc.getBigPageSize() * alloc.getBigPageCount() * 4;
+    const VPtrNum vbuffer = alloc.allocRaw(size);
+    for (VPtrSize i=0; i<size; ++i)
+    {
+        const char c = (char)(i / 64);
+        alloc.write(vbuffer + i, &c, sizeof(c));
+    }
+
+    // modified pages are only written when they are removed from the victim cache
+    EXPECT_LT(alloc.bytesWritten, size);
+    alloc.flush();
+    EXPECT_GE(alloc.bytesWritten, size);
+    alloc.resetCounters();
+
+    // the last pages should still be cached
+    for (VPtrSize i=size; i>0; --i)
+        ASSERT_EQ(*(char *)alloc.read(vbuffer + i - 1, sizeof(char)), (char)((i - 1) / 64));
+    EXPECT_EQ(alloc.writes, 0);
+    EXPECT_LT(alloc.reads, size / alloc.getBigPageSize() - alloc.getBigPageCount());
+
+    // locked data and data read after clearing pages must be up to date as well
+    char *lock = (char *)alloc.makeDataLock(vbuffer + 100, alloc.getSmallPageSize());
+    memset(lock, 55, alloc.getSmallPageSize());
+    alloc.releaseLock(vbuffer + 100);
+    for (VPtrSize i=0; i<size; i+=alloc.getBigPageSize())
+        alloc.write(vbuffer + i, &i, sizeof(char));
+    alloc.clearPages();
+    alloc.resetCounters();
+    for (VPtrSize i=0; i<size; ++i)
+    {
+        char expect = (char)(i / 64);
+        if ((i % alloc.getBigPageSize()) == 0)
+            expect = (char)i;
+        else if (i >= 100 && i < (VPtrSize)(100 + alloc.getSmallPageSize()))
+            expect = 55;
+        ASSERT_EQ(*(char *)alloc.read(vbuffer + i, sizeof(char)), expect);
+    }
+    EXPECT_GT(alloc.reads, 0); // victim cache was cleared as well
+
+    alloc.stop();
+}
+#endif
+
+struct ManyLocksProperties
+{
+    static const uint8_t smallPageCount = 16, smallPageSize = 16;
+    static const uint8_t mediumPageCount = 8, mediumPageSize = 64;
+    static const uint8_t bigPageCount = 16;
+    static const uint16_t bigPageSize = 256;
+};
+
+TEST(LockIntervalTest, ManyLocksTest)
+{
+    typedef StaticVAllocP<1024 * 16, ManyLocksProperties> Alloc;
+    Alloc alloc;
+    alloc.start();
+
+    const VPtrSize size = 1024 * 8;
+    const VPtrNum vbuffer = alloc.allocRaw(size);
+    ASSERT_NE(vbuffer, 0);
+
+    std::vector<char> mirror(size);
+    for (VPtrSize i=0; i<size; ++i)
+    {
+        mirror[i] = (char)i;
+        alloc.write(vbuffer + i, &mirror[i], sizeof(char));
+    }
+
+    // random (partially) overlapping locks, mixed with regular reads and writes
+    std::vector<VPtrNum> locks;
+    srand(1);
+    for (int i=0; i<5000; ++i)
+    {
+        const VPtrNum p = vbuffer + rand() % (size - alloc.getBigPageSize());
+        const int op = rand() % 4;
+        if (op == 0 && locks.size() < 12)
+        {
+            VirtPageSize lsize = 1 + rand() % alloc.getMediumPageSize();
+            char *data = (char *)alloc.makeFittingLock(p, lsize);
+            ASSERT_NE(data, (char *)0);
+            for (VirtPageSize j=0; j<lsize; ++j)
+            {
+                ASSERT_EQ(data[j], mirror[p - vbuffer + j]);
+                data[j] = mirror[p - vbuffer + j] = (char)rand();
+            }
+            locks.push_back(p);
+        }
+        else if (op == 1 && !locks.empty())
+        {
+            const size_t l = rand() % locks.size();
+            alloc.releaseLock(locks[l]);
+            locks.erase(locks.begin() + l);
+        }
+        else if (op == 2)
+        {
+            const VPtrSize rsize = 1 + rand() % 32;
+            const char *data = (const char *)alloc.read(p, rsize);
+            for (VPtrSize j=0; j<rsize; ++j)
+                ASSERT_EQ(data[j], mirror[p - vbuffer + j]);
+        }
+        else
+        {
+            char data[32];
+            const VPtrSize wsize = 1 + rand() % sizeof(data);
+            for (VPtrSize j=0; j<wsize; ++j)
+                data[j] = mirror[p - vbuffer + j] = (char)rand();
+            alloc.write(p, data, wsize);
+        }
+    }
+
+    for (size_t l=0; l<locks.size(); ++l)
+        alloc.releaseLock(locks[l]);
+    EXPECT_EQ(alloc.getUnlockedBigPages(), alloc.getBigPageCount());
+
+    alloc.clearPages();
+    for (VPtrSize i=0; i<size; ++i)
+        ASSERT_EQ(*(char *)alloc.read(vbuffer + i, sizeof(char)), mirror[i]);
+
+    alloc.stop();
+}
+
+struct SizeClassProperties
+{
+    static const uint8_t smallPageCount = 4, smallPageSize = 32;
+    static const uint8_t mediumPageCount = 4, mediumPageSize = 64;
+    static const uint8_t bigPageCount = 4, bigPageSize = 128;
+#ifdef VIRTMEM_SIZE_CLASSES
+    static const uint8_t sizeClassCount = 16, sizeClassDepth = 4;
+#endif
+};
+
+TEST(SizeClassTest, RandomAllocTest)
+{
+    typedef CountingVAlloc<SizeClassProperties> Alloc;
+    Alloc alloc;
+    alloc.start();
+
+    // blocks of random sizes with a known content
+    std::map<VPtrNum, VPtrSize> blocks;
+    srand(1);
+    for (int i=0; i<3000; ++i)
+    {
+        if (blocks.size() < 40 && (blocks.empty() || (rand() % 2)))
+        {
+            const VPtrSize size = 1 + rand() % 160;
+            const VPtrNum p = alloc.allocRaw(size);
+            ASSERT_NE(p, 0);
+
+            std::map<VPtrNum, VPtrSize>::iterator it = blocks.lower_bound(p);
+            if (it != blocks.end())
+            {
+                ASSERT_LE(p + size, it->first);
+            }
+            if (it != blocks.begin())
+            {
+                --it;
+                ASSERT_LE(it->first + it->second, p);
+            }
+
+            for (VPtrSize j=0; j<size; ++j)
+            {
+                const char c = (char)(p + j);
+                alloc.write(p + j, &c, sizeof(c));
+            }
+            blocks[p] = size;
+        }
+        else
+        {
+            std::map<VPtrNum, VPtrSize>::iterator it = blocks.begin();
+            std::advance(it, rand() % blocks.size());
+            for (VPtrSize j=0; j<it->second; ++j)
+                ASSERT_EQ(*(char *)alloc.read(it->first + j, sizeof(char)), (char)(it->first + j));
+            alloc.freeRaw(it->first);
+            blocks.erase(it);
+        }
+    }
+
+    alloc.stop();
+}
+
+#ifdef VIRTMEM_SIZE_CLASSES
+TEST(SizeClassTest, ReuseTest)
+{
+    typedef CountingVAlloc<SizeClassProperties> Alloc;
+    Alloc alloc;
+    alloc.start();
+
+    // large blocks, each followed by a small one
+    // NOTE: small size is chosen such that blocks are not split from a larger free block
+    const VPtrSize smallsize = 15 * 16 - 1, largesize = 1024 * 4;
+    std::vector<VPtrNum> small, large;
+    for (int i=0; i<3; ++i)
+    {
+        large.push_back(alloc.allocRaw(largesize));
+        small.push_back(alloc.allocRaw(smallsize));
+    }
+
+    // freed blocks of a size class are reused without searching the free list
+    alloc.freeRaw(small[0]);
+    alloc.clearPages();
+    alloc.resetCounters();
+    EXPECT_EQ(alloc.allocRaw(smallsize), small[0]);
+    EXPECT_EQ(alloc.reads, 0);
+
+    // the small blocks are kept in their size class and separate the large ones: the free list
+    // only contains a large enough block when the small blocks are returned to it
+    for (int i=0; i<3; ++i)
+    {
+        alloc.freeRaw(small[i]);
+        alloc.freeRaw(large[i]);
+    }
+    EXPECT_NE(alloc.allocRaw(largesize * 3), 0);
+
+    alloc.stop();
+}
+
+TEST(SizeClassTest, FreeTest)
+{
+    typedef CountingVAlloc<SizeClassProperties> Alloc;
+    Alloc alloc;
+    alloc.start();
+
+    // recently allocated blocks of the size classes are freed without reading their header
+    VPtrNum blocks[4];
+    for (int i=0; i<4; ++i)
+        blocks[i] = alloc.allocRaw(16 + i * 16);
+    alloc.clearPages();
+    alloc.resetCounters();
+    for (int i=0; i<4; ++i)
+        alloc.freeRaw(blocks[i]);
+    EXPECT_EQ(alloc.reads, 0);
+    for (int i=0; i<4; ++i)
+        EXPECT_EQ(alloc.allocRaw(16 + i * 16), blocks[i]);
+
+    // the size of a resized block is read from its header
+    EXPECT_EQ(alloc.reallocRaw(blocks[0], 8), blocks[0]);
+    alloc.clearPages();
+    alloc.resetCounters();
+    alloc.freeRaw(blocks[0]);
+    EXPECT_GT(alloc.reads, 0);
+    EXPECT_EQ(alloc.allocRaw(16), blocks[0]);
+
+    alloc.stop();
+}
+#endif
+
+TEST(ReallocTest, InPlaceTest)
+{
+    typedef CountingVAlloc<ManyPagesProperties<TEST_PAGE_POLICY, true> > Alloc;
+    Alloc alloc;
+    alloc.start();
+
+    VPtr<char, Alloc> a = alloc.alloc<char>(100);
+    VPtr<char, Alloc> b = alloc.alloc<char>(200);
+    VPtr<char, Alloc> c = alloc.alloc<char>(100);
+    for (int i=0; i<100; ++i)
+        a[i] = (char)i;
+
+    // grow into the adjacent free block
+    const VPtrNum ptr = a.getRawNum();
+    alloc.free(b);
+    a = alloc.realloc(a, 250);
+    EXPECT_EQ(a.getRawNum(), ptr);
+
+    // shrink, the freed end of the block is used again
+    a = alloc.realloc(a, 50);
+    EXPECT_EQ(a.getRawNum(), ptr);
+    b = alloc.alloc<char>(150);
+    EXPECT_GT(b.getRawNum(), ptr);
+    EXPECT_LT(b.getRawNum(), ptr + 300);
+
+    for (int i=0; i<50; ++i)
+        ASSERT_EQ(a[i], (char)i);
+
+    // grow at the end of the used memory pool (NOTE: no free block is large enough, so it's placed there)
+    VPtr<char, Alloc> d = alloc.alloc<char>(1000);
+    const VPtrNum dptr = d.getRawNum();
+    d = alloc.realloc(d, 4000);
+    EXPECT_EQ(d.getRawNum(), dptr);
+
+    // no space: move
+    alloc.clearPages();
+    alloc.resetCounters();
+    a = alloc.realloc(a, 1000);
+    EXPECT_NE(a.getRawNum(), ptr);
+    for (int i=0; i<50; ++i)
+        ASSERT_EQ(a[i], (char)i);
+
+    alloc.free(a); alloc.free(b); alloc.free(c); alloc.free(d);
+    EXPECT_EQ(alloc.realloc(alloc.realloc(VPtr<char, Alloc>(), 10), 0).getRawNum(), 0);
+    alloc.stop();
+}
+
+template <typename Properties> void reallocRandomTest(void)
+{
+    typedef CountingVAlloc<Properties> Alloc;
+    Alloc alloc;
+    alloc.start();
+
+    // blocks with their size and a content seed
+    std::map<VPtrNum, std::pair<VPtrSize, char> > blocks;
+    srand(3);
+    for (int i=0; i<2000; ++i)
+    {
+        const int action = rand() % 3;
+        if (blocks.size() < 20 && (blocks.empty() || action == 0))
+        {
+            const VPtrSize size = 1 + rand() % 400;
+            const VPtrNum p = alloc.allocRaw(size);
+            for (VPtrSize j=0; j<size; ++j)
+            {
+                const char c = (char)(i + j);
+                alloc.write(p + j, &c, sizeof(c));
+            }
+            blocks[p] = std::make_pair(size, (char)i);
+        }
+        else
+        {
+            typename std::map<VPtrNum, std::pair<VPtrSize, char> >::iterator it = blocks.begin();
+            std::advance(it, rand() % blocks.size());
+            VPtrNum p = it->first;
+            VPtrSize size = it->second.first;
+            const char seed = it->second.second;
+            blocks.erase(it);
+
+            if (action == 1)
+            {
+                // resize, modified data of the old block may still be in the page cache
+                const VPtrSize newsize = 1 + rand() % 800;
+                p = alloc.reallocRaw(p, newsize);
+                for (VPtrSize j=size; j<newsize; ++j)
+                {
+                    const char c = (char)(seed + j);
+                    alloc.write(p + j, &c, sizeof(c));
+                }
+                size = newsize;
+                blocks[p] = std::make_pair(size, seed);
+            }
+
+            for (VPtrSize j=0; j<size; ++j)
+                ASSERT_EQ(*(char *)alloc.read(p + j, sizeof(char)), (char)(seed + j));
+
+            if (action != 1)
+                alloc.freeRaw(p);
+        }
+    }
+
+    alloc.stop();
+}
+
+TEST(ReallocTest, RandomTest)
+{
+    reallocRandomTest<ManyPagesProperties<TEST_PAGE_POLICY, true> >();
+    reallocRandomTest<VictimCacheProperties>();
+    reallocRandomTest<SizeClassProperties>();
+}
+
+TEST(AlignedAllocTest, RandomAllocTest)
+{
+    typedef CountingVAlloc<ManyPagesProperties<TEST_PAGE_POLICY, true> > Alloc;
+    Alloc alloc;
+    alloc.start();
+
+    const VPtrSize pagesize = alloc.getBigPageSize();
+    std::map<VPtrNum, VPtrSize> blocks;
+    srand(4);
+    for (int i=0; i<2000; ++i)
+    {
+        if (blocks.size() < 20 && (blocks.empty() || (rand() % 2)))
+        {
+            const VPtrSize size = 1 + rand() % 300;
+            VPtrNum p;
+            switch (rand() % 3)
+            {
+            case 0: p = alloc.allocRaw(size); break;
+            case 1:
+            {
+                const VPtrSize alignment = 16 << (rand() % 5);
+                p = alloc.allocAligned(size, alignment);
+                ASSERT_EQ(p % alignment, 0);
+                break;
+            }
+            default:
+                p = alloc.allocNoStraddle(size);
+                if (size > pagesize)
+                    ASSERT_EQ(p % pagesize, 0);
+                else
+                    ASSERT_EQ(p / pagesize, (p + size - 1) / pagesize);
+                break;
+            }
+
+            std::map<VPtrNum, VPtrSize>::iterator it = blocks.lower_bound(p);
+            if (it != blocks.end())
+            {
+                ASSERT_LE(p + size, it->first);
+            }
+            if (it != blocks.begin())
+            {
+                --it;
+                ASSERT_LE(it->first + it->second, p);
+            }
+
+            for (VPtrSize j=0; j<size; ++j)
+            {
+                const char c = (char)(p + j);
+                alloc.write(p + j, &c, sizeof(c));
+            }
+            blocks[p] = size;
+        }
+        else
+        {
+            std::map<VPtrNum, VPtrSize>::iterator it = blocks.begin();
+            std::advance(it, rand() % blocks.size());
+            for (VPtrSize j=0; j<it->second; ++j)
+                ASSERT_EQ(*(char *)alloc.read(it->first + j, sizeof(char)), (char)(it->first + j));
+            alloc.freeRaw(it->first);
+            blocks.erase(it);
+        }
+    }
+
+    alloc.stop();
+}
+
+TEST(AlignedAllocTest, NoStraddleLockTest)
+{
+    typedef CountingVAlloc<ManyPagesProperties<TEST_PAGE_POLICY, true> > Alloc;
+    Alloc alloc;
+    alloc.start();
+
+    // page sized buffers start at a page boundary
+    VPtr<char, Alloc> buf = alloc.allocNoStraddle<char>(alloc.getBigPageSize());
+    EXPECT_EQ(buf.getRawNum() % alloc.getBigPageSize(), 0);
+
+    // objects can be locked as a whole
+    for (int i=0; i<20; ++i)
+    {
+        const VPtrNum p = alloc.allocNoStraddle(100);
+        VirtPageSize size = 100;
+        alloc.makeFittingLock(p, size);
+        EXPECT_EQ(size, 100);
+        alloc.releaseLock(p);
+    }
+
+    alloc.free(buf);
+    alloc.stop();
+}
+
+struct PoolObject
+{
+    uint32_t values[3]; // NOTE: size is not a divisor of the page size
+    uint8_t pad[6];
+};
+
+TEST(ObjectPoolTest, RandomAllocTest)
+{
+    typedef CountingVAlloc<SizeClassProperties> Alloc;
+    typedef VObjectPool<PoolObject, Alloc, 20, 8> Pool;
+    Alloc alloc;
+    alloc.start();
+
+    Pool pool;
+    std::map<VPtrNum, uint32_t> objects;
+    srand(2);
+    for (int i=0; i<3000; ++i)
+    {
+        if (objects.size() < 100 && (objects.empty() || (rand() % 2)))
+        {
+            Pool::Ptr p = pool.alloc();
+            ASSERT_NE(p.getRawNum(), 0);
+            ASSERT_EQ(objects.count(p.getRawNum()), 0);
+
+            // objects never cross a (grid aligned) big page boundary
+            const VPtrNum start = p.getRawNum();
+            ASSERT_EQ(start / alloc.getBigPageSize(), (start + sizeof(PoolObject) - 1) / alloc.getBigPageSize());
+
+            p->values[0] = p->values[2] = i;
+            objects[start] = i;
+        }
+        else
+        {
+            std::map<VPtrNum, uint32_t>::iterator it = objects.begin();
+            std::advance(it, rand() % objects.size());
+            Pool::Ptr p;
+            p.setRawNum(it->first);
+            ASSERT_EQ(p->values[0], it->second);
+            ASSERT_EQ(p->values[2], it->second);
+            pool.free(p);
+            EXPECT_EQ(p.getRawNum(), 0);
+            objects.erase(it);
+        }
+        ASSERT_EQ(pool.getUsed(), objects.size());
+        ASSERT_LE(pool.getUsed(), pool.getCapacity());
+    }
+
+    pool.clear();
+    EXPECT_EQ(pool.getSlabCount(), 0);
+    alloc.stop();
+}
+
+TEST(ObjectPoolTest, SlabTest)
+{
+    typedef CountingVAlloc<SizeClassProperties> Alloc;
+    typedef VObjectPool<PoolObject, Alloc, 10, 4> Pool;
+    Alloc alloc;
+    alloc.start();
+
+    Pool pool;
+    std::vector<Pool::Ptr> objects;
+    for (int i=0; i<40; ++i)
+        objects.push_back(pool.newClass());
+    EXPECT_EQ(pool.getSlabCount(), 4);
+    EXPECT_EQ(pool.getCapacity(), 40);
+
+    // pool is full
+    EXPECT_EQ(pool.alloc().getRawNum(), 0);
+
+    // freed objects are reused
+    const VPtrNum p = objects[15].getRawNum();
+    pool.deleteClass(objects[15]);
+    EXPECT_EQ(pool.alloc().getRawNum(), p);
+
+    // only one empty slab is kept
+    for (int i=0; i<10; ++i)
+    {
+        pool.free(objects[i]);
+        pool.free(objects[20 + i]);
+    }
+    EXPECT_EQ(pool.getSlabCount(), 3);
+    EXPECT_EQ(pool.getUsed(), 20);
+
+    pool.clear();
+    alloc.stop();
+}
+
+TEST(ArenaTest, ResetTest)
+{
+    typedef CountingVAlloc<ManyPagesProperties<TEST_PAGE_POLICY, true> > Alloc;
+    Alloc alloc;
+    alloc.start();
+
+    VArena<Alloc, 8> arena(1024);
+    std::vector<VPtrNum> blocks;
+    for (int i=0; i<100; ++i)
+    {
+        const VPtrNum p = arena.allocRaw(20);
+        ASSERT_NE(p, 0);
+        ASSERT_EQ(p % 8, 0);
+        blocks.push_back(p);
+    }
+    const VPtrNum large = arena.allocRaw(2000);
+    ASSERT_NE(large, 0);
+    EXPECT_EQ(arena.getChunkCount(), 4);
+    EXPECT_EQ(arena.getUsed(), 100 * 24 + 2000);
+
+    alloc.flush();
+    alloc.resetCounters();
+    for (int i=0; i<100; ++i)
+        alloc.write(blocks[i], &i, sizeof(i));
+    for (int i=0; i<100; ++i)
+        ASSERT_EQ(*(int *)alloc.read(blocks[i], sizeof(int)), i);
+
+    // modified arena data is never written, only headers of the free list
+    arena.reset();
+    alloc.flush();
+#ifdef VIRTMEM_DIRTY_RANGES
+    EXPECT_LT(alloc.bytesWritten, 100 * sizeof(int));
+#endif
+    EXPECT_EQ(arena.getChunkCount(), 0);
+    EXPECT_EQ(arena.getUsed(), 0);
+
+    // released memory is reused
+    const VPtrNum p = arena.allocRaw(20);
+    EXPECT_GE(p, blocks[0]);
+    EXPECT_LT(p, large + 2000);
+    arena.reset();
+
+    alloc.stop();
+}
+
+TEST(ArenaTest, DiscardRangeTest)
+{
+    typedef CountingVAlloc<ManyPagesProperties<TEST_PAGE_POLICY, true> > Alloc;
+    Alloc alloc;
+    alloc.start();
+
+    const VPtrSize size = 1024;
+    const VPtrNum vbuffer = alloc.allocRaw(size);
+    for (VPtrSize i=0; i<size; ++i)
+    {
+        const char c = (char)i;
+        alloc.write(vbuffer + i, &c, sizeof(c));
+    }
+    alloc.flush();
+
+    // discarded modifications are not written, data outside the range is kept
+    for (VPtrSize i=0; i<size; ++i)
+    {
+        const char c = 1;
+        alloc.write(vbuffer + i, &c, sizeof(c));
+    }
+    alloc.resetCounters();
+    alloc.discardRange(vbuffer + 100, 500);
+    alloc.flush();
+#ifdef VIRTMEM_DIRTY_RANGES
+    EXPECT_EQ(alloc.bytesWritten, size - 500);
+#endif
+
+    alloc.clearPages();
+    for (VPtrSize i=0; i<size; ++i)
+    {
+#ifndef VIRTMEM_DIRTY_RANGES
+        if (i >= 100 && i < 600)
+            continue; // pages that are partially discarded are written completely
+#endif
+        ASSERT_EQ(*(char *)alloc.read(vbuffer + i, sizeof(char)), (i >= 100 && i < 600) ? (char)i : 1);
+    }
+
+    alloc.stop();
+}
+
+TEST(MoveRawTest, OverlapTest)
+{
+    typedef CountingVAlloc<VictimCacheProperties> Alloc;
+    Alloc alloc;
+    alloc.start();
+
+    const VPtrSize size = 2048;
+    const VPtrNum vbuffer = alloc.allocRaw(size);
+    std::vector<char> mirror(size);
+    for (VPtrSize j=0; j<size; ++j)
+        alloc.write(vbuffer + j, &mirror[j], sizeof(char));
+    srand(5);
+    for (int i=0; i<50; ++i)
+    {
+        // modify some data, so pages are dirty or in the victim cache
+        for (int j=0; j<100; ++j)
+        {
+            const VPtrSize k = rand() % size;
+            mirror[k] = (char)rand();
+            alloc.write(vbuffer + k, &mirror[k], sizeof(char));
+        }
+
+        const VPtrSize n = 1 + rand() % 700, src = rand() % (size - n), dest = rand() % (size - n);
+        alloc.moveRaw(vbuffer + dest, vbuffer + src, n);
+        memmove(&mirror[dest], &mirror[src], n);
+
+        for (VPtrSize j=0; j<size; ++j)
+            ASSERT_EQ(*(char *)alloc.read(vbuffer + j, sizeof(char)), mirror[j]);
+    }
+
+    alloc.clearPages();
+    for (VPtrSize j=0; j<size; ++j)
+        ASSERT_EQ(*(char *)alloc.read(vbuffer + j, sizeof(char)), mirror[j]);
+
+    alloc.stop();
+}
+
+TEST(HandleHeapTest, CompactTest)
+{
+    typedef CountingVAlloc<ManyPagesProperties<TEST_PAGE_POLICY, true> > Alloc;
+    typedef VHandleHeap<Alloc, 32> Heap;
+    typedef VHandle<int, Heap> Handle;
+    Alloc alloc;
+    alloc.start();
+
+    Heap heap(512);
+    std::map<uint16_t, std::pair<VPtrSize, int> > blocks; // handle index: size, seed
+    srand(6);
+    for (int i=0; i<3000; ++i)
+    {
+        const int action = rand() % 4;
+        if (action < 2 && blocks.size() < 32)
+        {
+            const VPtrSize count = 1 + rand() % 40;
+            Handle h = heap.alloc<int>(count * sizeof(int));
+            ASSERT_FALSE(h.isNull());
+            for (VPtrSize j=0; j<count; ++j)
+                h.get()[j] = i + j;
+            blocks[h.getIndex()] = std::make_pair(count, i);
+        }
+        else if (action == 2 && !blocks.empty())
+        {
+            std::map<uint16_t, std::pair<VPtrSize, int> >::iterator it = blocks.begin();
+            std::advance(it, rand() % blocks.size());
+            Handle h(&heap, it->first);
+            for (VPtrSize j=0; j<it->second.first; ++j)
+                ASSERT_EQ((int)h.get()[j], it->second.second + (int)j);
+            heap.free(h);
+            EXPECT_TRUE(h.isNull());
+            blocks.erase(it);
+        }
+        else
+            heap.compactStep(64);
+    }
+
+    // blocks are moved together and only the handles know where they are
+    heap.compact();
+    EXPECT_EQ(heap.getGapSize(), 0);
+    for (std::map<uint16_t, std::pair<VPtrSize, int> >::iterator it=blocks.begin(); it!=blocks.end(); ++it)
+    {
+        Handle h(&heap, it->first);
+        for (VPtrSize j=0; j<it->second.first; ++j)
+            ASSERT_EQ((int)h.get()[j], it->second.second + (int)j);
+    }
+
+    // grown region is shrunk again
+    const VPtrSize regionsize = heap.getRegionSize();
+    EXPECT_GT(regionsize, 512);
+    while (blocks.size() > 1)
+    {
+        heap.freeRaw(blocks.begin()->first);
+        blocks.erase(blocks.begin());
+    }
+    heap.compact();
+    EXPECT_LT(heap.getRegionSize(), regionsize);
+
+    heap.clear();
+    alloc.stop();
+}
+
+// Allocator of which reallocRaw() can be made to fail, as if it runs out of memory (which asserts in debug builds)
+template <typename Properties> struct ReallocFailVAlloc : public CountingVAlloc<Properties>
+{
+    bool failRealloc;
+
+    ReallocFailVAlloc(void) : failRealloc(false) { }
+    VPtrNum reallocRaw(VPtrNum ptr, VPtrSize size)
+    { return (failRealloc) ? 0 : CountingVAlloc<Properties>::reallocRaw(ptr, size); }
+};
+
+TEST(HandleHeapTest, GrowFailTest)
+{
+    typedef ReallocFailVAlloc<ManyPagesProperties<TEST_PAGE_POLICY, true> > Alloc;
+    typedef VHandleHeap<Alloc, 8> Heap;
+    Alloc alloc;
+    alloc.start();
+
+    // the region can't be allocated
+    Heap heap(64);
+    alloc.failRealloc = true;
+    EXPECT_EQ(heap.allocRaw(64), 0);
+    EXPECT_EQ(heap.getRegionSize(), 0);
+    alloc.failRealloc = false;
+
+    const uint16_t first = heap.allocRaw(64);
+    ASSERT_NE(first, 0);
+    const VPtrNum firstptr = heap.getRaw(first);
+    const char c = 'a';
+    alloc.write(firstptr, &c, sizeof(c));
+
+    // the region can't be grown: the heap is unchanged
+    alloc.failRealloc = true;
+    EXPECT_EQ(heap.allocRaw(1024), 0);
+    EXPECT_EQ(heap.getRegionSize(), 64);
+    EXPECT_EQ(heap.getUsed(), 64);
+    EXPECT_EQ(heap.getRaw(first), firstptr);
+    alloc.failRealloc = false;
+
+    const uint16_t second = heap.allocRaw(1024);
+    ASSERT_NE(second, 0);
+    EXPECT_EQ(heap.getRaw(second), heap.getRaw(first) + 64);
+    EXPECT_EQ(*(const char *)alloc.read(heap.getRaw(first), sizeof(char)), c);
+
+    // the region can't be shrunk after compaction: it's kept
+    heap.freeRaw(second);
+    const VPtrSize regionsize = heap.getRegionSize();
+    alloc.failRealloc = true;
+    heap.compact();
+    EXPECT_EQ(heap.getRegionSize(), regionsize);
+    EXPECT_EQ(*(const char *)alloc.read(heap.getRaw(first), sizeof(char)), c);
+    alloc.failRealloc = false;
+
+    heap.clear();
+    alloc.stop();
+}
+
+#ifdef VIRTMEM_BUDDY_ALLOC
+struct BuddyProperties
+{
+    static const uint8_t smallPageCount = 4, smallPageSize = 32;
+    static const uint8_t mediumPageCount = 4, mediumPageSize = 64;
+    static const uint8_t bigPageCount = 4, bigPageSize = 128;
+    static const bool bigPageGrid = true;
+    static const uint8_t allocEngine = ALLOC_ENGINE_BUDDY;
+    static const uint32_t buddyMinSize = 16, buddyBlockCount = 1024;
+};
+
+TEST(BuddyTest, RandomAllocTest)
+{
+    typedef CountingVAlloc<BuddyProperties> Alloc;
+    Alloc alloc;
+    EXPECT_FALSE(alloc.setPersistent(true)); // the buddy tree is not stored in the pool
+    EXPECT_FALSE(alloc.isPersistent());
+    alloc.start();
+    EXPECT_EQ(alloc.getAllocEngine(), ALLOC_ENGINE_BUDDY);
+
+    // blocks with their size and a content seed
+    std::map<VPtrNum, std::pair<VPtrSize, char> > blocks;
+    srand(4);
+    for (int i=0; i<3000; ++i)
+    {
+        const int action = rand() % 3;
+        if (blocks.size() < 16 && (blocks.empty() || action == 0))
+        {
+            const VPtrSize size = 1 + rand() % 300;
+            const VPtrNum p = alloc.allocRaw(size);
+            ASSERT_NE(p, 0);
+
+            // blocks are aligned to their size (rounded to a power of two), hence never cross a big page
+            VPtrSize bsize = BuddyProperties::buddyMinSize;
+            while (bsize < size)
+                bsize *= 2;
+            ASSERT_EQ(p % bsize, 0);
+            if (size <= alloc.getBigPageSize())
+            {
+                ASSERT_EQ(p / alloc.getBigPageSize(), (p + size - 1) / alloc.getBigPageSize());
+            }
+
+            std::map<VPtrNum, std::pair<VPtrSize, char> >::iterator it = blocks.lower_bound(p);
+            if (it != blocks.end())
+            {
+                ASSERT_LE(p + size, it->first);
+            }
+            if (it != blocks.begin())
+            {
+                --it;
+                ASSERT_LE(it->first + it->second.first, p);
+            }
+
+            for (VPtrSize j=0; j<size; ++j)
+            {
+                const char c = (char)(i + j);
+                alloc.write(p + j, &c, sizeof(c));
+            }
+            blocks[p] = std::make_pair(size, (char)i);
+        }
+        else
+        {
+            std::map<VPtrNum, std::pair<VPtrSize, char> >::iterator it = blocks.begin();
+            std::advance(it, rand() % blocks.size());
+            VPtrNum p = it->first;
+            VPtrSize size = it->second.first;
+            const char seed = it->second.second;
+            blocks.erase(it);
+
+            if (action == 1)
+            {
+                const VPtrSize newsize = 1 + rand() % 300;
+                p = alloc.reallocRaw(p, newsize);
+                for (VPtrSize j=size; j<newsize; ++j)
+                {
+                    const char c = (char)(seed + j);
+                    alloc.write(p + j, &c, sizeof(c));
+                }
+                size = newsize;
+                blocks[p] = std::make_pair(size, seed);
+            }
+
+            for (VPtrSize j=0; j<size; ++j)
+                ASSERT_EQ(*(char *)alloc.read(p + j, sizeof(char)), (char)(seed + j));
+
+            if (action != 1)
+                alloc.freeRaw(p);
+        }
+    }
+
+    // all blocks should be merged again: only the (reserved) first half contains the start of the pool
+    for (std::map<VPtrNum, std::pair<VPtrSize, char> >::iterator it=blocks.begin(); it!=blocks.end(); ++it)
+        alloc.freeRaw(it->first);
+    EXPECT_EQ(alloc.allocRaw(8 * 1024), 8 * 1024);
+
+    alloc.stop();
+}
+
+TEST(BuddyTest, ReallocTest)
+{
+    typedef CountingVAlloc<BuddyProperties> Alloc;
+    Alloc alloc;
+    alloc.start();
+
+    // the first block of 1024 bytes follows the start of the pool, the second is the first half of a 2048 byte block
+    EXPECT_EQ(alloc.allocRaw(1024), 1024);
+    const VPtrNum p = alloc.allocRaw(1024);
+    ASSERT_EQ(p, 2048);
+    for (VPtrSize i=0; i<1024; ++i)
+    {
+        const char c = (char)i;
+        alloc.write(p + i, &c, sizeof(c));
+    }
+
+    // shrink and grow in place
+    EXPECT_EQ(alloc.reallocRaw(p, 100), p);
+    const VPtrNum half = alloc.allocRaw(512);
+    EXPECT_EQ(half, 512);
+    EXPECT_EQ(alloc.allocRaw(512), p + 512); // freed second half
+    alloc.freeRaw(p + 512);
+    alloc.freeRaw(half);
+    EXPECT_EQ(alloc.reallocRaw(p, 1000), p);
+    EXPECT_EQ(alloc.reallocRaw(p, 2048), p);
+
+    // moved: block is a second half
+    const VPtrNum newp = alloc.reallocRaw(p, 3000);
+    EXPECT_EQ(newp, 4096);
+    for (VPtrSize i=0; i<100; ++i)
+        ASSERT_EQ(*(char *)alloc.read(newp + i, sizeof(char)), (char)i);
+    EXPECT_EQ(alloc.allocRaw(2048), 2048); // old block was freed
+
+    alloc.stop();
+}
+#endif
+
+TEST(AllocNearTest, HoleTest)
+{
+    typedef CountingVAlloc<ManyPagesProperties<TEST_PAGE_POLICY, true> > Alloc;
+    Alloc alloc;
+    alloc.start();
+
+    // leave holes in used memory, so that the free list contains blocks all over the pool
+    VPtrNum blocks[200];
+    for (int i=0; i<200; ++i)
+        blocks[i] = alloc.allocRaw(40);
+    for (int i=0; i<200; i+=2)
+        alloc.freeRaw(blocks[i]);
+
+    // a regular allocation uses the first fitting block, allocNear() one that is close to the hint
+    for (int i=51; i<200; i+=10)
+    {
+        const VPtrNum p = alloc.allocNear(blocks[i], 40);
+        EXPECT_LE((p > blocks[i]) ? (p - blocks[i]) : (blocks[i] - p), alloc.getBigPageSize());
+        const char c = (char)i;
+        alloc.write(p, &c, sizeof(c));
+        blocks[i - 1] = p;
+    }
+
+    // surrounding blocks were not affected
+    for (int i=51; i<200; i+=10)
+    {
+        EXPECT_EQ(*(char *)alloc.read(blocks[i - 1], sizeof(char)), (char)i);
+        alloc.freeRaw(blocks[i - 1]);
+        alloc.freeRaw(blocks[i]);
+    }
+
+    alloc.stop();
+}
+
+TEST(AllocNearTest, GroupTest)
+{
+    typedef CountingVAlloc<ManyPagesProperties<TEST_PAGE_POLICY, true> > Alloc;
+    Alloc alloc;
+    alloc.start();
+
+    struct Node { VPtr<Node, Alloc> next; char data[8]; };
+
+    // two lists allocated alternately: without groups, nodes of both lists are interleaved
+    VAllocGroup<Alloc> groups[2];
+    VPtr<Node, Alloc> heads[2];
+    heads[0].setRawNum(0);
+    heads[1].setRawNum(0);
+    int samepage = 0;
+    for (int i=0; i<80; ++i)
+    {
+        VPtr<Node, Alloc> node = groups[i % 2].alloc<Node>();
+        ASSERT_FALSE(node == NILL);
+        node->next = heads[i % 2];
+        node->data[0] = (char)i;
+        if (heads[i % 2] != NILL && (node.getRawNum() / alloc.getBigPageSize()) == (heads[i % 2].getRawNum() / alloc.getBigPageSize()))
+            ++samepage;
+        heads[i % 2] = node;
+    }
+    EXPECT_GE(samepage, 50);
+
+    for (int l=0; l<2; ++l)
+    {
+        int i = 78 + l;
+        for (VPtr<Node, Alloc> node=heads[l]; node != NILL; i-=2)
+        {
+            EXPECT_EQ(node->data[0], (char)i);
+            VPtr<Node, Alloc> next = node->next;
+            alloc.free(node);
+            node = next;
+        }
+        EXPECT_EQ(i, l - 2);
+        groups[l].release();
+    }
+
+    alloc.stop();
+}
+
+TEST(PrefetchTest, PageCacheTest)
+{
+    typedef CountingVAlloc<ManyPagesProperties<TEST_PAGE_POLICY, true> > Alloc;
+    Alloc alloc;
+    alloc.start();
+#ifdef VIRTMEM_READ_AHEAD
+    alloc.setReadAhead(false);
+#endif
+
+    const VPtrSize size = 1024 * 2;
+    const VPtrNum vbuffer = alloc.allocRaw(size);
+    for (VPtrSize i=0; i<size; ++i)
+    {
+        const char c = (char)(i * 7);
+        alloc.write(vbuffer + i, &c, sizeof(c));
+    }
+    alloc.clearPages();
+    alloc.resetCounters();
+
+    // prefetched data is accessed without reading the pool again
+    const VPtrSize psize = alloc.getBigPageSize() * 6;
+    alloc.prefetch(vbuffer, psize);
+    const uint32_t reads = alloc.reads;
+    EXPECT_GT(reads, 0);
+    alloc.prefetch(vbuffer, psize);
+    EXPECT_EQ(alloc.reads, reads);
+    for (VPtrSize i=0; i<psize; ++i)
+        ASSERT_EQ(*(char *)alloc.read(vbuffer + i, sizeof(char)), (char)(i * 7));
+    EXPECT_EQ(alloc.reads, reads);
+
+    VPtr<char, Alloc> p;
+    p.setRawNum(vbuffer + psize);
+    p.prefetch(psize);
+    const uint32_t preads = alloc.reads;
+    EXPECT_GT(preads, reads);
+    for (VPtrSize i=psize; i<(psize * 2); ++i)
+        ASSERT_EQ(*(char *)alloc.read(vbuffer + i, sizeof(char)), (char)(i * 7));
+    EXPECT_EQ(alloc.reads, preads);
+
+    alloc.stop();
+}
+
+TEST(PrefetchTest, StdioTest)
+{
+    typedef StdioVAllocP<ManyPagesProperties<TEST_PAGE_POLICY, true> > Alloc;
+    Alloc alloc(1024 * 64);
+    alloc.start();
+#ifdef VIRTMEM_READ_AHEAD
+    alloc.setReadAhead(false);
+#endif
+
+    const VPtrSize size = 1024 * 32, chunk = 512;
+    VPtr<char, Alloc> vbuffer = alloc.alloc<char>(size);
+    std::vector<char> buffer(size);
+    for (VPtrSize i=0; i<size; ++i)
+        vbuffer[i] = buffer[i] = (char)(i * 7);
+    alloc.clearPages();
+
+    // data is modified while the next chunk is loading, also in the chunk itself
+    for (VPtrSize c=0; c<size; c+=chunk)
+    {
+        if ((c + chunk) < size)
+        {
+            (vbuffer + c + chunk).prefetch(chunk);
+            vbuffer[c + chunk + 1] = buffer[c + chunk + 1] = (char)c;
+        }
+        for (VPtrSize i=c; i<(c + chunk); ++i)
+        {
+            ASSERT_EQ((char)vbuffer[i], buffer[i]);
+            if ((i % 5) == 0)
+                vbuffer[i] = buffer[i] = (char)(i * 3);
+        }
+    }
+
+    alloc.clearPages();
+    for (VPtrSize i=0; i<size; ++i)
+        ASSERT_EQ((char)vbuffer[i], buffer[i]);
+
+    alloc.free(vbuffer);
+    alloc.stop();
+}
+
+struct MultiInstanceProperties : public ManyPagesProperties<TEST_PAGE_POLICY, true>
+{
+    static const bool multiInstance = true;
+};
+
+TEST(MultiInstanceTest, ScopeTest)
+{
+    typedef CountingVAlloc<MultiInstanceProperties> Alloc;
+    Alloc::setCurrentInstance(0);
+    Alloc allocs[2];
+    EXPECT_EQ(Alloc::getInstance(), &allocs[0]); // first instance becomes current
+
+    // same addresses in both instances, but different data
+    VPtr<int, Alloc> ptrs[2];
+    for (int i=0; i<2; ++i)
+    {
+        VAllocScope<Alloc> scope(allocs[i]);
+        EXPECT_EQ(Alloc::getInstance(), &allocs[i]);
+        allocs[i].start();
+        ptrs[i] = allocs[i].alloc<int>(sizeof(int) * 100);
+        for (int j=0; j<100; ++j)
+            ptrs[i][j] = j * (i + 1);
+    }
+    EXPECT_EQ(Alloc::getInstance(), &allocs[0]);
+    EXPECT_EQ(ptrs[0].getRawNum(), ptrs[1].getRawNum());
+
+    for (int i=1; i>=0; --i)
+    {
+        allocs[i].makeCurrent();
+        allocs[i].clearPages();
+        for (int j=0; j<100; ++j)
+            ASSERT_EQ(ptrs[i][j], j * (i + 1));
+        allocs[i].free(ptrs[i]);
+        allocs[i].stop();
+    }
+}
+
+#ifdef VIRTMEM_CPP11
+TEST(MultiInstanceTest, ThreadTest)
+{
+    typedef StdioVAllocP<MultiInstanceProperties> Alloc;
+    const int threadcount = 4, size = 1024 * 4;
+
+    // every thread uses its own instance, without locking
+    std::atomic<int> errors(0);
+    std::vector<std::thread> threads;
+    for (int t=0; t<threadcount; ++t)
+    {
+        threads.push_back(std::thread([&errors, t, size]()
+        {
+            Alloc alloc(1024 * 16);
+            EXPECT_EQ(Alloc::getInstance(), &alloc);
+            alloc.start();
+
+            VPtr<char, Alloc> buf = alloc.alloc<char>(size);
+            for (int r=0; r<10; ++r)
+            {
+                for (int i=0; i<size; ++i)
+                    buf[i] = (char)(i * t + r);
+                alloc.clearPages();
+                for (int i=0; i<size; ++i)
+                {
+                    if (buf[i] != (char)(i * t + r))
+                        ++errors;
+                }
+            }
+
+            alloc.free(buf);
+            alloc.stop();
+        }));
+    }
+    for (size_t t=0; t<threads.size(); ++t)
+        threads[t].join();
+
+    EXPECT_EQ(errors, 0);
+}
+#endif
+
+#ifdef VIRTMEM_COROUTINES
+template <typename Alloc> VTask sumTask(Alloc &alloc, VPtr<int, Alloc> values, int count, int stride, int *result)
+{
+    for (int i=0; i<count; ++i)
+        *result += *co_await alloc.readAsync(values + i * stride);
+}
+
+template <typename Alloc> VTask incrementTask(VPtr<int, Alloc> values, int count)
+{
+    VPtrLock<VPtr<int, Alloc> > lock = co_await lockAsync(values, sizeof(int) * count);
+    for (int i=0; i<count; ++i)
+        ++(*lock)[i];
+}
+
+TEST(CoroutineTest, BatchTest)
+{
+    typedef CountingVAlloc<ManyPagesProperties<TEST_PAGE_POLICY, true> > Alloc;
+    Alloc alloc;
+    alloc.start();
+#ifdef VIRTMEM_READ_AHEAD
+    alloc.setReadAhead(false);
+#endif
+
+    // every task reads from its own page, misses of all tasks are loaded together
+    const int taskcount = 8, count = 8, stride = alloc.getBigPageSize() / sizeof(int) * taskcount;
+    VPtr<int, Alloc> values = alloc.alloc<int>(sizeof(int) * stride * count);
+    for (int i=0; i<(stride * count); ++i)
+        values[i] = i;
+    alloc.clearPages();
+    alloc.resetCounters();
+
+    int sums[taskcount] = { };
+    VTaskScheduler scheduler;
+    for (int t=0; t<taskcount; ++t)
+        scheduler.spawn(sumTask(alloc, values + t * (stride / taskcount), count, stride, &sums[t]));
+    EXPECT_EQ(scheduler.getTaskCount(), (size_t)taskcount);
+    scheduler.run();
+    EXPECT_EQ(scheduler.getTaskCount(), 0u);
+
+    for (int t=0; t<taskcount; ++t)
+    {
+        int expected = 0;
+        for (int i=0; i<count; ++i)
+            expected += t * (stride / taskcount) + i * stride;
+        EXPECT_EQ(sums[t], expected);
+    }
+    // about one request per round instead of one per page
+    EXPECT_LE(alloc.reads, (uint32_t)count * 2);
+    EXPECT_LE(scheduler.getRequestCount(), (uint32_t)count * 2);
+
+    for (int t=0; t<taskcount; ++t)
+        scheduler.spawn(incrementTask(values + t * 100, 10));
+    scheduler.run();
+    alloc.clearPages();
+    for (int i=0; i<(stride * count); ++i)
+        ASSERT_EQ(values[i], i + ((i % 100) < 10 && i < (taskcount * 100)));
+
+    alloc.free(values);
+    alloc.stop();
+}
+#endif
+
+#ifdef VIRTMEM_THREAD_SAFE
+TEST(ThreadSafeTest, ConcurrentAccessTest)
+{
+    typedef CountingVAlloc<SizeClassProperties> Alloc;
+    Alloc alloc;
+    alloc.start();
+
+    // each thread allocates, writes and checks its own blocks, while the small page cache is shared
+    std::atomic<int> errors(0), started(0);
+    std::vector<std::thread> threads;
+    for (int t=0; t<4; ++t)
+    {
+        threads.push_back(std::thread([&alloc, &errors, &started, t]()
+        {
+            for (++started; started < 4; )
+                std::this_thread::yield();
+
+            uint32_t seed = t + 1;
+            for (int round=0; round<2000; ++round)
+            {
+                seed = seed * 1103515245 + 12345;
+                const int count = 4 + (seed >> 16) % 60;
+                VPtr<int, Alloc> buf = alloc.alloc<int>(count * sizeof(int));
+                for (int i=0; i<count; ++i)
+                    buf[i] = t * 100000 + round * 100 + i;
+                for (int i=0; i<count; ++i)
+                {
+                    if (buf[i] != (t * 100000 + round * 100 + i))
+                        ++errors;
+                }
+
+                // locked data stays valid while other threads swap pages
+                VPtrLock<VPtr<int, Alloc> > lock = makeVirtPtrLock(buf, count * sizeof(int), true);
+                for (int i=0; i<(int)(lock.getLockSize() / sizeof(int)); ++i)
+                {
+                    std::this_thread::yield();
+                    if ((*lock)[i] != (t * 100000 + round * 100 + i))
+                        ++errors;
+                }
+                lock.unlock();
+
+                alloc.free(buf);
+            }
+        }));
+    }
+    for (size_t t=0; t<threads.size(); ++t)
+        threads[t].join();
+
+    EXPECT_EQ(errors, 0);
+    alloc.stop();
+}
+
+TEST(ThreadSafeTest, OptimisticReadTest)
+{
+    typedef CountingVAlloc<SizeClassProperties> Alloc;
+    Alloc alloc;
+    alloc.start();
+
+    const int count = 1024;
+    VPtr<int, Alloc> buf = alloc.alloc<int>(count * sizeof(int));
+    for (int i=0; i<count; ++i)
+        buf[i] = i;
+    alloc.flush();
+
+    // clean pages are read without locking, while pages are swapped and modified
+    srand(1);
+    for (int n=0; n<20000; ++n)
+    {
+        const int i = rand() % count;
+        if ((n % 8) == 0)
+            buf[i] = i + count;
+        ASSERT_TRUE(buf[i] == i || buf[i] == (i + count));
+        if ((n % 128) == 0)
+            alloc.flush();
+    }
+
+    // data that is modified through a lock is not read from the big page
+    alloc.flush();
+    int value = buf[10];
+    VPtrLock<VPtr<int, Alloc> > lock = makeVirtPtrLock(buf + 10, sizeof(int));
+    **lock = 55;
+    alloc.read((buf + 10).getRawNum(), &value, sizeof(int));
+    EXPECT_EQ(value, 55);
+    lock.unlock();
+    EXPECT_EQ(buf[10], 55);
+
+    // a value written by another thread is never read partially
+    struct Pair { int a, b; };
+    VPtr<Pair, Alloc> pair = alloc.alloc<Pair>();
+    const Pair start = { 0, 0 };
+    *pair = start;
+    std::atomic<bool> done(false);
+    std::thread writer([&pair, &alloc, &done]()
+    {
+        for (int i=1; i<=2000; ++i)
+        {
+            const Pair p = { i, i };
+            *pair = p;
+            alloc.flush(); // clean again, so readers use the optimistic path
+        }
+        done = true;
+    });
+    int errors = 0;
+    while (!done)
+    {
+        const Pair p = *pair;
+        if (p.a != p.b)
+            ++errors;
+    }
+    writer.join();
+    EXPECT_EQ(errors, 0);
+
+    alloc.stop();
+}
+
+TEST(ThreadSafeTest, OptimisticDiscardTest)
+{
+    typedef CountingVAlloc<VictimCacheProperties> Alloc;
+    Alloc alloc;
+    alloc.start();
+
+    const int count = 256;
+    VPtr<int, Alloc> values = alloc.alloc<int>(count * sizeof(int));
+    VPtr<int, Alloc> scratch = alloc.alloc<int>(count * sizeof(int));
+    for (int i=0; i<count; ++i)
+        values[i] = i;
+    alloc.flush();
+
+    // another thread modifies and discards data, so the big pages (and victim cache entries) that are
+    // read optimistically are recycled for other data while reads are in flight
+    std::atomic<bool> done(false);
+    std::thread discarder([&scratch, &alloc, &done]()
+    {
+        for (int n=0; n<2000; ++n)
+        {
+            for (int i=0; i<count; i+=8)
+                scratch[i] = -1;
+            alloc.discardRange(scratch.getRawNum(), count * sizeof(int));
+        }
+        done = true;
+    });
+    int errors = 0;
+    for (int n=0; !done; ++n)
+    {
+        const int i = (n * 7) % count;
+        if (values[i] != i)
+            ++errors;
+    }
+    discarder.join();
+    EXPECT_EQ(errors, 0);
+
+    alloc.stop();
+}
+
+struct ShardedCacheProperties
+{
+    static const uint8_t smallPageCount = 4, smallPageSize = 32;
+    static const uint8_t mediumPageCount = 4, mediumPageSize = 64;
+    static const uint8_t bigPageCount = 8, bigPageSize = 128;
+    static const bool bigPageGrid = true;
+    static const uint8_t cacheShards = 4;
+};
+
+// Allocator of which reads can be held up, to check which accesses wait for a page miss of another thread
+template <typename Properties> class BlockingVAlloc : public VAlloc<Properties, BlockingVAlloc<Properties> >
+{
+    enum { POOL_SIZE = 1024 * 4 };
+    char data[POOL_SIZE];
+
+    void doStart(void) { }
+    void doSuspend(void) { }
+    void doStop(void) { }
+    void doRead(void *d, VPtrSize offset, VPtrSize size)
+    {
+        for (blocked = true; block; )
+            std::this_thread::yield();
+        blocked = false;
+        memcpy(d, &data[offset], size);
+    }
+    void doWrite(const void *d, VPtrSize offset, VPtrSize size) { memcpy(&data[offset], d, size); }
+
+public:
+    std::atomic<bool> block, blocked;
+
+    BlockingVAlloc(void) : block(false), blocked(false) { this->setPoolSize(POOL_SIZE); }
+};
+
+TEST(ThreadSafeTest, ShardLockTest)
+{
+    typedef BlockingVAlloc<ShardedCacheProperties> Alloc;
+    Alloc alloc;
+    alloc.start();
+#ifdef VIRTMEM_READ_AHEAD
+    alloc.setReadAhead(false); // page misses that read ahead lock all shards
+#endif
+
+    // successive big pages belong to different shards
+    const VPtrSize pagesize = ShardedCacheProperties::bigPageSize;
+    const VPtrNum buf = alloc.allocRaw(pagesize * 4);
+    const VPtrNum page1 = (buf / pagesize + 1) * pagesize, page2 = page1 + pagesize;
+    int value = 1;
+    alloc.clearPages();
+    alloc.write(page1, &value, sizeof(value));
+
+    // a page miss only blocks its own shard, so the cached page of another shard stays accessible
+    alloc.block = true;
+    std::thread reader([&alloc, page2]()
+    {
+        int v;
+        alloc.read(page2, &v, sizeof(v));
+    });
+    while (!alloc.blocked)
+        std::this_thread::yield();
+
+    std::atomic<bool> written(false);
+    std::thread writer([&alloc, &written, page1]()
+    {
+        const int v = 2;
+        alloc.write(page1, &v, sizeof(v));
+        written = true;
+    });
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    while (!written && (std::chrono::steady_clock::now() - start) < std::chrono::seconds(5))
+        std::this_thread::yield();
+    EXPECT_TRUE(written);
+
+    alloc.block = false;
+    reader.join();
+    writer.join();
+    alloc.read(page1, &value, sizeof(value));
+    EXPECT_EQ(value, 2);
+
+    alloc.stop();
+}
+
+TEST(ThreadSafeTest, ShardLockFrameTest)
+{
+    typedef CountingVAlloc<ShardedCacheProperties> Alloc;
+    Alloc alloc;
+    alloc.start();
+
+    // every fourth big page belongs to the same shard, which has two frames
+    const VPtrSize pagesize = ShardedCacheProperties::bigPageSize;
+    const VPtrNum buf = alloc.allocRaw(pagesize * 16);
+    const VPtrNum page1 = (buf / pagesize + 1) * pagesize, page2 = page1 + pagesize * 4, page3 = page2 + pagesize * 4;
+    for (VPtrNum p=page1; p<=page3; p+=pagesize*4)
+    {
+        const int v = (int)p;
+        alloc.write(p, &v, sizeof(v));
+    }
+
+    // locks should not take the last frame of a shard
+    int *lock1 = static_cast<int *>(alloc.makeDataLock(page1, pagesize));
+    int *lock2 = static_cast<int *>(alloc.makeDataLock(page2, pagesize));
+    EXPECT_EQ(*lock1, (int)page1);
+    EXPECT_EQ(*lock2, (int)page2);
+    *lock2 = 2;
+
+    int value;
+    alloc.read(page3, &value, sizeof(value));
+    EXPECT_EQ(value, (int)page3);
+
+    alloc.releaseLock(page1);
+    alloc.releaseLock(page2);
+    alloc.read(page2, &value, sizeof(value));
+    EXPECT_EQ(value, 2);
+
+    alloc.stop();
+}
+
+TEST(ThreadSafeTest, ShardedAccessTest)
+{
+    typedef CountingVAlloc<ShardedCacheProperties> Alloc;
+    Alloc alloc;
+    alloc.start();
+
+    // threads increment interleaved values, so all of them swap pages of all shards. Some values are incremented
+    // through locks, which lock all shards. Page misses read ahead (which locks all shards) in the first pass.
+    const int count = 1024, rounds = 50;
+    VPtr<int, Alloc> buf = alloc.alloc<int>(count * sizeof(int));
+#ifdef VIRTMEM_READ_AHEAD
+    for (int readahead=1; readahead>=0; --readahead)
+    {
+        alloc.setReadAhead(readahead);
+#else
+    for (int pass=0; pass<1; ++pass)
+    {
+#endif
+        for (int i=0; i<count; ++i)
+            buf[i] = 0;
+
+        std::vector<std::thread> threads;
+        for (int t=0; t<4; ++t)
+        {
+            threads.push_back(std::thread([&buf, t]()
+            {
+                for (int round=0; round<rounds; ++round)
+                {
+                    for (int i=t; i<count; i+=4)
+                    {
+                        if ((i % 64) == t)
+                        {
+                            VPtrLock<VPtr<int, Alloc> > lock = makeVirtPtrLock(buf + i, sizeof(int));
+                            ++(**lock);
+                        }
+                        else
+                            buf[i] = buf[i] + 1;
+                    }
+                }
+            }));
+        }
+        for (size_t t=0; t<threads.size(); ++t)
+            threads[t].join();
+
+        alloc.clearPages();
+        for (int i=0; i<count; ++i)
+            ASSERT_EQ(buf[i], rounds);
+    }
+
+    alloc.free(buf);
+    alloc.stop();
+}
+#endif
+
+struct ZeroFillProperties
+{
+    static const uint8_t smallPageCount = 4, smallPageSize = 32;
+    static const uint8_t mediumPageCount = 4, mediumPageSize = 64;
+    static const uint8_t bigPageCount = 4, bigPageSize = 128;
+#ifdef VIRTMEM_ZERO_FILL
+    static const uint16_t zeroFillRegions = 64;
+#endif
+};
+
+#ifdef VIRTMEM_ZERO_FILL
+TEST(ZeroFillTest, UntouchedReadTest)
+{
+    typedef CountingVAlloc<ZeroFillProperties> Alloc;
+    Alloc alloc;
+    alloc.fillPool(55);
+    alloc.start();
+    ASSERT_TRUE(alloc.hasLazyZeroFill());
+
+    const VPtrSize size = 1024 * 8, regionsize = alloc.getPoolSize() / ZeroFillProperties::zeroFillRegions;
+    const VPtrNum vbuffer = alloc.allocRaw(size);
+    alloc.flush();
+    alloc.clearPages();
+    alloc.resetCounters();
+
+    // untouched memory reads as zeros without I/O
+    for (VPtrSize i=1024; i<size; ++i)
+        ASSERT_EQ(*(char *)alloc.read(vbuffer + i, sizeof(char)), 0);
+    EXPECT_EQ(alloc.reads, 0);
+
+    // other data in a partially written region should still be zero
+    const VPtrSize offset = 4000;
+    const char val = 12;
+    alloc.write(vbuffer + offset, &val, sizeof(val));
+    alloc.flush();
+    EXPECT_GE(alloc.bytesWritten, regionsize);
+    alloc.resetCounters();
+    alloc.write(vbuffer + offset + 1, &val, sizeof(val));
+    alloc.flush();
+    EXPECT_LT(alloc.bytesWritten, regionsize); // no padding needed anymore
+
+    alloc.clearPages();
+    alloc.resetCounters();
+    for (VPtrSize i=1024; i<size; ++i)
+        ASSERT_EQ(*(char *)alloc.read(vbuffer + i, sizeof(char)), (i == offset || i == (offset + 1)) ? val : 0);
+    EXPECT_GT(alloc.reads, 0);
+    EXPECT_LT(alloc.reads, regionsize * 2 / alloc.getBigPageSize() + 2);
+
+    // start() clears everything
+    alloc.stop();
+    alloc.start();
+    alloc.resetCounters();
+    for (VPtrSize i=1024; i<size; ++i)
+        ASSERT_EQ(*(char *)alloc.read(vbuffer + i, sizeof(char)), 0);
+    EXPECT_EQ(alloc.reads, 0);
+    alloc.stop();
+}
+
+#endif
+
+struct StdioZeroFillProperties : public ZeroFillProperties
+{
+    static const bool bigPageGrid = true;
+#ifdef VIRTMEM_ZERO_FILL
+    static const uint16_t zeroFillRegions = 1024 * 8;
+#endif
+};
+
+#ifdef VIRTMEM_ZERO_FILL
+TEST(ZeroFillTest, LargeStdioPoolTest)
+{
+    // NOTE: initialization should be fast, as nothing is written
+    const VPtrSize poolsize = (VPtrSize)1024 * 1024 * 512;
+    typedef StdioVAllocP<StdioZeroFillProperties> Alloc;
+    Alloc alloc(poolsize);
+    alloc.start();
+
+    const VPtrSize size = poolsize - 1024 * 1024;
+    const VPtrNum vbuffer = alloc.allocRaw(size);
+    ASSERT_NE(vbuffer, 0);
+
+    std::map<VPtrSize, char> written;
+    srand(1);
+    for (int i=0; i<200; ++i)
+    {
+        const VPtrSize offset = ((VPtrSize)rand() * 4099) % size;
+        const char c = (char)(1 + rand() % 100);
+        alloc.write(vbuffer + offset, &c, sizeof(c));
+        written[offset] = c;
+    }
+
+    alloc.clearPages();
+    for (std::map<VPtrSize, char>::iterator it=written.begin(); it!=written.end(); ++it)
+    {
+        ASSERT_EQ(*(char *)alloc.read(vbuffer + it->first, sizeof(char)), it->second);
+        if (written.find(it->first + 1) == written.end() && (it->first + 1) < size)
+        {
+            ASSERT_EQ(*(char *)alloc.read(vbuffer + it->first + 1, sizeof(char)), 0);
+        }
+    }
+
+    alloc.stop();
+}
+#endif
+
+TEST(PersistentTest, RestartTest)
+{
+    typedef StaticVAllocP<1024 * 16, ManyLocksProperties> Alloc;
+    Alloc alloc;
+    EXPECT_TRUE(alloc.setPersistent(true));
+    alloc.start();
+    EXPECT_FALSE(alloc.isRestored());
+    EXPECT_EQ(alloc.getRoot("data"), 0);
+
+    const VPtrSize size = 1024 * 2;
+    const VPtrNum vbuffer = alloc.allocRaw(size), vtmp = alloc.allocRaw(size);
+    ASSERT_NE(vbuffer, 0);
+    for (VPtrSize i=0; i<size; ++i)
+    {
+        const char c = (char)(i * 3);
+        alloc.write(vbuffer + i, &c, sizeof(c));
+    }
+    EXPECT_TRUE(alloc.setRoot("data", vbuffer));
+    EXPECT_TRUE(alloc.setRoot("tmp", vtmp));
+    alloc.stop();
+
+    alloc.start();
+    ASSERT_TRUE(alloc.isRestored());
+    ASSERT_EQ(alloc.getRoot("data"), vbuffer);
+    ASSERT_EQ(alloc.getRoot("tmp"), vtmp);
+    EXPECT_EQ(alloc.getRoot("dat"), 0);
+    for (VPtrSize i=0; i<size; ++i)
+        ASSERT_EQ(*(char *)alloc.read(vbuffer + i, sizeof(char)), (char)(i * 3));
+
+    // freed memory is reused, other allocations should not overlap with restored data
+    alloc.freeRaw(vtmp);
+    EXPECT_TRUE(alloc.setRoot("tmp", 0));
+    EXPECT_EQ(alloc.getRoot("tmp"), 0);
+    for (int i=0; i<4; ++i)
+    {
+        const VPtrNum p = alloc.allocRaw(size / 2);
+        ASSERT_NE(p, 0);
+        EXPECT_TRUE(p >= (vbuffer + size) || (p + size / 2) <= vbuffer);
+        char zeros[64] = { 0 };
+        for (VPtrSize j=0; j<(size / 2); j+=sizeof(zeros))
+            alloc.write(p + j, zeros, sizeof(zeros));
+    }
+
+    // roots are limited
+    char name[16];
+    int roots = 1;
+    for (; roots<20; ++roots)
+    {
+        sprintf(name, "root%d", roots);
+        if (!alloc.setRoot(name, vbuffer + roots))
+            break;
+    }
+    EXPECT_EQ(roots, 8);
+    alloc.setRoot("root1", 0);
+    EXPECT_TRUE(alloc.setRoot("new", vbuffer));
+    alloc.flush();
+
+    // flush() also stores the state
+    alloc.start();
+    ASSERT_TRUE(alloc.isRestored());
+    EXPECT_EQ(alloc.getRoot("new"), vbuffer);
+    EXPECT_EQ(alloc.getRoot("root7"), vbuffer + 7);
+    for (VPtrSize i=0; i<size; ++i)
+        ASSERT_EQ(*(char *)alloc.read(vbuffer + i, sizeof(char)), (char)(i * 3));
+    alloc.stop();
+}
+
+TEST(PersistentTest, StdioFileTest)
+{
+    const char *file = "virtmem_persistent_test.vm";
+    const VPtrSize poolsize = 1024 * 1024;
+    typedef StdioVAllocP<StdioZeroFillProperties> Alloc;
+    remove(file);
+
+    {
+        Alloc alloc(poolsize, file);
+        alloc.setPersistent(true);
+        alloc.start();
+        EXPECT_FALSE(alloc.isRestored());
+        Alloc::TVPtr<int>::type data = alloc.alloc<int>(1024 * sizeof(int));
+        for (int i=0; i<1024; ++i)
+            data[i] = i * 5;
+        alloc.setRoot("data", data);
+        alloc.stop();
+    }
+
+    {
+        Alloc alloc(poolsize, file);
+        alloc.setPersistent(true);
+        alloc.start();
+        ASSERT_TRUE(alloc.isRestored());
+        Alloc::TVPtr<int>::type data = alloc.getRoot<int>("data");
+        ASSERT_NE(data.getRawNum(), 0);
+        for (int i=0; i<1024; ++i)
+            ASSERT_EQ(data[i], i * 5);
+        alloc.stop();
+    }
+
+    {
+        // different pool size: new pool
+        Alloc alloc(poolsize * 2, file);
+        alloc.setPersistent(true);
+        alloc.start();
+        EXPECT_FALSE(alloc.isRestored());
+        EXPECT_EQ(alloc.getRoot("data"), 0);
+        alloc.stop();
+    }
+
+    remove(file);
+}
+
+#ifdef VIRTMEM_LARGE_PAGES
+struct ManyLargePagesProperties
+{
+    static const uint8_t smallPageCount = 4, smallPageSize = 32;
+    static const uint8_t mediumPageCount = 4, mediumPageSize = 128;
+    static const uint16_t bigPageCount = 300;
+    static const uint32_t bigPageSize = 1024 * 128;
+    static const bool bigPageGrid = true;
+};
+
+TEST(LargePagesTest, SimpleTest)
+{
+    typedef StaticVAllocP<1024 * 1024 * 64, ManyLargePagesProperties> Alloc;
+    static Alloc alloc; // too large for the stack
+    alloc.start();
+
+    EXPECT_EQ(alloc.getBigPageCount(), 300);
+    EXPECT_EQ(alloc.getBigPageSize(), 1024 * 128);
+
+    const VPtrSize size = 1024 * 1024 * 63;
+    const VPtrNum vbuffer = alloc.allocRaw(size);
+    ASSERT_NE(vbuffer, 0);
+    const VPtrSize step = 4093; // not a multiple of the page size
+    for (VPtrSize i=0; i<size; i+=step)
+        alloc.write(vbuffer + i, &i, sizeof(i));
+
+    alloc.clearPages();
+    for (VPtrSize i=0; i<size; i+=step)
+    {
+        // the data is not aligned, so copy it out instead of dereferencing it
+        VPtrSize val;
+        memcpy(&val, alloc.read(vbuffer + i, sizeof(VPtrSize)), sizeof(val));
+        ASSERT_EQ(val, i);
+    }
+
+    alloc.stop();
+}
+#endif
+
+#ifdef VIRTMEM_VPTR_64BIT
+// Allocator with a sparse (RAM) storage, so that pools larger than 4 GB can be tested
+class SparseVAlloc : public VAlloc<DefaultAllocProperties, SparseVAlloc>
+{
+    enum { CHUNK_SIZE = 1024 * 4 };
+    typedef std::map<VPtrNum, std::vector<char> > ChunkMap;
+    ChunkMap chunks;
+
+    char *getChunkData(VPtrNum offset)
+    {
+        std::vector<char> &chunk = chunks[offset / CHUNK_SIZE];
+        if (chunk.empty())
+            chunk.resize(CHUNK_SIZE);
+        return &chunk[offset % CHUNK_SIZE];
+    }
+
+    void doStart(void) { }
+    void doSuspend(void) { }
+    void doStop(void) { chunks.clear(); }
+    void doRead(void *d, VPtrSize offset, VPtrSize size)
+    {
+        for (VPtrSize i=0; i<size; ++i)
+            static_cast<char *>(d)[i] = *getChunkData(offset + i);
+    }
+    void doWrite(const void *d, VPtrSize offset, VPtrSize size)
+    {
+        for (VPtrSize i=0; i<size; ++i)
+            *getChunkData(offset + i) = static_cast<const char *>(d)[i];
+    }
+
+public:
+    SparseVAlloc(VPtrSize ps) { setPoolSize(ps); }
+};
+
+TEST(VPtr64BitTest, LargePoolTest)
+{
+    const VPtrSize fourgb = (VPtrSize)1 << 32;
+    SparseVAlloc alloc(fourgb * 2);
+    alloc.start();
+
+    const VPtrNum vbuffer = alloc.allocRaw(fourgb + 1024);
+    ASSERT_NE(vbuffer, 0);
+    for (VPtrSize i=0; i<=fourgb; i+=(fourgb / 8))
+        alloc.write(vbuffer + i, &i, sizeof(i));
+
+    // pointers beyond the 32 bit range
+    VPtr<VPtrSize, SparseVAlloc> vptr = alloc.alloc<VPtrSize>();
+    ASSERT_NE(vptr, NILL);
+    EXPECT_GT(vptr.getRawNum(), fourgb);
+    *vptr = fourgb + 1;
+
+    alloc.clearPages();
+    for (VPtrSize i=0; i<=fourgb; i+=(fourgb / 8))
+        ASSERT_EQ(*(VPtrSize *)alloc.read(vbuffer + i, sizeof(VPtrSize)), i);
+    EXPECT_EQ((VPtrSize)*vptr, fourgb + 1);
+
+    alloc.free(vptr);
+    alloc.freeRaw(vbuffer);
+    alloc.stop();
+}
+#endif
@@ -0,0 +1,7 @@
+# Same tests built as C++20, so the coroutine API (VIRTMEM_COROUTINES) is tested as well
+include(test.pro)
+
+TARGET = test_cpp20
+OBJECTS_DIR = cpp20
+QMAKE_CXXFLAGS -= -std=gnu++11
+QMAKE_CXXFLAGS += -std=gnu++20
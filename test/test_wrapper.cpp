@@ -242,23 +242,32 @@ TYPED_TEST(LimitedWrapFixture, WrappedArithmeticTest)
 }
 #endif
 
+// Big pages are only loaded at aligned addresses if they are on a grid
+struct GridAllocProperties : public DefaultAllocProperties
+{
+    static const bool bigPageGrid = true;
+};
+
 TEST_F(IntWrapFixture, AlignmentTest)
 {
     const int bufsize = 17;
+    StdioVAllocP<GridAllocProperties> gridAlloc(1024 * 1024 * 10);
+    gridAlloc.start();
 
-    this->vptr = vAlloc.alloc<int>();
-    CharVirtPtr buf = vAlloc.alloc<char>(bufsize);
-    CharVirtPtr unalignedbuf = &buf[1];
-    vAlloc.clearPages();
+    StdioVAllocP<GridAllocProperties>::TVPtr<int>::type intptr = gridAlloc.alloc<int>();
+    StdioVAllocP<GridAllocProperties>::TVPtr<char>::type buf = gridAlloc.alloc<char>(bufsize);
+    StdioVAllocP<GridAllocProperties>::TVPtr<char>::type unalignedbuf = &buf[1];
+    gridAlloc.clearPages();
     volatile char c = *unalignedbuf; // force load of unaligned address
-    ASSERT_EQ(reinterpret_cast<intptr_t>(vAlloc.read(this->vptr.getRawNum(), sizeof(int))) & (sizeof(int)-1), 0);
+    ASSERT_EQ(reinterpret_cast<intptr_t>(gridAlloc.read(intptr.getRawNum(), sizeof(int))) & (sizeof(int)-1), 0);
 
     // check if int is still aligned after locking a big page
-    vAlloc.clearPages();
-    vAlloc.makeDataLock(unalignedbuf.getRawNum(), vAlloc.getBigPageSize(), true);
-    vAlloc.releaseLock(unalignedbuf.getRawNum());
+    gridAlloc.clearPages();
+    gridAlloc.makeDataLock(unalignedbuf.getRawNum(), gridAlloc.getBigPageSize(), true);
+    gridAlloc.releaseLock(unalignedbuf.getRawNum());
 
-    ASSERT_EQ(reinterpret_cast<intptr_t>(vAlloc.read(this->vptr.getRawNum(), sizeof(int))) & (sizeof(int)-1), 0);
+    ASSERT_EQ(reinterpret_cast<intptr_t>(gridAlloc.read(intptr.getRawNum(), sizeof(int))) & (sizeof(int)-1), 0);
+    gridAlloc.stop();
 }
 
 TEST_F(ClassWrapFixture, ClassAllocTest)
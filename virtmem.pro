@@ -2,5 +2,13 @@ TEMPLATE = subdirs
 CONFIG += ordered
 SUBDIRS = src \
           test \
-    benchmark
+    benchmark \
+    test_cpp20 \
+    benchmark_cpp20
 test.depends = lib
+
+# C++20 builds of the tests and benchmark (coroutines), next to the C++11 builds in the same directories
+test_cpp20.file = test/test_cpp20.pro
+test_cpp20.makefile = Makefile.cpp20
+benchmark_cpp20.file = benchmark/benchmark_cpp20.pro
+benchmark_cpp20.makefile = Makefile.cpp20